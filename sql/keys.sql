@@ -0,0 +1,46 @@
+--
+--  Create the optional "keys" table which lists the authorized
+--  client keys (see "beacon-receiver --check-keys").  Changes are
+--  announced to the receiver with NOTIFY on the "beacon_keys"
+--  channel; the payload is "+KEY" or "-KEY", or "reload" after
+--  TRUNCATE (which does not fire row triggers).
+--
+--  Run this after grant.sql.
+--
+--  author: Max Kellermann <max.kellermann@gmail.com>
+--
+
+CREATE TABLE IF NOT EXISTS keys (
+        key bigint PRIMARY KEY
+);
+
+CREATE OR REPLACE FUNCTION keys_notify() RETURNS trigger AS $$
+BEGIN
+        IF TG_OP IN ('DELETE', 'UPDATE') THEN
+                PERFORM pg_notify('beacon_keys', '-' || OLD.key);
+        END IF;
+
+        IF TG_OP IN ('INSERT', 'UPDATE') THEN
+                PERFORM pg_notify('beacon_keys', '+' || NEW.key);
+        END IF;
+
+        RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE TRIGGER keys_notify
+        AFTER INSERT OR UPDATE OR DELETE ON keys
+        FOR EACH ROW EXECUTE FUNCTION keys_notify();
+
+CREATE OR REPLACE FUNCTION keys_notify_reload() RETURNS trigger AS $$
+BEGIN
+        PERFORM pg_notify('beacon_keys', 'reload');
+        RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE TRIGGER keys_notify_reload
+        AFTER TRUNCATE ON keys
+        FOR EACH STATEMENT EXECUTE FUNCTION keys_notify_reload();
+
+GRANT SELECT ON keys TO "beacon-receiver";
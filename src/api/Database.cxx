@@ -8,31 +8,47 @@ namespace Beacon {
 ApiDatabase::ApiDatabase(const char *conninfo)
 	:db(conninfo)
 {
-	db.Prepare("SelectList",
-		   "SELECT key,"
-		   "to_char(MAX(time), 'YYYY-MM-DD\"T\"HH24:MI:SS.MS\"Z\"')"
-		   " FROM fixes"
-		   " WHERE time > now() at time zone 'UTC' - '4 hours'::interval"
-		   " GROUP BY key",
-		   0);
-
-	db.Prepare("SelectFixes",
-		   "SELECT ST_X(location),ST_Y(location),"
-		   "to_char(time, 'YYYY-MM-DD\"T\"HH24:MI:SS.MS\"Z\"')"
-		   " FROM fixes"
-		   " WHERE key=$1"
-		   " AND time > now() at time zone 'UTC' - '4 hours'::interval"
-		   " ORDER BY time LIMIT 16384",
-		   1);
-
-	db.Prepare("SelectFixesSince",
-		   "SELECT ST_X(location),ST_Y(location),"
-		   "to_char(time, 'YYYY-MM-DD\"T\"HH24:MI:SS.MS\"Z\"')"
-		   " FROM fixes"
-		   " WHERE key=$1 AND time>=$2"
-		   " AND time > now() at time zone 'UTC' - '4 hours'::interval"
-		   " ORDER BY time LIMIT 16384",
-		   2);
+	/* send all statements at once instead of waiting for each
+	   one */
+	db.EnterPipelineMode();
+
+	db.SendPrepare("SelectList",
+		       "SELECT key,"
+		       "to_char(MAX(time), 'YYYY-MM-DD\"T\"HH24:MI:SS.MS\"Z\"')"
+		       " FROM fixes"
+		       " WHERE time > now() at time zone 'UTC' - '4 hours'::interval"
+		       " GROUP BY key",
+		       0);
+
+	db.SendPrepare("SelectFixes",
+		       "SELECT ST_X(location),ST_Y(location),"
+		       "to_char(time, 'YYYY-MM-DD\"T\"HH24:MI:SS.MS\"Z\"'),"
+		       "altitude,speed,direction"
+		       " FROM fixes"
+		       " WHERE key=$1"
+		       " AND time > now() at time zone 'UTC' - '4 hours'::interval"
+		       " ORDER BY time LIMIT 16384",
+		       1);
+
+	db.SendPrepare("SelectFixesSince",
+		       "SELECT ST_X(location),ST_Y(location),"
+		       "to_char(time, 'YYYY-MM-DD\"T\"HH24:MI:SS.MS\"Z\"'),"
+		       "altitude,speed,direction"
+		       " FROM fixes"
+		       " WHERE key=$1 AND time>=$2"
+		       " AND time > now() at time zone 'UTC' - '4 hours'::interval"
+		       " ORDER BY time LIMIT 16384",
+		       2);
+
+	db.PipelineSync();
+
+	for (unsigned i = 0; i < 3; ++i)
+		db.ReceivePipelineResult();
+
+	/* the PGRES_PIPELINE_SYNC result */
+	db.ReceivePipelineResult();
+
+	db.ExitPipelineMode();
 }
 
 Pg::Result
@@ -44,13 +60,14 @@ ApiDatabase::SelectList()
 Pg::Result
 ApiDatabase::SelectFixes(const uint64_t key)
 {
-	return db.ExecutePrepared(false, "SelectFixes", key);
+	return db.ExecutePrepared(false, "SelectFixes", Pg::BinaryInt8(key));
 }
 
 Pg::Result
 ApiDatabase::SelectFixesSince(const uint64_t key, const char *since)
 {
-	return db.ExecutePrepared(false, "SelectFixesSince", key, since);
+	return db.ExecutePrepared(false, "SelectFixesSince",
+				  Pg::BinaryInt8(key), since);
 }
 
 } /* namespace Beacon */
@@ -59,6 +59,7 @@ HandleGPX(Beacon::ApiDatabase &db,
 		  "\n"
 		  "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n"
 		  "<gpx xmlns=\"http://www.topografix.com/GPX/1/1\"\n"
+		  "  xmlns:gpxtpx=\"http://www.garmin.com/xmlschemas/TrackPointExtension/v2\"\n"
 		  "  creator=\"beacon\" version=\"1.0\">\n"
 		  "<trk><trkseg>\n",
 		  out);
@@ -72,9 +73,31 @@ HandleGPX(Beacon::ApiDatabase &db,
 
 		const auto time = row.GetValue(2);
 
-		FCGX_FPrintF(out,
-			     "<trkpt lat=\"%s\" lon=\"%s\"><time>%s</time></trkpt>\n",
-			     latitude, longitude, time);
+		FCGX_FPrintF(out, "<trkpt lat=\"%s\" lon=\"%s\">",
+			     latitude, longitude);
+
+		if (!row.IsValueNull(3))
+			FCGX_FPrintF(out, "<ele>%s</ele>", row.GetValue(3));
+
+		FCGX_FPrintF(out, "<time>%s</time>", time);
+
+		/* GPX 1.1 has no speed/course elements; use the
+		   Garmin TrackPointExtension v2 */
+		if (!row.IsValueNull(4) || !row.IsValueNull(5)) {
+			FCGX_PutS("<extensions><gpxtpx:TrackPointExtension>", out);
+
+			if (!row.IsValueNull(4))
+				FCGX_FPrintF(out, "<gpxtpx:speed>%s</gpxtpx:speed>",
+					     row.GetValue(4));
+
+			if (!row.IsValueNull(5))
+				FCGX_FPrintF(out, "<gpxtpx:course>%s</gpxtpx:course>",
+					     row.GetValue(5));
+
+			FCGX_PutS("</gpxtpx:TrackPointExtension></extensions>", out);
+		}
+
+		FCGX_PutS("</trkpt>\n", out);
 
 	}
 
@@ -4,6 +4,7 @@
 
 #include "Loop.hxx"
 #include "DeferEvent.hxx"
+#include "LoopProfiler.hxx"
 #include "SocketEvent.hxx"
 #include "util/ScopeExit.hxx"
 
@@ -42,6 +43,8 @@ public:
 	}
 
 private:
+	using Uring::Operation::OnUringCompletion;
+
 	void OnUringCompletion(int res) noexcept override {
 		(void)res; // TODO
 
@@ -84,6 +87,8 @@ public:
 	}
 
 private:
+	using Uring::Operation::OnUringCompletion;
+
 	void OnUringCompletion(int res) noexcept override {
 		if (res <= 0)
 			return;
@@ -269,7 +274,7 @@ EventLoop::HandleTimers() noexcept
 #else
 	const Event::Duration fine_timeout{-1};
 #endif // NO_FINE_TIMER_EVENT
-	auto coarse_timeout = coarse_timers.Run(now);
+	auto coarse_timeout = coarse_timers.Run(now, profiler);
 
 	return GetEarlierTimeout(coarse_timeout, fine_timeout);
 }
@@ -312,12 +317,22 @@ EventLoop::AddNext(DeferEvent &e) noexcept
 	next.push_back(e);
 }
 
+inline void
+EventLoop::Invoke(const void *function, auto &&f) noexcept
+{
+	if (profiler == nullptr) [[likely]]
+		f();
+	else
+		profiler->Invoke(function, f);
+}
+
 void
 EventLoop::RunDeferred() noexcept
 {
 	while (!defer.empty() && !quit) {
-		defer.pop_front_and_dispose([](DeferEvent *e){
-			e->Run();
+		defer.pop_front_and_dispose([this](DeferEvent *e){
+			Invoke(e->callback.GetFunctionAddress(),
+			       [e]{ e->Run(); });
 		});
 	}
 }
@@ -328,8 +343,9 @@ EventLoop::RunOneIdle() noexcept
 	if (idle.empty())
 		return false;
 
-	idle.pop_front_and_dispose([](DeferEvent *e){
-		e->Run();
+	idle.pop_front_and_dispose([this](DeferEvent *e){
+		Invoke(e->callback.GetFunctionAddress(),
+		       [e]{ e->Run(); });
 	});
 
 	return true;
@@ -378,9 +394,16 @@ inline bool
 EventLoop::Poll(Event::Duration timeout) noexcept
 {
 	std::array<struct epoll_event, 256> received_events;
+
+	if (profiler != nullptr) [[unlikely]]
+		profiler->BeginWait();
+
 	int ret = poll_backend.Wait(received_events.data(),
 				    received_events.size(),
 				    ExportTimeoutMS(timeout));
+
+	if (profiler != nullptr) [[unlikely]]
+		profiler->EndWait();
 	for (int i = 0; i < ret; ++i) {
 		const auto &e = received_events[i];
 		auto &socket_event = *(SocketEvent *)e.data.ptr;
@@ -445,7 +468,19 @@ EventLoop::UringWait(Event::Duration timeout) noexcept
 		struct __kernel_timespec timeout_buffer;
 		auto *kernel_timeout = ExportTimeoutKernelTimespec(timeout, timeout_buffer);
 		Uring::Queue &uring_queue = *uring;
-		uring_queue.SubmitAndWaitDispatchCompletions(kernel_timeout);
+
+		if (profiler != nullptr) [[unlikely]] {
+			profiler->BeginWait();
+			uring_queue.SubmitAndWait(kernel_timeout);
+			profiler->EndWait();
+
+			/* the completion handlers are not
+			   identified individually */
+			profiler->Invoke(nullptr, [&uring_queue]{
+				uring_queue.DispatchCompletions();
+			});
+		} else
+			uring_queue.SubmitAndWaitDispatchCompletions(kernel_timeout);
 	}
 
 	if (epoll_ready) {
@@ -570,7 +605,8 @@ EventLoop::Run() noexcept
 			socket_event.unlink();
 			sockets.push_back(socket_event);
 
-			socket_event.Dispatch();
+			Invoke(socket_event.callback.GetFunctionAddress(),
+			       [&socket_event]{ socket_event.Dispatch(); });
 		}
 
 		RunPost();
@@ -37,6 +37,7 @@ namespace Uring { class Queue; class Manager; }
 
 class DeferEvent;
 class SocketEvent;
+class LoopProfiler;
 
 /**
  * An event loop that polls for events on file/socket descriptors.
@@ -114,6 +115,12 @@ class EventLoop final
 	PostCallback post_callback = nullptr;
 #endif
 
+	/**
+	 * If not nullptr, then it measures the time spent waiting
+	 * and in callbacks.
+	 */
+	LoopProfiler *profiler = nullptr;
+
 #ifdef HAVE_THREADED_EVENT_LOOP
 #if defined(USE_EVENTFD) && defined(HAVE_URING)
 	class UringWake;
@@ -198,10 +205,26 @@ public:
 	}
 #endif
 
+	/**
+	 * Install a #LoopProfiler (or remove it by passing nullptr).
+	 * The caller is responsible for keeping it alive.
+	 */
+	void SetProfiler(LoopProfiler *_profiler) noexcept {
+		profiler = _profiler;
+	}
+
 	const auto &GetSteadyClockCache() const noexcept {
 		return steady_clock_cache;
 	}
 
+	/**
+	 * Non-const overload which allows unit tests to inject a fake
+	 * time with ClockCache::Mock().
+	 */
+	auto &GetSteadyClockCache() noexcept {
+		return steady_clock_cache;
+	}
+
 	const auto &GetSystemClockCache() const noexcept {
 		return system_clock_cache;
 	}
@@ -349,6 +372,14 @@ public:
 	void Run() noexcept;
 
 private:
+	/**
+	 * Invoke a callback and let the #profiler measure it.
+	 *
+	 * @param function identifies the callback (see
+	 * BoundMethod::GetFunctionAddress())
+	 */
+	void Invoke(const void *function, auto &&f) noexcept;
+
 	void RunDeferred() noexcept;
 
 	/**
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "LoopProfiler.hxx"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <stdlib.h>
+
+void
+LoopProfiler::BeginWait() noexcept
+{
+	wait_since = Event::Clock::now();
+
+	const auto busy = wait_since - busy_since;
+	stats.busy += busy;
+	if (busy > stats.max_busy)
+		stats.max_busy = busy;
+}
+
+void
+LoopProfiler::EndWait() noexcept
+{
+	busy_since = Event::Clock::now();
+
+	++stats.n_waits;
+	stats.wait += busy_since - wait_since;
+}
+
+void
+LoopProfiler::AddSlow(const void *function, Event::Duration duration) noexcept
+{
+	auto &slowest = stats.slowest;
+
+	auto i = std::find_if(slowest.begin(), slowest.end(), [function](const auto &c){
+		return c.function == function && c.duration > Event::Duration{};
+	});
+
+	if (i == slowest.end())
+		/* replace the fastest entry */
+		i = std::prev(slowest.end());
+	else if (duration <= i->duration)
+		return;
+
+	*i = {function, duration};
+
+	/* move it up to keep the list sorted */
+	for (; i != slowest.begin() && std::prev(i)->duration < i->duration; --i)
+		std::iter_swap(i, std::prev(i));
+}
+
+/**
+ * Extract the method name from the demangled name of a
+ * #BoundMethod wrapper function, e.g.
+ * "BindMethodDetail::WrapperGenerator<void (Foo::*)(), &Foo::Bar>::Invoke(void*)"
+ * becomes "Foo::Bar".
+ */
+static std::string_view
+StripWrapper(std::string_view name) noexcept
+{
+	static constexpr std::string_view prefix = "BindMethodDetail::WrapperGenerator<";
+	if (!name.starts_with(prefix))
+		return name;
+
+	const auto begin = name.rfind(", &");
+	const auto end = name.rfind(">::Invoke(");
+	if (begin == name.npos || end == name.npos || end < begin)
+		return name;
+
+	return name.substr(begin + 3, end - begin - 3);
+}
+
+std::string
+LoopProfiler::GetFunctionName(const void *function)
+{
+	if (function == nullptr)
+		return "io_uring completions";
+
+	Dl_info info;
+	if (dladdr(function, &info) == 0)
+		return fmt::format("{}", function);
+
+	if (info.dli_sname == nullptr)
+		/* no exported symbol (e.g. due to
+		   -fvisibility=hidden); the offset can be resolved
+		   with addr2line */
+		return fmt::format("{}+{:#x}", info.dli_fname,
+				   (const char *)function - (const char *)info.dli_fbase);
+
+	int status;
+	const std::unique_ptr<char, decltype(&free)>
+		demangled{abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status), free};
+	if (demangled == nullptr)
+		return info.dli_sname;
+
+	return std::string{StripWrapper(demangled.get())};
+}
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Chrono.hxx"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Measures how an #EventLoop spends its time: waiting for events
+ * or running callbacks, which callbacks take longest and how late
+ * #CoarseTimerEvent callbacks are invoked.  Install it with
+ * EventLoop::SetProfiler().
+ *
+ * Each measurement queries the clock, so this costs roughly two
+ * clock_gettime() calls (vDSO) per callback.  Without a profiler,
+ * the #EventLoop only checks a pointer.
+ *
+ * This class is not thread-safe; it may only be accessed from
+ * the #EventLoop thread.
+ */
+class LoopProfiler {
+public:
+	/**
+	 * The number of entries in #slowest.
+	 */
+	static constexpr std::size_t N_SLOWEST = 8;
+
+	struct Callback {
+		/**
+		 * The wrapper function address from
+		 * BoundMethod::GetFunctionAddress() or nullptr for
+		 * io_uring completions.
+		 */
+		const void *function;
+
+		/**
+		 * The longest duration of one invocation.
+		 */
+		Event::Duration duration;
+	};
+
+	struct Stats {
+		/**
+		 * The number of times the #EventLoop has waited for
+		 * events.
+		 */
+		uint64_t n_waits = 0;
+
+		/**
+		 * The total time spent waiting for events.
+		 */
+		Event::Duration wait{};
+
+		/**
+		 * The total time spent running callbacks (including
+		 * the #EventLoop's own overhead).
+		 */
+		Event::Duration busy{};
+
+		/**
+		 * The longest time between two waits; during that
+		 * time, the #EventLoop could not react to new events.
+		 */
+		Event::Duration max_busy{};
+
+		/**
+		 * The number of #CoarseTimerEvent invocations.
+		 */
+		uint64_t n_timers = 0;
+
+		/**
+		 * The sum and the maximum of the difference between
+		 * the due time and the actual invocation time of
+		 * #CoarseTimerEvent callbacks.  This includes the
+		 * timer wheel's granularity of one second.
+		 */
+		Event::Duration timer_delay{}, max_timer_delay{};
+
+		/**
+		 * The slowest callbacks (at most one entry per
+		 * function), sorted by duration (slowest first).
+		 * Unused entries have a zero duration.
+		 */
+		std::array<Callback, N_SLOWEST> slowest{};
+	};
+
+private:
+	Stats stats;
+
+	/**
+	 * When did the #EventLoop last return from waiting?
+	 */
+	Event::TimePoint busy_since = Event::Clock::now();
+
+	/**
+	 * When did the #EventLoop begin waiting?
+	 */
+	Event::TimePoint wait_since;
+
+public:
+	const Stats &GetStats() const noexcept {
+		return stats;
+	}
+
+	/**
+	 * Reset the maximum values (but not the totals and the
+	 * #Stats::slowest list), to be able to report the maximum
+	 * of each interval.
+	 */
+	void ResetMax() noexcept {
+		stats.max_busy = {};
+		stats.max_timer_delay = {};
+	}
+
+	/**
+	 * The #EventLoop is about to wait for events.
+	 */
+	void BeginWait() noexcept;
+
+	/**
+	 * The #EventLoop has finished waiting for events.
+	 */
+	void EndWait() noexcept;
+
+	/**
+	 * A #CoarseTimerEvent which was due at the given time is
+	 * about to be invoked.
+	 */
+	void OnTimer(Event::TimePoint due, Event::TimePoint now) noexcept {
+		const auto delay = now - due;
+		++stats.n_timers;
+		stats.timer_delay += delay;
+		if (delay > stats.max_timer_delay)
+			stats.max_timer_delay = delay;
+	}
+
+	/**
+	 * Invoke a callback and measure its duration.
+	 *
+	 * @param function identifies the callback (see
+	 * BoundMethod::GetFunctionAddress())
+	 */
+	void Invoke(const void *function, auto &&f) noexcept {
+		const auto start = Event::Clock::now();
+		f();
+		const auto duration = Event::Clock::now() - start;
+
+		/* quick check before walking the list */
+		if (duration > stats.slowest.back().duration)
+			AddSlow(function, duration);
+	}
+
+	/**
+	 * Obtain a human-readable name of a function: the demangled
+	 * symbol name if it is exported, otherwise the file name
+	 * and the offset (for addr2line).
+	 */
+	static std::string GetFunctionName(const void *function);
+
+	/**
+	 * Record an invocation in #Stats::slowest.  This is called
+	 * by Invoke() only if the duration is longer than the last
+	 * entry's.
+	 */
+	void AddSlow(const void *function, Event::Duration duration) noexcept;
+};
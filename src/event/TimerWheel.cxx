@@ -4,6 +4,7 @@
 
 #include "TimerWheel.hxx"
 #include "CoarseTimerEvent.hxx"
+#include "LoopProfiler.hxx"
 
 #include <cassert>
 
@@ -32,8 +33,22 @@ TimerWheel::Insert(CoarseTimerEvent &t,
 	empty = false;
 }
 
+inline void
+TimerWheel::RunTimer(CoarseTimerEvent &t, Event::TimePoint now,
+		     LoopProfiler *profiler) noexcept
+{
+	if (profiler == nullptr) [[likely]] {
+		t.Run();
+		return;
+	}
+
+	profiler->OnTimer(t.GetDue(), now);
+	profiler->Invoke(t.callback.GetFunctionAddress(), [&t]{ t.Run(); });
+}
+
 void
-TimerWheel::Run(List &list, Event::TimePoint now) noexcept
+TimerWheel::Run(List &list, Event::TimePoint now,
+		LoopProfiler *profiler) noexcept
 {
 	/* move all timers to a temporary list to avoid problems with
 	   canceled timers while we traverse the list */
@@ -42,7 +57,7 @@ TimerWheel::Run(List &list, Event::TimePoint now) noexcept
 	tmp.clear_and_dispose([&](auto *t){
 		if (t->GetDue() <= now) {
 			/* this timer is due: run it */
-			t->Run();
+			RunTimer(*t, now, profiler);
 		} else {
 			/* not yet due: move it back to the given
 			   list */
@@ -93,11 +108,11 @@ TimerWheel::GetSleep(Event::TimePoint now) const noexcept
 }
 
 Event::Duration
-TimerWheel::Run(const Event::TimePoint now) noexcept
+TimerWheel::Run(const Event::TimePoint now, LoopProfiler *profiler) noexcept
 {
 	/* invoke the "ready" list unconditionally */
 	ready.clear_and_dispose([&](auto *t){
-		t->Run();
+		RunTimer(*t, now, profiler);
 	});
 
 	/* check all buckets between the last time we were invoked and
@@ -131,7 +146,7 @@ TimerWheel::Run(const Event::TimePoint now) noexcept
 	/* run those buckets */
 
 	for (std::size_t i = start_bucket;;) {
-		Run(buckets[i], now);
+		Run(buckets[i], now, profiler);
 
 		i = NextBucketIndex(i);
 		if (i == end_bucket)
@@ -11,6 +11,7 @@
 #include <algorithm>
 
 class CoarseTimerEvent;
+class LoopProfiler;
 
 /**
  * A list of #CoarseTimerEvent instances managed in a circular timer
@@ -80,8 +81,12 @@ public:
 	 * Invoke all expired #CoarseTimerEvent instances and return
 	 * the duration until the next timer expires.  Returns a
 	 * negative duration if there is no timeout.
+	 *
+	 * @param profiler an optional #LoopProfiler which measures
+	 * the timer callbacks
 	 */
-	Event::Duration Run(Event::TimePoint now) noexcept;
+	Event::Duration Run(Event::TimePoint now,
+			    LoopProfiler *profiler=nullptr) noexcept;
 
 private:
 	static constexpr std::size_t NextBucketIndex(std::size_t i) noexcept {
@@ -110,8 +115,12 @@ private:
 	[[gnu::pure]]
 	Event::Duration GetSleep(Event::TimePoint now) const noexcept;
 
+	static void RunTimer(CoarseTimerEvent &t, Event::TimePoint now,
+			     LoopProfiler *profiler) noexcept;
+
 	/**
 	 * Run all due timers in this bucket.
 	 */
-	static void Run(List &list, Event::TimePoint now) noexcept;
+	static void Run(List &list, Event::TimePoint now,
+			LoopProfiler *profiler) noexcept;
 };
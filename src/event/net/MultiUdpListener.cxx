@@ -0,0 +1,523 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "MultiUdpListener.hxx"
+#include "UdpHandler.hxx"
+#include "net/SocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "net/SocketError.hxx"
+
+#ifdef HAVE_URING
+#include "event/Loop.hxx"
+#include "io/uring/BufferRing.hxx"
+#include "io/uring/Operation.hxx"
+#include "io/uring/Queue.hxx"
+#include "system/Error.hxx"
+#include "time/Convert.hxx"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#include <stdio.h>
+#include <sys/socket.h>
+#endif
+
+#include <stdexcept>
+
+#include <assert.h>
+
+#ifdef HAVE_URING
+
+/**
+ * Receives datagrams with a multishot IORING_OP_RECVMSG.  The kernel
+ * writes each datagram (with its peer address) into a buffer from a
+ * #Uring::BufferRing; the datagrams are collected and passed to
+ * UdpHandler::OnUdpDatagrams() after all completions of this
+ * #EventLoop iteration have been dispatched (or when the batch is
+ * full).  Buffers are returned to the kernel after the handler has
+ * consumed them.
+ */
+class MultiUdpListener::UringReceive final : Uring::Operation {
+	MultiUdpListener &listener;
+
+	Uring::Queue &queue;
+
+	/**
+	 * The template for the recvmsg() calls; the kernel uses only
+	 * msg_namelen and msg_controllen to lay out each provided
+	 * buffer.  The control buffer has room for SCM_TIMESTAMPNS
+	 * and SO_RXQ_OVFL messages.
+	 */
+	struct msghdr msg{};
+
+	Uring::BufferRing buffers;
+
+	/**
+	 * Datagrams which have been received but not yet passed to
+	 * the handler.  This array can hold all buffers, because the
+	 * kernel may fill all of them while this object is disabled.
+	 */
+	const std::unique_ptr<MultiReceiveMessage::Datagram[]> datagrams;
+	const std::unique_ptr<uint16_t[]> buffer_ids;
+	std::size_t n_datagrams = 0;
+
+	/**
+	 * The number of datagrams passed to the handler at once
+	 * (like MultiReceiveMessage::GetCapacity()).
+	 */
+	const std::size_t batch_size;
+
+	/**
+	 * Passes #datagrams to the handler after all pending
+	 * completions have been dispatched.
+	 */
+	DeferEvent defer_flush;
+
+	/**
+	 * Has at least one datagram been received?  Until then, an
+	 * error may mean that the kernel does not support multishot
+	 * IORING_OP_RECVMSG.
+	 */
+	bool received = false;
+
+	/**
+	 * Cleared by Disable().
+	 */
+	bool enabled = true;
+
+public:
+	/**
+	 * Throws if the buffer ring cannot be registered.
+	 */
+	UringReceive(MultiUdpListener &_listener, Uring::Queue &_queue,
+		     std::size_t _batch_size, std::size_t max_payload_size);
+
+	~UringReceive() noexcept {
+		/* cancel the operation before the BufferRing gets
+		   unregistered */
+		queue.CancelOperation(*this);
+	}
+
+	/**
+	 * Submit the multishot operation.
+	 *
+	 * Throws on error.
+	 */
+	void Start();
+
+	void Enable() noexcept;
+
+	/**
+	 * Stop passing datagrams to the handler.  The operation
+	 * remains active until the kernel runs out of buffers.
+	 */
+	void Disable() noexcept {
+		enabled = false;
+		defer_flush.Cancel();
+	}
+
+private:
+	/**
+	 * Pass all #datagrams to the handler and recycle their
+	 * buffers.
+	 *
+	 * @return false if the #MultiUdpListener has been destroyed
+	 */
+	bool Flush() noexcept;
+
+	void OnDeferredFlush() noexcept {
+		Flush();
+	}
+
+	/**
+	 * Restart the operation after the kernel has stopped it.
+	 *
+	 * @return false if the #MultiUdpListener has been destroyed
+	 */
+	bool Restart() noexcept;
+
+	void OnUringError(int error) noexcept;
+
+	/* virtual methods from class Uring::Operation */
+	using Uring::Operation::OnUringCompletion;
+	void OnUringCompletion(int res, unsigned flags) noexcept override;
+};
+
+/**
+ * The size of the peer address buffer at the beginning of each
+ * provided buffer.
+ */
+static constexpr socklen_t URING_RECEIVE_NAMELEN = sizeof(struct sockaddr_storage);
+
+/**
+ * The size of the control message buffer in each provided buffer.
+ */
+static constexpr std::size_t URING_RECEIVE_CONTROLLEN =
+	CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t));
+
+/**
+ * How many buffers shall be provided for a batch size?  Twice as
+ * many, so the kernel can fill new buffers while the handler
+ * processes a batch.
+ */
+static constexpr unsigned
+UringReceiveBufferCount(std::size_t batch_size) noexcept
+{
+	return std::bit_ceil(std::clamp<std::size_t>(batch_size * 2, 2, 32768));
+}
+
+MultiUdpListener::UringReceive::UringReceive(MultiUdpListener &_listener,
+					     Uring::Queue &_queue,
+					     std::size_t _batch_size,
+					     std::size_t max_payload_size)
+	:listener(_listener), queue(_queue),
+	 msg{.msg_namelen = URING_RECEIVE_NAMELEN,
+	     .msg_controllen = URING_RECEIVE_CONTROLLEN},
+	 buffers(queue.GetRing(), queue.AllocateBufferGroupId(),
+		 UringReceiveBufferCount(_batch_size),
+		 sizeof(struct io_uring_recvmsg_out) + URING_RECEIVE_NAMELEN +
+		 URING_RECEIVE_CONTROLLEN + max_payload_size),
+	 datagrams(std::make_unique_for_overwrite<MultiReceiveMessage::Datagram[]>(buffers.GetBufferCount())),
+	 buffer_ids(std::make_unique_for_overwrite<uint16_t[]>(buffers.GetBufferCount())),
+	 batch_size(std::min<std::size_t>(_batch_size, buffers.GetBufferCount())),
+	 defer_flush(listener.GetEventLoop(), BIND_THIS_METHOD(OnDeferredFlush))
+{
+}
+
+void
+MultiUdpListener::UringReceive::Start()
+{
+	assert(!IsUringPending());
+
+	auto &s = queue.RequireSubmitEntry();
+	io_uring_prep_recvmsg_multishot(&s, listener.GetSocket().Get(),
+					&msg, 0);
+	s.flags |= IOSQE_BUFFER_SELECT;
+	s.buf_group = buffers.GetGroupId();
+	queue.Push(s, *this);
+}
+
+void
+MultiUdpListener::UringReceive::Enable() noexcept
+{
+	enabled = true;
+
+	if (n_datagrams > 0)
+		defer_flush.Schedule();
+
+	if (!IsUringPending()) {
+		try {
+			Start();
+		} catch (...) {
+			listener.handler.OnUdpError(std::current_exception());
+		}
+	}
+}
+
+bool
+MultiUdpListener::UringReceive::Flush() noexcept
+try {
+	defer_flush.Cancel();
+
+	if (n_datagrams == 0)
+		return true;
+
+	if (!listener.handler.OnUdpDatagrams({datagrams.get(), n_datagrams}))
+		return false;
+
+	/* the handler is done with the buffers; give them back to
+	   the kernel */
+	for (std::size_t i = 0; i < n_datagrams; ++i)
+		buffers.Recycle(buffer_ids[i]);
+	buffers.Commit();
+	n_datagrams = 0;
+	return true;
+} catch (...) {
+	listener.handler.OnUdpError(std::current_exception());
+	return false;
+}
+
+bool
+MultiUdpListener::UringReceive::Restart() noexcept
+try {
+	Start();
+	return true;
+} catch (...) {
+	listener.handler.OnUdpError(std::current_exception());
+	return false;
+}
+
+inline void
+MultiUdpListener::UringReceive::OnUringError(int error) noexcept
+{
+	assert(!IsUringPending());
+
+	switch (error) {
+	case -ENOBUFS:
+		/* all buffers are in use; continue after the
+		   handler has returned some of them */
+		if (enabled && Flush())
+			Restart();
+		return;
+
+	case -EINVAL:
+	case -EOPNOTSUPP:
+		if (!received) {
+			/* this kernel does not support multishot
+			   IORING_OP_RECVMSG: fall back to
+			   recvmmsg() */
+			auto &_listener = listener;
+			const bool was_enabled = enabled;
+			_listener.uring_receive.reset(); // destroys this object
+			if (was_enabled)
+				_listener.event.ScheduleRead();
+			return;
+		}
+
+		break;
+	}
+
+	listener.handler.OnUdpError(std::make_exception_ptr(MakeErrno(-error, "Failed to receive")));
+}
+
+void
+MultiUdpListener::UringReceive::OnUringCompletion(int res,
+						  unsigned flags) noexcept
+{
+	if (res < 0) [[unlikely]] {
+		OnUringError(res);
+		return;
+	}
+
+	assert(flags & IORING_CQE_F_BUFFER);
+	const uint16_t buffer_id = flags >> IORING_CQE_BUFFER_SHIFT;
+	const auto buffer = buffers.Get(buffer_id);
+
+	received = true;
+
+	auto *out = io_uring_recvmsg_validate(buffer.data(), res, &msg);
+	if (out == nullptr || (out->flags & MSG_TRUNC) != 0) [[unlikely]] {
+		/* discard truncated datagrams, just like
+		   MultiReceiveMessage does */
+		buffers.Recycle(buffer_id);
+		buffers.Commit();
+	} else {
+		assert(n_datagrams < buffers.GetBufferCount());
+
+		const std::span<const std::byte> payload{
+			(const std::byte *)io_uring_recvmsg_payload(out, &msg),
+			io_uring_recvmsg_payload_length(out, res, &msg),
+		};
+
+		const SocketAddress address{
+			(const struct sockaddr *)io_uring_recvmsg_name(out),
+			std::min(out->namelen, msg.msg_namelen),
+		};
+
+		std::chrono::system_clock::time_point timestamp{};
+		for (auto *cmsg = io_uring_recvmsg_cmsg_firsthdr(out, &msg);
+		     cmsg != nullptr;
+		     cmsg = io_uring_recvmsg_cmsg_nexthdr(out, &msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_SOCKET)
+				continue;
+
+			if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+				struct timespec ts;
+				memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+				timestamp = ToSystemTimePoint(ts);
+			} else if (cmsg->cmsg_type == SO_RXQ_OVFL)
+				memcpy(&listener.drop_count, CMSG_DATA(cmsg),
+				       sizeof(listener.drop_count));
+		}
+
+		buffer_ids[n_datagrams] = buffer_id;
+		datagrams[n_datagrams++] = {address, payload, timestamp};
+	}
+
+	if (enabled) {
+		if (n_datagrams >= batch_size) {
+			if (!Flush())
+				return;
+		} else if (n_datagrams > 0)
+			defer_flush.Schedule();
+	}
+
+	if (!IsUringPending() && enabled) [[unlikely]]
+		/* the kernel has stopped our operation (no
+		   IORING_CQE_F_MORE): restart it */
+		Restart();
+}
+
+#endif // HAVE_URING
+
+MultiUdpListener::MultiUdpListener(EventLoop &event_loop,
+				   UniqueSocketDescriptor &&_fd,
+				   MultiReceiveMessage &&_multi,
+				   MultiSendMessage &&_replies,
+				   UdpHandler &_handler)
+	:event(event_loop, BIND_THIS_METHOD(EventCallback), _fd.Release()),
+	 multi(std::move(_multi)),
+	 replies(std::move(_replies)),
+	 defer_flush(event_loop, BIND_THIS_METHOD(FlushReplies)),
+	 handler(_handler)
+{
+#ifdef HAVE_URING
+	if (auto *queue = event_loop.GetUring()) {
+		try {
+			uring_receive = std::make_unique<UringReceive>(*this, *queue,
+								       multi.GetCapacity(),
+								       multi.GetMaxPayloadSize());
+			uring_receive->Start();
+			return;
+		} catch (const std::system_error &e) {
+			/* EINVAL: the kernel does not support provided
+			   buffer rings (Linux 5.19): fall back to
+			   recvmmsg() */
+			if (!IsErrno(e, EINVAL))
+				throw;
+
+			/* there is one listener per socket and
+			   thread; the reason is the same for all */
+			static std::atomic_flag logged;
+			if (!logged.test_and_set(std::memory_order_relaxed))
+				fmt::print(stderr, "Falling back to recvmmsg(): {}\n",
+					   e.what());
+
+			uring_receive.reset();
+		}
+	}
+#endif
+
+	event.ScheduleRead();
+}
+
+MultiUdpListener::~MultiUdpListener() noexcept
+{
+	Close();
+}
+
+void
+MultiUdpListener::Close() noexcept
+{
+#ifdef HAVE_URING
+	uring_receive.reset();
+#endif
+
+	defer_flush.Cancel();
+	replies.Clear();
+	event.Close();
+}
+
+void
+MultiUdpListener::Enable() noexcept
+{
+#ifdef HAVE_URING
+	if (uring_receive)
+		uring_receive->Enable();
+	else
+#endif
+		event.ScheduleRead();
+
+	if (!replies.empty())
+		defer_flush.ScheduleIdle();
+}
+
+void
+MultiUdpListener::Disable() noexcept
+{
+#ifdef HAVE_URING
+	if (uring_receive)
+		uring_receive->Disable();
+#endif
+
+	event.Cancel();
+	defer_flush.Cancel();
+}
+
+void
+MultiUdpListener::FlushReplies() noexcept
+{
+	defer_flush.Cancel();
+
+	while (true) {
+		try {
+			if (replies.Send(GetSocket()))
+				event.CancelWrite();
+			else
+				/* the send buffer is full; try again
+				   when the socket becomes writable */
+				event.ScheduleWrite();
+			return;
+		} catch (...) {
+			/* discard this reply and go on with the
+			   next one */
+			const auto address = replies.GetFrontAddress();
+			replies.PopFront();
+			handler.OnUdpReplyError(address, std::current_exception());
+		}
+	}
+}
+
+void
+MultiUdpListener::EventCallback(unsigned events) noexcept
+try {
+	if (events & event.ERROR)
+		throw MakeSocketError(event.GetSocket().GetError(),
+				      "Socket error");
+
+	if ((events & event.HANGUP) != 0 &&
+	    !handler.OnUdpHangup())
+		return;
+
+	if (events & event.WRITE)
+		FlushReplies();
+
+	if ((events & event.READ) == 0)
+		return;
+
+	multi.Receive(GetSocket());
+	drop_count = multi.GetDropCount();
+	if (!multi.empty())
+		handler.OnUdpDatagrams(multi.GetDatagrams());
+} catch (...) {
+	/* unregister the SocketEvent, just in case the handler does
+	   not destroy us */
+	event.Cancel();
+
+	handler.OnUdpError(std::current_exception());
+}
+
+void
+MultiUdpListener::Reply(SocketAddress address,
+			std::span<const std::byte> payload)
+{
+	assert(event.IsDefined());
+
+	if (payload.size() <= replies.GetMaxPayloadSize()) {
+		if (replies.IsFull())
+			/* make room */
+			FlushReplies();
+
+		if (!replies.Push(address, payload)) [[unlikely]]
+			throw std::runtime_error("Reply queue is full");
+
+		if (!event.IsWritePending())
+			defer_flush.ScheduleIdle();
+
+		return;
+	}
+
+	/* too large for the queue: send it right now */
+	ssize_t nbytes = GetSocket().WriteNoWait(payload, address);
+	if (nbytes < 0) [[unlikely]]
+		throw MakeSocketError("Failed to send UDP packet");
+
+	if ((std::size_t)nbytes != payload.size_bytes()) [[unlikely]]
+		throw std::runtime_error("Short send");
+}
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "event/SocketEvent.hxx"
+#include "event/DeferEvent.hxx"
+#include "event/config.h" // for HAVE_URING
+#include "net/MultiReceiveMessage.hxx"
+#include "net/MultiSendMessage.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#ifdef HAVE_URING
+#include <memory>
+#endif
+
+class UniqueSocketDescriptor;
+class SocketAddress;
+class UdpHandler;
+
+/**
+ * Like #UdpListener, but receives multiple datagrams at once using
+ * recvmmsg() and passes them to UdpHandler::OnUdpDatagrams().  This
+ * saves system calls on sockets with a high packet rate.
+ *
+ * Replies are queued and sent at once using sendmmsg() when the
+ * #EventLoop becomes idle.
+ *
+ * If io_uring is enabled in the #EventLoop, datagrams are received
+ * with a multishot IORING_OP_RECVMSG into a ring of provided
+ * buffers instead, which needs no system call per batch.
+ */
+class MultiUdpListener {
+	SocketEvent event;
+
+	MultiReceiveMessage multi;
+
+#ifdef HAVE_URING
+	class UringReceive;
+
+	/**
+	 * If set, then datagrams are received using io_uring and
+	 * the #SocketEvent is only used for sending replies.
+	 */
+	std::unique_ptr<UringReceive> uring_receive;
+#endif
+
+	/**
+	 * Replies which have not yet been sent.
+	 */
+	MultiSendMessage replies;
+
+	/**
+	 * Sends the #replies after all pending events have been
+	 * handled.
+	 */
+	DeferEvent defer_flush;
+
+	UdpHandler &handler;
+
+	/**
+	 * The most recent SO_RXQ_OVFL value.
+	 */
+	uint32_t drop_count = 0;
+
+public:
+	/**
+	 * Receives with io_uring if the #EventLoop has one, falling
+	 * back to recvmmsg() if the kernel does not support it.
+	 *
+	 * Throws on error.
+	 */
+	MultiUdpListener(EventLoop &event_loop, UniqueSocketDescriptor &&_fd,
+			 MultiReceiveMessage &&_multi,
+			 MultiSendMessage &&_replies,
+			 UdpHandler &_handler);
+	~MultiUdpListener() noexcept;
+
+	auto &GetEventLoop() const noexcept {
+		return event.GetEventLoop();
+	}
+
+	bool IsDefined() const noexcept {
+		return event.IsDefined();
+	}
+
+	/**
+	 * Close the socket and disable this listener permanently.
+	 */
+	void Close() noexcept;
+
+	/**
+	 * Enable the object after it has been disabled by Disable().  A
+	 * new object is enabled by default.
+	 */
+	void Enable() noexcept;
+
+	/**
+	 * Disable the object temporarily.  To undo this, call Enable().
+	 */
+	void Disable() noexcept;
+
+	/**
+	 * Obtains the underlying socket, which can be used to send
+	 * replies.
+	 */
+	SocketDescriptor GetSocket() const noexcept {
+		return event.GetSocket();
+	}
+
+	/**
+	 * Returns the number of datagrams the kernel has dropped on
+	 * this socket because its receive buffer was full.  This
+	 * requires SO_RXQ_OVFL, and the value is only updated when
+	 * a datagram is received.
+	 */
+	uint32_t GetDropCount() const noexcept {
+		return drop_count;
+	}
+
+	/**
+	 * Queue a reply datagram to a client.  It will be sent
+	 * together with other replies after all pending events have
+	 * been handled, or when the socket becomes writable again.
+	 * Errors while sending queued replies are reported to
+	 * UdpHandler::OnUdpReplyError().
+	 *
+	 * Throws std::runtime_error on error (e.g. if the queue is
+	 * full and the socket's send buffer, too).
+	 */
+	void Reply(SocketAddress address, std::span<const std::byte> payload);
+
+private:
+	/**
+	 * Send all queued replies.  If the socket's send buffer is
+	 * full, wait for it to become writable.
+	 */
+	void FlushReplies() noexcept;
+
+	void EventCallback(unsigned events) noexcept;
+};
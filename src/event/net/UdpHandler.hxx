@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include "net/MultiReceiveMessage.hxx"
+
+#include <chrono>
 #include <exception>
 #include <span>
 
@@ -21,11 +24,34 @@ public:
 	 * Exceptions thrown by this method will be passed to OnUdpError().
 	 *
 	 * @param uid the peer process uid, or -1 if unknown
+	 * @param timestamp the time the kernel has received the
+	 * datagram (if SO_TIMESTAMPNS is enabled on the socket) or
+	 * the epoch (a default-initialized value) if unknown
 	 * @return false if the #UdpHandler was destroyed inside this method
 	 */
 	virtual bool OnUdpDatagram(std::span<const std::byte> payload,
 				   std::span<UniqueFileDescriptor> fds,
-				   SocketAddress address, int uid) = 0;
+				   SocketAddress address, int uid,
+				   std::chrono::system_clock::time_point timestamp) = 0;
+
+	/**
+	 * A batch of datagrams was received by #MultiUdpListener.
+	 * The default implementation passes each one to
+	 * OnUdpDatagram(); override this method to process the whole
+	 * batch at once.
+	 *
+	 * Exceptions thrown by this method will be passed to OnUdpError().
+	 *
+	 * @return false if the #UdpHandler was destroyed inside this method
+	 */
+	virtual bool OnUdpDatagrams(std::span<const MultiReceiveMessage::Datagram> datagrams) {
+		for (const auto &i : datagrams)
+			if (!OnUdpDatagram(i.payload, {}, i.address, -1,
+					   i.timestamp))
+				return false;
+
+		return true;
+	}
 
 	/**
 	 * The peer has hung up the (SOCK_SEQPACKET) connection.  The
@@ -42,6 +68,14 @@ public:
 		return true;
 	}
 
+	/**
+	 * A reply queued by MultiUdpListener::Reply() could not be
+	 * sent.  This error is not fatal; the reply has been
+	 * discarded.  This method must not destroy the listener.
+	 */
+	virtual void OnUdpReplyError(SocketAddress,
+				     std::exception_ptr &&) noexcept {}
+
 	/**
 	 * An I/O error has occurred, and the socket is defunct.
 	 * After returning, it is assumed that the #UdpListener has
@@ -8,14 +8,15 @@
 #include "net/ReceiveMessage.hxx"
 #include "net/UniqueSocketDescriptor.hxx"
 #include "net/SocketError.hxx"
+#include "time/Convert.hxx"
 
 #include <assert.h>
 #include <unistd.h>
 
 UdpListener::UdpListener(EventLoop &event_loop, UniqueSocketDescriptor &&_fd,
-			 UdpHandler &_handler) noexcept
+			 UdpHandler &_handler, bool _ancillary) noexcept
 	:event(event_loop, BIND_THIS_METHOD(EventCallback), _fd.Release()),
-	 handler(_handler)
+	 handler(_handler), ancillary(_ancillary)
 {
 	event.ScheduleRead();
 }
@@ -45,9 +46,27 @@ try {
 	throw;
 }
 
+inline bool
+UdpListener::ReceiveOneDatagram()
+{
+	ReceiveDatagramBuffer<4096> buffer;
+	const auto result = ReceiveDatagram(GetSocket(), buffer, MSG_DONTWAIT);
+
+	if (result.drops != nullptr)
+		drop_count = *result.drops;
+
+	return handler.OnUdpDatagram(result.payload, {}, result.address, -1,
+				     result.timestamp != nullptr
+				     ? ToSystemTimePoint(*result.timestamp)
+				     : std::chrono::system_clock::time_point{});
+}
+
 bool
 UdpListener::ReceiveOne()
 {
+	if (!ancillary)
+		return ReceiveOneDatagram();
+
 	ReceiveMessageBuffer<4096, 1024> buffer;
 	auto result = ReceiveMessage(GetSocket(), buffer, MSG_DONTWAIT);
 	int uid = result.cred != nullptr
@@ -58,10 +77,16 @@ UdpListener::ReceiveOne()
 	if (!result.fds.empty())
 		fds = result.fds;
 
+	if (result.drops != nullptr)
+		drop_count = *result.drops;
+
 	return handler.OnUdpDatagram(result.payload,
 				     fds,
 				     result.address,
-				     uid);
+				     uid,
+				     result.timestamp != nullptr
+				     ? ToSystemTimePoint(*result.timestamp)
+				     : std::chrono::system_clock::time_point{});
 }
 
 void
@@ -7,6 +7,7 @@
 #include "event/SocketEvent.hxx"
 
 #include <cstddef>
+#include <cstdint>
 #include <span>
 
 class UniqueSocketDescriptor;
@@ -21,9 +22,27 @@ class UdpListener {
 
 	UdpHandler &handler;
 
+	/**
+	 * Receive ancillary data (file descriptors and credentials)?
+	 * If not, a lean code path without a control message buffer
+	 * and without heap allocations is used.
+	 */
+	const bool ancillary;
+
+	/**
+	 * The most recent SO_RXQ_OVFL value.
+	 */
+	uint32_t drop_count = 0;
+
 public:
+	/**
+	 * @param _ancillary false for sockets which never carry
+	 * file descriptors or credentials (e.g. UDP);
+	 * UdpHandler::OnUdpDatagram() then always gets no file
+	 * descriptors and uid -1
+	 */
 	UdpListener(EventLoop &event_loop, UniqueSocketDescriptor &&_fd,
-		    UdpHandler &_handler) noexcept;
+		    UdpHandler &_handler, bool _ancillary=true) noexcept;
 	~UdpListener() noexcept;
 
 	auto &GetEventLoop() const noexcept {
@@ -64,6 +83,16 @@ public:
 		return event.GetSocket();
 	}
 
+	/**
+	 * Returns the number of datagrams the kernel has dropped on
+	 * this socket because its receive buffer was full.  This
+	 * requires SO_RXQ_OVFL, and the value is only updated when
+	 * a datagram is received.
+	 */
+	uint32_t GetDropCount() const noexcept {
+		return drop_count;
+	}
+
 	/**
 	 * Send a reply datagram to a client.
 	 *
@@ -90,5 +119,10 @@ private:
 	 */
 	bool ReceiveOne();
 
+	/**
+	 * Like ReceiveOne(), but without ancillary data.
+	 */
+	bool ReceiveOneDatagram();
+
 	void EventCallback(unsigned events) noexcept;
 };
@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "Manager.hxx"
+
+namespace Uring {
+
+Manager::Manager(unsigned entries, unsigned flags)
+	:Queue(entries, flags)
+{
+}
+
+Manager::Manager(unsigned entries, struct io_uring_params &params)
+	:Queue(entries, params)
+{
+}
+
+} /* namespace Uring */
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "io/uring/Queue.hxx"
+
+namespace Uring {
+
+/**
+ * The #Queue owned by an #EventLoop (see EventLoop::EnableUring()).
+ * The #EventLoop submits and waits for completions with
+ * io_uring_enter() instead of epoll_wait() and dispatches them to
+ * the #Operation instances.
+ */
+class Manager final : public Queue {
+public:
+	/**
+	 * Throws on error.
+	 */
+	Manager(unsigned entries, unsigned flags);
+
+	/**
+	 * Throws on error.
+	 */
+	Manager(unsigned entries, struct io_uring_params &params);
+};
+
+} /* namespace Uring */
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "BufferRing.hxx"
+#include "system/Error.hxx"
+
+#include <liburing.h>
+
+#include <cassert>
+
+namespace Uring {
+
+static struct io_uring_buf_ring *
+SetupBufRing(struct io_uring &ring, unsigned n_buffers, uint16_t group_id)
+{
+	int error;
+	auto *buf_ring = io_uring_setup_buf_ring(&ring, n_buffers, group_id,
+						 0, &error);
+	if (buf_ring == nullptr)
+		throw MakeErrno(-error, "io_uring_setup_buf_ring() failed");
+
+	return buf_ring;
+}
+
+BufferRing::BufferRing(struct io_uring &_ring, uint16_t _group_id,
+		       unsigned _n_buffers, std::size_t _buffer_size)
+	:ring(_ring),
+	 buffers(std::make_unique_for_overwrite<std::byte[]>(_n_buffers * _buffer_size)),
+	 buf_ring(SetupBufRing(ring, _n_buffers, _group_id)),
+	 n_buffers(_n_buffers), buffer_size(_buffer_size),
+	 group_id(_group_id)
+{
+	assert(n_buffers > 0);
+	assert((n_buffers & (n_buffers - 1)) == 0);
+	assert(buffer_size > 0);
+
+	for (unsigned i = 0; i < n_buffers; ++i)
+		Recycle(i);
+
+	Commit();
+}
+
+BufferRing::~BufferRing() noexcept
+{
+	io_uring_free_buf_ring(&ring, buf_ring, n_buffers, group_id);
+}
+
+void
+BufferRing::Recycle(uint16_t buffer_id) noexcept
+{
+	assert(buffer_id < n_buffers);
+	assert(n_recycled < n_buffers);
+
+	const auto buffer = Get(buffer_id);
+	io_uring_buf_ring_add(buf_ring, buffer.data(), buffer.size(),
+			      buffer_id, io_uring_buf_ring_mask(n_buffers),
+			      n_recycled++);
+}
+
+void
+BufferRing::Commit() noexcept
+{
+	if (n_recycled == 0)
+		return;
+
+	io_uring_buf_ring_advance(buf_ring, n_recycled);
+	n_recycled = 0;
+}
+
+} /* namespace Uring */
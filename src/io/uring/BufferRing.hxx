@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+struct io_uring;
+struct io_uring_buf_ring;
+
+namespace Uring {
+
+/**
+ * A ring of provided buffers registered with an io_uring (see
+ * io_uring_setup_buf_ring()).  Operations submitted with
+ * IOSQE_BUFFER_SELECT and this buffer group let the kernel pick a
+ * buffer only when data arrives; the buffer id is reported in the
+ * completion flags.  After the application has consumed the data,
+ * it returns the buffer with Recycle() and Commit().
+ */
+class BufferRing {
+	struct io_uring &ring;
+
+	const std::unique_ptr<std::byte[]> buffers;
+
+	struct io_uring_buf_ring *const buf_ring;
+
+	/**
+	 * The number of buffers (a power of two).
+	 */
+	const unsigned n_buffers;
+
+	const std::size_t buffer_size;
+
+	const uint16_t group_id;
+
+	/**
+	 * The number of buffers passed to Recycle() since the last
+	 * Commit() call.
+	 */
+	unsigned n_recycled = 0;
+
+public:
+	/**
+	 * Allocate the buffers, register the ring with the kernel and
+	 * provide all buffers.
+	 *
+	 * Throws on error.
+	 *
+	 * @param _group_id the buffer group id which must be unique
+	 * within the io_uring (see Queue::AllocateBufferGroupId())
+	 * @param _n_buffers the number of buffers; must be a power of
+	 * two not larger than 32768
+	 */
+	BufferRing(struct io_uring &_ring, uint16_t _group_id,
+		   unsigned _n_buffers, std::size_t _buffer_size);
+
+	/**
+	 * Unregisters the ring from the kernel.  Operations which use
+	 * this buffer group must have been canceled already.
+	 */
+	~BufferRing() noexcept;
+
+	BufferRing(const BufferRing &) = delete;
+	BufferRing &operator=(const BufferRing &) = delete;
+
+	uint16_t GetGroupId() const noexcept {
+		return group_id;
+	}
+
+	unsigned GetBufferCount() const noexcept {
+		return n_buffers;
+	}
+
+	std::size_t GetBufferSize() const noexcept {
+		return buffer_size;
+	}
+
+	/**
+	 * Returns the buffer with the given id.
+	 */
+	std::span<std::byte> Get(uint16_t buffer_id) const noexcept {
+		return {buffers.get() + buffer_id * buffer_size, buffer_size};
+	}
+
+	/**
+	 * Prepare returning a buffer to the kernel.  It is
+	 * published with the next Commit() call.
+	 */
+	void Recycle(uint16_t buffer_id) noexcept;
+
+	/**
+	 * Make all buffers passed to Recycle() available to the
+	 * kernel.
+	 */
+	void Commit() noexcept;
+};
+
+} /* namespace Uring */
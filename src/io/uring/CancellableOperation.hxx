@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Operation.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <cassert>
+
+#include <liburing.h>
+
+namespace Uring {
+
+/**
+ * The object whose address is passed to the kernel as "user_data"
+ * of a submission.  It is owned by the #Queue and lives until the
+ * kernel has posted the last completion of the operation, even if
+ * the #Operation has been destroyed (i.e. canceled) meanwhile.
+ */
+class CancellableOperation : public IntrusiveListHook<> {
+	Operation *operation;
+
+public:
+	explicit CancellableOperation(Operation &_operation) noexcept {
+		Attach(_operation);
+	}
+
+	~CancellableOperation() noexcept {
+		assert(operation == nullptr);
+	}
+
+	CancellableOperation(const CancellableOperation &) = delete;
+	CancellableOperation &operator=(const CancellableOperation &) = delete;
+
+	/**
+	 * Reuse this (detached) object for a new #Operation.
+	 */
+	void Attach(Operation &_operation) noexcept {
+		assert(_operation.cancellable == nullptr);
+
+		operation = &_operation;
+		operation->cancellable = this;
+	}
+
+	bool IsCanceled() const noexcept {
+		return operation == nullptr;
+	}
+
+	/**
+	 * Detach the #Operation; further completions will be
+	 * discarded.
+	 */
+	void Cancel([[maybe_unused]] Operation &_operation) noexcept {
+		assert(operation == &_operation);
+		assert(operation->cancellable == this);
+
+		Detach();
+	}
+
+	/**
+	 * Like Cancel(), but the #Operation may have been detached
+	 * already.
+	 */
+	void Detach() noexcept {
+		if (operation != nullptr) {
+			operation->cancellable = nullptr;
+			operation = nullptr;
+		}
+	}
+
+	/**
+	 * Detach the #Operation before its last completion is
+	 * delivered, so IsUringPending() returns false and the
+	 * handler may resubmit the operation or destroy it.
+	 *
+	 * @return the #Operation or nullptr if it was canceled
+	 */
+	Operation *Release() noexcept {
+		auto *_operation = operation;
+		Detach();
+		return _operation;
+	}
+
+	/**
+	 * Deliver a completion which is not the last one
+	 * (IORING_CQE_F_MORE) to the #Operation.
+	 */
+	void OnUringCompletion(int res, unsigned flags) noexcept {
+		assert(flags & IORING_CQE_F_MORE);
+
+		if (operation != nullptr)
+			operation->OnUringCompletion(res, flags);
+	}
+};
+
+} /* namespace Uring */
@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "Operation.hxx"
+#include "CancellableOperation.hxx"
+
+namespace Uring {
+
+void
+Operation::CancelUring() noexcept
+{
+	if (cancellable == nullptr)
+		return;
+
+	cancellable->Cancel(*this);
+}
+
+} /* namespace Uring */
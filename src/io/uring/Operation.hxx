@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+namespace Uring {
+
+class CancellableOperation;
+class Queue;
+
+/**
+ * An asynchronous I/O operation to be queued in a #Queue instance.
+ */
+class Operation {
+	friend class CancellableOperation;
+	friend class Queue;
+
+	CancellableOperation *cancellable = nullptr;
+
+public:
+	Operation() noexcept = default;
+
+	~Operation() noexcept {
+		CancelUring();
+	}
+
+	Operation(const Operation &) = delete;
+	Operation &operator=(const Operation &) = delete;
+
+	/**
+	 * Is this operation still waiting for (another) completion?
+	 * A multishot operation remains pending until the kernel
+	 * posts a completion without IORING_CQE_F_MORE.
+	 */
+	bool IsUringPending() const noexcept {
+		return cancellable != nullptr;
+	}
+
+	/**
+	 * Detach this object from the #Queue, i.e. its completion
+	 * will not be delivered.  This does not cancel the
+	 * operation in the kernel (see Queue::CancelOperation()), so
+	 * all buffers passed to it must remain valid until it
+	 * completes.
+	 */
+	void CancelUring() noexcept;
+
+	/**
+	 * This method is called when the operation completes.  The
+	 * default implementation calls OnUringCompletion(int);
+	 * override this one if you need the completion flags, e.g.
+	 * the id of a provided buffer (IORING_CQE_F_BUFFER).
+	 *
+	 * @param res the result code; the meaning is specific to the
+	 * operation, but negative values usually mean an error has
+	 * occurred
+	 * @param flags the completion's IORING_CQE_F_* flags
+	 */
+	virtual void OnUringCompletion(int res,
+				       [[maybe_unused]] unsigned flags) noexcept {
+		OnUringCompletion(res);
+	}
+
+	virtual void OnUringCompletion([[maybe_unused]] int res) noexcept {}
+};
+
+} /* namespace Uring */
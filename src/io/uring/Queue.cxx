@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "Queue.hxx"
+#include "CancellableOperation.hxx"
+#include "util/PrintException.hxx"
+
+#include <stdexcept>
+
+namespace Uring {
+
+Queue::Queue(unsigned entries, unsigned flags)
+	:ring(entries, flags)
+{
+}
+
+Queue::Queue(unsigned entries, struct io_uring_params &params)
+	:ring(entries, params)
+{
+}
+
+Queue::~Queue() noexcept
+{
+	/* the kernel cancels all operations when the io_uring is
+	   closed; just free our bookkeeping objects */
+	operations.clear_and_dispose([](CancellableOperation *c){
+		c->Detach();
+		delete c;
+	});
+
+	spare_operations.clear_and_dispose([](CancellableOperation *c){
+		delete c;
+	});
+}
+
+bool
+Queue::HasPendingMoreThan(std::size_t n) const noexcept
+{
+	for ([[maybe_unused]] const auto &i : operations)
+		if (n-- == 0)
+			return true;
+
+	return false;
+}
+
+struct io_uring_sqe &
+Queue::RequireSubmitEntry()
+{
+	auto *sqe = GetSubmitEntry();
+	if (sqe == nullptr) {
+		/* the submit queue is full; submit it to the
+		   kernel and try again */
+		Submit();
+
+		sqe = GetSubmitEntry();
+		if (sqe == nullptr)
+			throw std::runtime_error{"io_uring_get_sqe() failed"};
+	}
+
+	return *sqe;
+}
+
+void
+Queue::Push(struct io_uring_sqe &sqe, Operation &operation) noexcept
+{
+	CancellableOperation *c;
+	if (spare_operations.empty())
+		c = new CancellableOperation(operation);
+	else {
+		c = &spare_operations.pop_front();
+		c->Attach(operation);
+	}
+
+	operations.push_back(*c);
+	io_uring_sqe_set_data(&sqe, c);
+}
+
+void
+Queue::CancelOperation(Operation &operation) noexcept
+{
+	if (!operation.IsUringPending())
+		return;
+
+	auto *sqe = GetSubmitEntry();
+	if (sqe == nullptr) {
+		try {
+			Submit();
+		} catch (...) {
+			PrintException(std::current_exception());
+		}
+
+		sqe = GetSubmitEntry();
+	}
+
+	if (sqe != nullptr) {
+		/* the CancellableOperation is the "user_data" of
+		   the operation to be canceled; the completion of
+		   this request has no "user_data" and is ignored */
+		io_uring_prep_cancel(sqe, operation.cancellable, 0);
+		io_uring_sqe_set_data(sqe, nullptr);
+	}
+
+	operation.CancelUring();
+}
+
+inline void
+Queue::DispatchOneCompletion(struct io_uring_cqe &cqe) noexcept
+{
+	auto *c = (CancellableOperation *)io_uring_cqe_get_data(&cqe);
+	const int res = cqe.res;
+	const unsigned flags = cqe.flags;
+
+	/* mark the completion as "seen" before invoking the
+	   handler, which may submit new operations */
+	ring.SeenCompletion(cqe);
+
+	if (c == nullptr)
+		/* the completion of a cancel request */
+		return;
+
+	if (flags & IORING_CQE_F_MORE) {
+		/* a multishot operation which remains active */
+		c->OnUringCompletion(res, flags);
+		return;
+	}
+
+	/* this is the last completion: recycle the
+	   CancellableOperation before invoking the handler, which
+	   may submit a new operation */
+	auto *operation = c->Release();
+	c->unlink();
+	spare_operations.push_front(*c);
+
+	if (operation != nullptr)
+		operation->OnUringCompletion(res, flags);
+}
+
+bool
+Queue::DispatchOneCompletion() noexcept
+try {
+	auto *cqe = ring.PeekCompletion();
+	if (cqe == nullptr)
+		return false;
+
+	DispatchOneCompletion(*cqe);
+	return true;
+} catch (...) {
+	PrintException(std::current_exception());
+	return false;
+}
+
+void
+Queue::DispatchCompletions() noexcept
+{
+	while (DispatchOneCompletion()) {}
+}
+
+void
+Queue::SubmitAndWait(struct __kernel_timespec *timeout) noexcept
+{
+	try {
+		ring.SubmitAndWaitCompletion(timeout);
+	} catch (...) {
+		PrintException(std::current_exception());
+	}
+}
+
+} /* namespace Uring */
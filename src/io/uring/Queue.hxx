@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Ring.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Uring {
+
+class Operation;
+class CancellableOperation;
+
+/**
+ * High-level C++ wrapper for a `struct io_uring`.  It supports a
+ * handler class, cancellation and multishot operations.
+ */
+class Queue {
+	Ring ring;
+
+	IntrusiveList<CancellableOperation> operations;
+
+	/**
+	 * #CancellableOperation instances which have completed; they
+	 * are reused by Push() to avoid a heap allocation for each
+	 * submission.
+	 */
+	IntrusiveList<CancellableOperation> spare_operations;
+
+	/**
+	 * The next id to be returned by AllocateBufferGroupId().
+	 */
+	uint16_t next_buffer_group_id = 0;
+
+public:
+	Queue(unsigned entries, unsigned flags);
+	Queue(unsigned entries, struct io_uring_params &params);
+	~Queue() noexcept;
+
+	Queue(const Queue &) = delete;
+	Queue &operator=(const Queue &) = delete;
+
+	FileDescriptor GetFileDescriptor() const noexcept {
+		return ring.GetFileDescriptor();
+	}
+
+	/**
+	 * Returns the underlying `struct io_uring`, e.g. for
+	 * registering a #BufferRing.
+	 */
+	struct io_uring &GetRing() noexcept {
+		return ring.Get();
+	}
+
+	bool HasPending() const noexcept {
+		return !operations.empty();
+	}
+
+	/**
+	 * Are there more than @a n pending operations?
+	 */
+	[[gnu::pure]]
+	bool HasPendingMoreThan(std::size_t n) const noexcept;
+
+	/**
+	 * Returns a new id for a provided buffer group which is
+	 * unique within this queue.
+	 */
+	uint16_t AllocateBufferGroupId() noexcept {
+		return next_buffer_group_id++;
+	}
+
+	struct io_uring_sqe *GetSubmitEntry() noexcept {
+		return ring.GetSubmitEntry();
+	}
+
+	/**
+	 * Like GetSubmitEntry(), but call Submit() if the submit
+	 * queue is full.
+	 *
+	 * Throws on error.
+	 */
+	struct io_uring_sqe &RequireSubmitEntry();
+
+	/**
+	 * Register an #Operation for the given submit queue entry.
+	 * It is submitted with the next Submit() call.  The
+	 * #Operation's OnUringCompletion() method will be invoked for
+	 * each completion.
+	 */
+	void Push(struct io_uring_sqe &sqe, Operation &operation) noexcept;
+
+	/**
+	 * Detach the given #Operation and ask the kernel to cancel
+	 * it.  This is mandatory for multishot operations, which
+	 * would otherwise run forever.
+	 */
+	void CancelOperation(Operation &operation) noexcept;
+
+	/**
+	 * Throws on error.
+	 */
+	void Submit() {
+		ring.Submit();
+	}
+
+	/**
+	 * Invoke the handlers of all completions which are
+	 * available right now.
+	 */
+	void DispatchCompletions() noexcept;
+
+	/**
+	 * Submit all pending submit queue entries and wait for at
+	 * least one completion (or until the timeout expires), but
+	 * do not dispatch completions.
+	 *
+	 * @param timeout the timeout or nullptr to wait forever
+	 */
+	void SubmitAndWait(struct __kernel_timespec *timeout) noexcept;
+
+	/**
+	 * Like SubmitAndWait(), but dispatch all available
+	 * completions afterwards.
+	 */
+	void SubmitAndWaitDispatchCompletions(struct __kernel_timespec *timeout) noexcept {
+		SubmitAndWait(timeout);
+		DispatchCompletions();
+	}
+
+private:
+	/**
+	 * @return false if no completion was available
+	 */
+	bool DispatchOneCompletion() noexcept;
+
+	void DispatchOneCompletion(struct io_uring_cqe &cqe) noexcept;
+};
+
+} /* namespace Uring */
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "Ring.hxx"
+#include "system/Error.hxx"
+
+namespace Uring {
+
+Ring::Ring(unsigned entries, unsigned flags)
+{
+	int error = io_uring_queue_init(entries, &ring, flags);
+	if (error < 0)
+		throw MakeErrno(-error, "io_uring_queue_init() failed");
+}
+
+Ring::Ring(unsigned entries, struct io_uring_params &params)
+{
+	int error = io_uring_queue_init_params(entries, &ring, &params);
+	if (error < 0)
+		throw MakeErrno(-error, "io_uring_queue_init_params() failed");
+}
+
+void
+Ring::Submit()
+{
+	int error = io_uring_submit(&ring);
+	if (error < 0)
+		throw MakeErrno(-error, "io_uring_submit() failed");
+}
+
+bool
+Ring::SubmitAndWaitCompletion(struct __kernel_timespec *timeout)
+{
+	struct io_uring_cqe *cqe;
+	int error = io_uring_submit_and_wait_timeout(&ring, &cqe, 1,
+						     timeout, nullptr);
+	if (error < 0) {
+		if (error == -ETIME || error == -EINTR || error == -EAGAIN)
+			return false;
+
+		throw MakeErrno(-error, "io_uring_submit_and_wait_timeout() failed");
+	}
+
+	return true;
+}
+
+struct io_uring_cqe *
+Ring::PeekCompletion()
+{
+	struct io_uring_cqe *cqe;
+	int error = io_uring_peek_cqe(&ring, &cqe);
+	if (error < 0) {
+		if (error == -EAGAIN)
+			return nullptr;
+
+		throw MakeErrno(-error, "io_uring_peek_cqe() failed");
+	}
+
+	return cqe;
+}
+
+} /* namespace Uring */
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "io/FileDescriptor.hxx"
+
+#include <liburing.h>
+
+namespace Uring {
+
+/**
+ * Low-level C++ wrapper for a `struct io_uring`.  It provides simple
+ * wrappers to liburing functions and throws std::system_error on
+ * errors.
+ */
+class Ring {
+	struct io_uring ring;
+
+public:
+	/**
+	 * Construct the io_uring using io_uring_queue_init().
+	 *
+	 * Throws on error.
+	 */
+	Ring(unsigned entries, unsigned flags);
+
+	/**
+	 * Construct the io_uring using io_uring_queue_init_params().
+	 *
+	 * Throws on error.
+	 */
+	Ring(unsigned entries, struct io_uring_params &params);
+
+	~Ring() noexcept {
+		io_uring_queue_exit(&ring);
+	}
+
+	Ring(const Ring &) = delete;
+	Ring &operator=(const Ring &) = delete;
+
+	/**
+	 * Returns the underlying `struct io_uring` which can be
+	 * passed to liburing functions which are not wrapped by this
+	 * class.
+	 */
+	struct io_uring &Get() noexcept {
+		return ring;
+	}
+
+	FileDescriptor GetFileDescriptor() const noexcept {
+		return FileDescriptor(ring.ring_fd);
+	}
+
+	/**
+	 * Returns a submit queue entry or nullptr if the submit
+	 * queue is full.
+	 */
+	struct io_uring_sqe *GetSubmitEntry() noexcept {
+		return io_uring_get_sqe(&ring);
+	}
+
+	/**
+	 * Submit all pending submit queue entries.
+	 *
+	 * Throws on error.
+	 */
+	void Submit();
+
+	/**
+	 * Submit all pending submit queue entries and wait for at
+	 * least one completion (or until the timeout expires).
+	 *
+	 * Throws on error.
+	 *
+	 * @param timeout the timeout or nullptr to wait forever
+	 * @return false if the timeout has expired or if the wait was
+	 * interrupted by a signal
+	 */
+	bool SubmitAndWaitCompletion(struct __kernel_timespec *timeout);
+
+	/**
+	 * Returns the next completion queue entry without waiting
+	 * or nullptr if there is none.  After it has been handled,
+	 * call SeenCompletion().
+	 *
+	 * Throws on error.
+	 */
+	struct io_uring_cqe *PeekCompletion();
+
+	void SeenCompletion(struct io_uring_cqe &cqe) noexcept {
+		io_uring_cqe_seen(&ring, &cqe);
+	}
+};
+
+} /* namespace Uring */
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "SocketAddress.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <string_view>
+
+#include <sys/un.h>
+
+/**
+ * A local socket address (AF_LOCAL) with a path name or (if the
+ * name starts with '@') an abstract name.
+ */
+class LocalSocketAddress {
+	struct sockaddr_un address;
+	SocketAddress::size_type size;
+
+public:
+	/**
+	 * The maximum length of a name passed to the constructor.
+	 */
+	static constexpr std::size_t MAX_LENGTH =
+		sizeof(sockaddr_un::sun_path) - 1;
+
+	/**
+	 * @param name a path name or '@' followed by an abstract
+	 * name; it must not be empty and not longer than
+	 * #MAX_LENGTH
+	 */
+	explicit LocalSocketAddress(std::string_view name) noexcept {
+		assert(!name.empty());
+		assert(name.size() <= MAX_LENGTH);
+
+		address.sun_family = AF_LOCAL;
+		std::copy(name.begin(), name.end(), address.sun_path);
+
+		if (name.front() == '@') {
+			/* abstract names begin with a null byte and
+			   are not null-terminated */
+			address.sun_path[0] = '\0';
+			size = offsetof(struct sockaddr_un, sun_path) + name.size();
+		} else {
+			address.sun_path[name.size()] = '\0';
+			size = offsetof(struct sockaddr_un, sun_path) + name.size() + 1;
+		}
+	}
+
+	operator SocketAddress() const noexcept {
+		return {(const struct sockaddr *)(const void *)&address, size};
+	}
+};
@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "MultiReceiveMessage.hxx"
+#include "MsgHdr.hxx"
+#include "SocketDescriptor.hxx"
+#include "SocketError.hxx"
+#include "StaticSocketAddress.hxx"
+#include "time/Convert.hxx"
+
+#include <cassert>
+#include <cstring>
+
+#include <sys/socket.h>
+
+/**
+ * The size of the control message buffer of each datagram; it has
+ * room for SCM_TIMESTAMPNS and SO_RXQ_OVFL messages.
+ */
+static constexpr std::size_t CONTROL_SIZE =
+	CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t));
+
+MultiReceiveMessage::MultiReceiveMessage(std::size_t _allocated_datagrams,
+					 std::size_t _max_payload_size)
+	:allocated_datagrams(_allocated_datagrams),
+	 max_payload_size(_max_payload_size),
+	 addresses(std::make_unique_for_overwrite<StaticSocketAddress[]>(allocated_datagrams)),
+	 payloads(std::make_unique_for_overwrite<std::byte[]>(allocated_datagrams * max_payload_size)),
+	 controls(std::make_unique_for_overwrite<std::byte[]>(allocated_datagrams * CONTROL_SIZE)),
+	 iovecs(std::make_unique_for_overwrite<struct iovec[]>(allocated_datagrams)),
+	 m(std::make_unique<struct mmsghdr[]>(allocated_datagrams)),
+	 datagrams(std::make_unique_for_overwrite<Datagram[]>(allocated_datagrams))
+{
+	assert(allocated_datagrams > 0);
+	assert(max_payload_size > 0);
+
+	for (std::size_t i = 0; i < allocated_datagrams; ++i) {
+		iovecs[i] = {
+			.iov_base = payloads.get() + i * max_payload_size,
+			.iov_len = max_payload_size,
+		};
+
+		m[i].msg_hdr = MakeMsgHdr(addresses[i], {&iovecs[i], 1},
+					  {controls.get() + i * CONTROL_SIZE, CONTROL_SIZE});
+	}
+}
+
+MultiReceiveMessage::MultiReceiveMessage(MultiReceiveMessage &&) noexcept = default;
+
+MultiReceiveMessage::~MultiReceiveMessage() noexcept = default;
+
+void
+MultiReceiveMessage::Receive(SocketDescriptor s)
+{
+	Clear();
+
+	/* recvmmsg() overwrites the name and control lengths; reset
+	   them to the capacity for each slot */
+	for (std::size_t i = 0; i < allocated_datagrams; ++i) {
+		m[i].msg_hdr.msg_namelen = addresses[i].GetCapacity();
+		m[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+		m[i].msg_hdr.msg_flags = 0;
+	}
+
+	int flags = MSG_DONTWAIT;
+#ifdef MSG_CMSG_CLOEXEC
+	flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+	int result = recvmmsg(s.Get(), m.get(), allocated_datagrams,
+			      flags, nullptr);
+	if (result < 0) {
+		const auto e = GetSocketError();
+		if (IsSocketErrorReceiveWouldBlock(e))
+			return;
+
+		throw MakeSocketError(e, "recvmmsg() failed");
+	}
+
+	for (std::size_t i = 0; i < std::size_t(result); ++i) {
+		auto &msg = m[i].msg_hdr;
+		if (msg.msg_flags & MSG_TRUNC) [[unlikely]]
+			/* this datagram was too large for our buffer;
+			   discard it */
+			continue;
+
+		auto &d = datagrams[n_datagrams++];
+		d.address = {addresses[i], msg.msg_namelen};
+		d.payload = {
+			(const std::byte *)iovecs[i].iov_base,
+			m[i].msg_len,
+		};
+		d.timestamp = {};
+
+		for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_SOCKET)
+				continue;
+
+			if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+				struct timespec ts;
+				memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+				d.timestamp = ToSystemTimePoint(ts);
+			} else if (cmsg->cmsg_type == SO_RXQ_OVFL)
+				memcpy(&drop_count, CMSG_DATA(cmsg), sizeof(drop_count));
+		}
+	}
+}
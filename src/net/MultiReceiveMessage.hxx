@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "SocketAddress.hxx"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+struct mmsghdr;
+struct iovec;
+class StaticSocketAddress;
+class SocketDescriptor;
+
+/**
+ * Receive multiple datagrams at once using recvmmsg().  The buffers
+ * are allocated once in the constructor and reused for each
+ * Receive() call.
+ *
+ * If SO_TIMESTAMPNS is enabled on the socket, the kernel receive
+ * time of each datagram is available in Datagram::timestamp.  If
+ * SO_RXQ_OVFL is enabled, GetDropCount() returns the number of
+ * datagrams dropped by the kernel.
+ */
+class MultiReceiveMessage {
+public:
+	struct Datagram {
+		SocketAddress address;
+		std::span<const std::byte> payload;
+
+		/**
+		 * The time the kernel has received this datagram;
+		 * the epoch (a default-initialized value) if not
+		 * known.
+		 */
+		std::chrono::system_clock::time_point timestamp;
+	};
+
+private:
+	const std::size_t allocated_datagrams;
+	const std::size_t max_payload_size;
+
+	std::unique_ptr<StaticSocketAddress[]> addresses;
+	std::unique_ptr<std::byte[]> payloads;
+	std::unique_ptr<std::byte[]> controls;
+	std::unique_ptr<struct iovec[]> iovecs;
+	std::unique_ptr<struct mmsghdr[]> m;
+	std::unique_ptr<Datagram[]> datagrams;
+
+	std::size_t n_datagrams = 0;
+
+	/**
+	 * The most recent SO_RXQ_OVFL value.
+	 */
+	uint32_t drop_count = 0;
+
+public:
+	/**
+	 * @param _allocated_datagrams the maximum number of
+	 * datagrams received by one Receive() call (the batch depth)
+	 * @param _max_payload_size the maximum payload size of each
+	 * datagram; larger datagrams are truncated and discarded
+	 */
+	MultiReceiveMessage(std::size_t _allocated_datagrams,
+			    std::size_t _max_payload_size);
+	~MultiReceiveMessage() noexcept;
+
+	MultiReceiveMessage(MultiReceiveMessage &&) noexcept;
+	MultiReceiveMessage &operator=(MultiReceiveMessage &&) = delete;
+
+	std::size_t GetCapacity() const noexcept {
+		return allocated_datagrams;
+	}
+
+	std::size_t GetMaxPayloadSize() const noexcept {
+		return max_payload_size;
+	}
+
+	/**
+	 * Returns the number of datagrams the kernel has dropped on
+	 * the socket because its receive buffer was full (as of the
+	 * most recent datagram received).  The kernel counter is
+	 * 32 bits wide and wraps around.
+	 */
+	uint32_t GetDropCount() const noexcept {
+		return drop_count;
+	}
+
+	/**
+	 * Receive up to GetCapacity() datagrams from the given
+	 * (non-blocking) socket, replacing the previous batch.
+	 *
+	 * Throws on error.  If no datagram is pending, the new batch
+	 * is empty.
+	 */
+	void Receive(SocketDescriptor s);
+
+	/**
+	 * Forget the datagrams received by the last Receive() call.
+	 */
+	void Clear() noexcept {
+		n_datagrams = 0;
+	}
+
+	bool empty() const noexcept {
+		return n_datagrams == 0;
+	}
+
+	std::span<const Datagram> GetDatagrams() const noexcept {
+		return {datagrams.get(), n_datagrams};
+	}
+
+	auto begin() const noexcept {
+		return GetDatagrams().begin();
+	}
+
+	auto end() const noexcept {
+		return GetDatagrams().end();
+	}
+};
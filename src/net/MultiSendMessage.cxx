@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "MultiSendMessage.hxx"
+#include "MsgHdr.hxx"
+#include "SocketDescriptor.hxx"
+#include "SocketError.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <sys/socket.h>
+
+MultiSendMessage::MultiSendMessage(std::size_t _allocated_datagrams,
+				   std::size_t _max_payload_size)
+	:allocated_datagrams(_allocated_datagrams),
+	 max_payload_size(_max_payload_size),
+	 addresses(std::make_unique_for_overwrite<struct sockaddr_storage[]>(allocated_datagrams)),
+	 payloads(std::make_unique_for_overwrite<std::byte[]>(allocated_datagrams * max_payload_size)),
+	 iovecs(std::make_unique_for_overwrite<struct iovec[]>(allocated_datagrams)),
+	 m(std::make_unique<struct mmsghdr[]>(allocated_datagrams))
+{
+	assert(allocated_datagrams > 0);
+	assert(max_payload_size > 0);
+
+	for (std::size_t i = 0; i < allocated_datagrams; ++i)
+		iovecs[i].iov_base = payloads.get() + i * max_payload_size;
+}
+
+MultiSendMessage::MultiSendMessage(MultiSendMessage &&) noexcept = default;
+
+MultiSendMessage::~MultiSendMessage() noexcept = default;
+
+bool
+MultiSendMessage::Push(SocketAddress address,
+		       std::span<const std::byte> payload) noexcept
+{
+	assert(!address.IsNull());
+	assert(address.GetSize() <= sizeof(addresses[0]));
+	assert(payload.size() <= max_payload_size);
+
+	if (empty())
+		/* reuse the slots of datagrams which have been sent
+		   (or discarded) */
+		Clear();
+	else if (IsFull())
+		return false;
+
+	const std::size_t i = tail++;
+
+	std::memcpy(&addresses[i], address.GetAddress(), address.GetSize());
+	std::copy(payload.begin(), payload.end(),
+		  static_cast<std::byte *>(iovecs[i].iov_base));
+	iovecs[i].iov_len = payload.size();
+
+	m[i].msg_hdr = MakeMsgHdr(addresses[i], {&iovecs[i], 1}, {});
+	m[i].msg_hdr.msg_namelen = address.GetSize();
+	return true;
+}
+
+SocketAddress
+MultiSendMessage::GetFrontAddress() const noexcept
+{
+	assert(!empty());
+
+	return {
+		reinterpret_cast<const struct sockaddr *>(&addresses[head]),
+		m[head].msg_hdr.msg_namelen,
+	};
+}
+
+void
+MultiSendMessage::PopFront() noexcept
+{
+	assert(!empty());
+
+	++head;
+}
+
+bool
+MultiSendMessage::Send(SocketDescriptor s)
+{
+	while (!empty()) {
+		int result = sendmmsg(s.Get(), m.get() + head, size(),
+				      MSG_DONTWAIT|MSG_NOSIGNAL);
+		if (result < 0) {
+			const auto e = GetSocketError();
+			if (IsSocketErrorSendWouldBlock(e))
+				return false;
+
+			throw MakeSocketError(e, "sendmmsg() failed");
+		}
+
+		head += result;
+	}
+
+	Clear();
+	return true;
+}
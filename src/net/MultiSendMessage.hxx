@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "SocketAddress.hxx"
+
+#include <cstddef>
+#include <memory>
+#include <span>
+
+struct mmsghdr;
+struct iovec;
+struct sockaddr_storage;
+class SocketDescriptor;
+
+/**
+ * A queue of outgoing datagrams which are sent at once using
+ * sendmmsg().  The buffers are allocated once in the constructor
+ * and reused.
+ */
+class MultiSendMessage {
+	const std::size_t allocated_datagrams;
+	const std::size_t max_payload_size;
+
+	std::unique_ptr<struct sockaddr_storage[]> addresses;
+	std::unique_ptr<std::byte[]> payloads;
+	std::unique_ptr<struct iovec[]> iovecs;
+	std::unique_ptr<struct mmsghdr[]> m;
+
+	/**
+	 * The index of the first datagram which has not yet been
+	 * sent.
+	 */
+	std::size_t head = 0;
+
+	/**
+	 * The index of the next free slot.
+	 */
+	std::size_t tail = 0;
+
+public:
+	/**
+	 * @param _allocated_datagrams the maximum number of queued
+	 * datagrams
+	 * @param _max_payload_size the maximum payload size of each
+	 * datagram
+	 */
+	MultiSendMessage(std::size_t _allocated_datagrams,
+			 std::size_t _max_payload_size);
+	~MultiSendMessage() noexcept;
+
+	MultiSendMessage(MultiSendMessage &&) noexcept;
+	MultiSendMessage &operator=(MultiSendMessage &&) = delete;
+
+	std::size_t GetMaxPayloadSize() const noexcept {
+		return max_payload_size;
+	}
+
+	bool empty() const noexcept {
+		return head == tail;
+	}
+
+	/**
+	 * Returns the number of datagrams which have not yet been
+	 * sent.
+	 */
+	std::size_t size() const noexcept {
+		return tail - head;
+	}
+
+	/**
+	 * Are all slots occupied?  Slots of datagrams which have been
+	 * sent are only freed after the whole queue has been sent.
+	 */
+	bool IsFull() const noexcept {
+		return tail == allocated_datagrams && !empty();
+	}
+
+	/**
+	 * Discard all queued datagrams.
+	 */
+	void Clear() noexcept {
+		head = tail = 0;
+	}
+
+	/**
+	 * Copy a datagram into the queue.
+	 *
+	 * @param payload the payload; its size must not exceed
+	 * GetMaxPayloadSize()
+	 * @return false if the queue is full
+	 */
+	bool Push(SocketAddress address,
+		  std::span<const std::byte> payload) noexcept;
+
+	/**
+	 * Returns the destination of the oldest datagram which has
+	 * not yet been sent.
+	 */
+	[[gnu::pure]]
+	SocketAddress GetFrontAddress() const noexcept;
+
+	/**
+	 * Discard the oldest datagram which has not yet been sent.
+	 * The address returned by GetFrontAddress() remains valid
+	 * until the next Push() or Send() call.
+	 */
+	void PopFront() noexcept;
+
+	/**
+	 * Send as many queued datagrams as possible to the given
+	 * (non-blocking) socket.
+	 *
+	 * Throws on error; the datagram which has failed is still at
+	 * the front of the queue, and the caller may remove it with
+	 * PopFront() before trying again.
+	 *
+	 * @return true if the queue is empty now, false if the
+	 * socket's send buffer is full
+	 */
+	bool Send(SocketDescriptor s);
+};
@@ -15,6 +15,7 @@
 #include <vector>
 
 #include <stdint.h>
+#include <time.h>
 
 template<size_t PAYLOAD_SIZE, size_t CMSG_SIZE>
 struct ReceiveMessageBuffer {
@@ -34,6 +35,21 @@ struct ReceiveMessageResult {
 
 	const struct ucred *cred = nullptr;
 
+	/**
+	 * The time the kernel has received this datagram
+	 * (CLOCK_REALTIME); only available if SO_TIMESTAMPNS is
+	 * enabled on the socket.
+	 */
+	const struct timespec *timestamp = nullptr;
+
+	/**
+	 * The number of datagrams the kernel has dropped on this
+	 * socket so far because its receive buffer was full; only
+	 * available if SO_RXQ_OVFL is enabled on the socket and at
+	 * least one datagram has been dropped.
+	 */
+	const uint32_t *drops = nullptr;
+
 	std::vector<UniqueFileDescriptor> fds;
 };
 
@@ -74,6 +90,12 @@ ReceiveMessage(SocketDescriptor s,
 		if (cmsg->cmsg_level == SOL_SOCKET &&
 		    cmsg->cmsg_type == SCM_CREDENTIALS) {
 			result.cred = (const struct ucred *)CMSG_DATA(cmsg);
+		} else if (cmsg->cmsg_level == SOL_SOCKET &&
+			   cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			result.timestamp = (const struct timespec *)CMSG_DATA(cmsg);
+		} else if (cmsg->cmsg_level == SOL_SOCKET &&
+			   cmsg->cmsg_type == SO_RXQ_OVFL) {
+			result.drops = (const uint32_t *)CMSG_DATA(cmsg);
 		} else if (cmsg->cmsg_level == SOL_SOCKET &&
 			   cmsg->cmsg_type == SCM_RIGHTS) {
 			const int *fds = (const int *)CMSG_DATA(cmsg);
@@ -93,3 +115,86 @@ ReceiveMessage(SocketDescriptor s,
 
 	return result;
 }
+
+template<size_t PAYLOAD_SIZE>
+struct ReceiveDatagramBuffer {
+	StaticSocketAddress address;
+
+	std::byte payload[PAYLOAD_SIZE];
+
+	/**
+	 * Room for SCM_TIMESTAMPNS and SO_RXQ_OVFL.
+	 */
+	static constexpr size_t CMSG_BUFFER_SIZE =
+		CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t));
+	static constexpr size_t CMSG_N_LONGS = (CMSG_BUFFER_SIZE + sizeof(long) - 1) / sizeof(long);
+	long cmsg[CMSG_N_LONGS];
+};
+
+struct ReceiveDatagramResult {
+	SocketAddress address;
+
+	std::span<const std::byte> payload{};
+
+	/**
+	 * See ReceiveMessageResult::timestamp.
+	 */
+	const struct timespec *timestamp = nullptr;
+
+	/**
+	 * See ReceiveMessageResult::drops.
+	 */
+	const uint32_t *drops = nullptr;
+};
+
+/**
+ * A lean version of ReceiveMessage() for datagram sockets which
+ * never carry credentials or file descriptors (e.g. UDP): only the
+ * receive timestamp and the drop counter are parsed from the
+ * (small, fixed-size) control message buffer, and there is no heap
+ * allocation.
+ */
+template<size_t PAYLOAD_SIZE>
+ReceiveDatagramResult
+ReceiveDatagram(SocketDescriptor s,
+		ReceiveDatagramBuffer<PAYLOAD_SIZE> &buffer,
+		int flags)
+{
+	struct iovec iov[] = {MakeIovec(buffer.payload)};
+
+	auto msg = MakeMsgHdr(buffer.address, iov,
+			      {(const std::byte *)buffer.cmsg, sizeof(buffer.cmsg)});
+
+	auto nbytes = s.Receive(msg, flags);
+	if (nbytes < 0)
+		throw MakeSocketError("recvmsg() failed");
+
+	if (nbytes == 0)
+		return {};
+
+	ReceiveDatagramResult result;
+	result.address = {buffer.address, msg.msg_namelen};
+	result.payload = {buffer.payload, size_t(nbytes)};
+
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-align"
+#endif
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET)
+			continue;
+
+		if (cmsg->cmsg_type == SCM_TIMESTAMPNS)
+			result.timestamp = (const struct timespec *)CMSG_DATA(cmsg);
+		else if (cmsg->cmsg_type == SO_RXQ_OVFL)
+			result.drops = (const uint32_t *)CMSG_DATA(cmsg);
+	}
+
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif
+
+	return result;
+}
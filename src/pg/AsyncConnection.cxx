@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "AsyncConnection.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+namespace Pg {
+
+static constexpr Event::Duration INITIAL_RECONNECT_DELAY = std::chrono::seconds{1};
+static constexpr Event::Duration MAX_RECONNECT_DELAY = std::chrono::minutes{1};
+
+AsyncConnection::AsyncConnection(EventLoop &event_loop, const char *_conninfo,
+				 AsyncConnectionHandler &_handler) noexcept
+	:conninfo(_conninfo), handler(_handler),
+	 socket_event(event_loop, BIND_THIS_METHOD(OnSocketEvent)),
+	 reconnect_timer(event_loop, BIND_THIS_METHOD(OnReconnectTimer)),
+	 reconnect_delay(INITIAL_RECONNECT_DELAY)
+{
+}
+
+AsyncConnection::~AsyncConnection() noexcept
+{
+	Disconnect();
+}
+
+void
+AsyncConnection::DetachSocket() noexcept
+{
+	if (!socket_event.IsDefined())
+		return;
+
+	if (IsDefined() && GetSocket() == socket_event.GetSocket().Get())
+		/* still open: unregister it from epoll */
+		socket_event.ReleaseSocket();
+	else
+		/* libpq has already closed it */
+		socket_event.Abandon();
+}
+
+inline void
+AsyncConnection::StartConnect()
+{
+	assert(!IsDefined());
+
+	Connection::StartConnect(conninfo.c_str());
+	state = State::CONNECTING;
+
+	socket_event.Open(SocketDescriptor{GetSocket()});
+	socket_event.ScheduleWrite();
+}
+
+void
+AsyncConnection::Connect() noexcept
+{
+	assert(state == State::DISCONNECTED);
+
+	try {
+		StartConnect();
+	} catch (...) {
+		Fail(std::current_exception());
+	}
+}
+
+void
+AsyncConnection::Disconnect() noexcept
+{
+	reconnect_timer.Cancel();
+	DetachSocket();
+	Connection::Disconnect();
+	result_handler = nullptr;
+	state = State::DISCONNECTED;
+}
+
+void
+AsyncConnection::Fail(std::exception_ptr e) noexcept
+{
+	const bool was_ready = state == State::READY;
+
+	DetachSocket();
+	Connection::Disconnect();
+	state = State::WAITING;
+
+	reconnect_timer.Schedule(reconnect_delay);
+	reconnect_delay = std::min(reconnect_delay * 2, MAX_RECONNECT_DELAY);
+
+	handler.OnError(std::move(e));
+
+	if (result_handler != nullptr)
+		std::exchange(result_handler, nullptr)->OnResultError();
+
+	if (was_ready)
+		handler.OnDisconnect();
+}
+
+void
+AsyncConnection::ScheduleSocket()
+{
+	socket_event.Schedule(Flush()
+			      ? SocketEvent::READ
+			      : SocketEvent::READ|SocketEvent::WRITE);
+}
+
+inline void
+AsyncConnection::PollConnect()
+{
+	assert(state == State::CONNECTING);
+
+	/* libpq may close the socket and open a new one (e.g. to try
+	   the next host address), so unregister it now and register
+	   the current one afterwards */
+	socket_event.ReleaseSocket();
+
+	switch (Connection::PollConnect()) {
+	case PGRES_POLLING_FAILED:
+		throw std::runtime_error(GetErrorMessage());
+
+	case PGRES_POLLING_READING:
+		socket_event.Open(SocketDescriptor{GetSocket()});
+		socket_event.ScheduleRead();
+		break;
+
+	case PGRES_POLLING_WRITING:
+		socket_event.Open(SocketDescriptor{GetSocket()});
+		socket_event.ScheduleWrite();
+		break;
+
+	case PGRES_POLLING_OK:
+		SetNonBlocking();
+		socket_event.Open(SocketDescriptor{GetSocket()});
+		socket_event.ScheduleRead();
+
+		state = State::READY;
+		reconnect_delay = INITIAL_RECONNECT_DELAY;
+		handler.OnConnect();
+		break;
+
+	case PGRES_POLLING_ACTIVE:
+		/* obsolete, never returned by libpq */
+		socket_event.Open(SocketDescriptor{GetSocket()});
+		socket_event.ScheduleWrite();
+		break;
+	}
+}
+
+inline void
+AsyncConnection::PollResults()
+{
+	while (result_handler != nullptr && !IsBusy()) {
+		auto result = ReceiveResult();
+		if (!result.IsDefined()) {
+			/* the handler may send the next query */
+			std::exchange(result_handler, nullptr)->OnResultEnd();
+			continue;
+		}
+
+		result_handler->OnResult(std::move(result));
+	}
+
+	if (state == State::READY)
+		ScheduleSocket();
+}
+
+inline void
+AsyncConnection::PollNotify() noexcept
+{
+	/* the handler may disconnect */
+	while (state == State::READY) {
+		const auto notify = GetNextNotify();
+		if (!notify)
+			break;
+
+		handler.OnNotify(notify->relname, notify->extra);
+	}
+}
+
+void
+AsyncConnection::OnSocketEvent(unsigned events) noexcept
+try {
+	switch (state) {
+	case State::DISCONNECTED:
+	case State::WAITING:
+		assert(false);
+		break;
+
+	case State::CONNECTING:
+		PollConnect();
+		break;
+
+	case State::READY:
+		if ((events & SocketEvent::WRITE) != 0 && Flush())
+			socket_event.CancelWrite();
+
+		if ((events & (SocketEvent::READ|SocketEvent::HANGUP|SocketEvent::ERROR)) != 0) {
+			ConsumeInput();
+			PollResults();
+			PollNotify();
+		}
+
+		break;
+	}
+} catch (...) {
+	Fail(std::current_exception());
+}
+
+void
+AsyncConnection::OnReconnectTimer() noexcept
+{
+	assert(state == State::WAITING);
+
+	state = State::DISCONNECTED;
+	Connect();
+}
+
+} /* namespace Pg */
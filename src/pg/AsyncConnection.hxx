@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Connection.hxx"
+#include "event/SocketEvent.hxx"
+#include "event/CoarseTimerEvent.hxx"
+
+#include <exception>
+#include <string>
+
+namespace Pg {
+
+class AsyncConnectionHandler {
+public:
+	/**
+	 * The connection has been established (for the first time
+	 * or after a reconnect) and is ready for queries.
+	 */
+	virtual void OnConnect() noexcept = 0;
+
+	/**
+	 * The connection has failed.  A reconnect has been
+	 * scheduled.
+	 */
+	virtual void OnDisconnect() noexcept {}
+
+	/**
+	 * An asynchronous notification has been received (see
+	 * LISTEN and NOTIFY).
+	 *
+	 * @param name the name of the channel
+	 * @param payload the payload string (may be empty)
+	 */
+	virtual void OnNotify([[maybe_unused]] const char *name,
+			      [[maybe_unused]] const char *payload) noexcept {}
+
+	/**
+	 * An error has occurred; this is called before
+	 * OnDisconnect() and also when a connect attempt fails.
+	 */
+	virtual void OnError(std::exception_ptr e) noexcept = 0;
+};
+
+class AsyncResultHandler {
+public:
+	/**
+	 * A result has been received.  Exceptions thrown by this
+	 * method are treated as connection failures.
+	 */
+	virtual void OnResult(Result &&result) = 0;
+
+	/**
+	 * All results of the query have been received.  The
+	 * connection is idle again, and this method may send the
+	 * next query.
+	 */
+	virtual void OnResultEnd() noexcept = 0;
+
+	/**
+	 * The connection has failed before all results were
+	 * received.
+	 */
+	virtual void OnResultError() noexcept {
+		OnResultEnd();
+	}
+};
+
+/**
+ * A PostgreSQL connection which is integrated into an #EventLoop.
+ * It never blocks: connecting, sending and receiving are driven by
+ * a #SocketEvent on the libpq socket, and results are delivered to
+ * an #AsyncResultHandler.
+ *
+ * After a connection failure, it reconnects automatically; the
+ * delay between attempts doubles after each failure, up to a limit,
+ * and is reset after a connection has been established.
+ */
+class AsyncConnection : public Connection {
+	const std::string conninfo;
+
+	AsyncConnectionHandler &handler;
+
+	/**
+	 * The handler of the query in progress, or nullptr if the
+	 * connection is idle.
+	 */
+	AsyncResultHandler *result_handler = nullptr;
+
+	enum class State {
+		/**
+		 * Connect() has not been called yet, or
+		 * Disconnect() has been called.
+		 */
+		DISCONNECTED,
+
+		/**
+		 * Waiting for #reconnect_timer.
+		 */
+		WAITING,
+
+		CONNECTING,
+
+		READY,
+	} state = State::DISCONNECTED;
+
+	/**
+	 * Watches the libpq socket.  It does not own the socket.
+	 */
+	SocketEvent socket_event;
+
+	CoarseTimerEvent reconnect_timer;
+
+	/**
+	 * The delay before the next reconnect attempt.
+	 */
+	Event::Duration reconnect_delay;
+
+public:
+	AsyncConnection(EventLoop &event_loop, const char *_conninfo,
+			AsyncConnectionHandler &_handler) noexcept;
+	~AsyncConnection() noexcept;
+
+	auto &GetEventLoop() const noexcept {
+		return socket_event.GetEventLoop();
+	}
+
+	/**
+	 * Is the connection established?
+	 */
+	bool IsReady() const noexcept {
+		return state == State::READY;
+	}
+
+	/**
+	 * Is the connection established and no query in progress?
+	 */
+	bool IsIdle() const noexcept {
+		return IsReady() && result_handler == nullptr;
+	}
+
+	/**
+	 * Begin connecting.  Errors are reported to the
+	 * #AsyncConnectionHandler.
+	 */
+	void Connect() noexcept;
+
+	/**
+	 * Close the connection and cancel the reconnect timer.  A
+	 * query in progress is aborted without notifying its
+	 * handler.
+	 */
+	void Disconnect() noexcept;
+
+	/**
+	 * Treat the connection as failed: close it, notify the
+	 * handlers and schedule a reconnect.  Call this after a
+	 * method of the #Connection base class has thrown.
+	 */
+	void Fail(std::exception_ptr e) noexcept;
+
+	/**
+	 * Send a query; its results will be delivered to the given
+	 * handler.  The connection must be idle.
+	 *
+	 * Throws on error.
+	 */
+	template<typename... Params>
+	void SendQuery(AsyncResultHandler &_handler, const Params&... params) {
+		assert(IsIdle());
+
+		Connection::SendQuery(params...);
+		result_handler = &_handler;
+		ScheduleSocket();
+	}
+
+	/**
+	 * Like SendQuery(), but execute a prepared statement.
+	 *
+	 * Throws on error.
+	 */
+	template<typename... Params>
+	void SendPrepared(AsyncResultHandler &_handler, const Params&... params) {
+		assert(IsIdle());
+
+		Connection::SendPrepared(params...);
+		result_handler = &_handler;
+		ScheduleSocket();
+	}
+
+	/**
+	 * Flush libpq's output buffer and wait for the socket to
+	 * become readable, and also writable if some data remains.
+	 * Call this after queuing data (e.g. with PutCopyData())
+	 * outside of AsyncResultHandler::OnResult().
+	 *
+	 * Throws on error.
+	 */
+	void ScheduleSocket();
+
+private:
+	/**
+	 * Unregister the libpq socket from #socket_event.  libpq may
+	 * have closed it already.
+	 */
+	void DetachSocket() noexcept;
+
+	void StartConnect();
+	void PollConnect();
+	void PollResults();
+	void PollNotify() noexcept;
+
+	void OnSocketEvent(unsigned events) noexcept;
+	void OnReconnectTimer() noexcept;
+};
+
+} /* namespace Pg */
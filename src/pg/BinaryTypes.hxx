@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "BinaryValue.hxx"
+#include "util/ByteOrder.hxx"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/*
+ * Encoders for the binary representation of PostgreSQL types.  They
+ * can be passed as query parameters (see #ParamWrapper) and are used
+ * by #CopyWriter.
+ */
+
+namespace Pg {
+
+/**
+ * An "integer" (int4) value.
+ */
+class BinaryInt4 {
+	/**
+	 * The value in big-endian byte order.
+	 */
+	uint32_t value;
+
+public:
+	explicit constexpr BinaryInt4(int_least32_t _value) noexcept
+		:value(ToBE32(_value)) {}
+
+	operator BinaryValue() const noexcept {
+		return {&value, sizeof(value)};
+	}
+};
+
+/**
+ * A "bigint" (int8) value.
+ */
+class BinaryInt8 {
+	/**
+	 * The value in big-endian byte order.
+	 */
+	uint64_t value;
+
+public:
+	explicit constexpr BinaryInt8(int_least64_t _value) noexcept
+		:value(ToBE64(_value)) {}
+
+	operator BinaryValue() const noexcept {
+		return {&value, sizeof(value)};
+	}
+};
+
+/**
+ * A "real" (float4) value.
+ */
+class BinaryFloat4 {
+	/**
+	 * The IEEE 754 bits in big-endian byte order.
+	 */
+	uint32_t value;
+
+public:
+	explicit constexpr BinaryFloat4(float _value) noexcept
+		:value(ToBE32(std::bit_cast<uint32_t>(_value))) {}
+
+	operator BinaryValue() const noexcept {
+		return {&value, sizeof(value)};
+	}
+};
+
+/**
+ * A "double precision" (float8) value.
+ */
+class BinaryFloat8 {
+	/**
+	 * The IEEE 754 bits in big-endian byte order.
+	 */
+	uint64_t value;
+
+public:
+	explicit constexpr BinaryFloat8(double _value) noexcept
+		:value(ToBE64(std::bit_cast<uint64_t>(_value))) {}
+
+	operator BinaryValue() const noexcept {
+		return {&value, sizeof(value)};
+	}
+};
+
+/**
+ * A "timestamp" (without time zone) value; the time point is stored
+ * as UTC.
+ */
+class BinaryTimestamp {
+	/**
+	 * The PostgreSQL epoch (2000-01-01T00:00:00Z) relative to the
+	 * Unix epoch.
+	 */
+	static constexpr std::chrono::seconds POSTGRES_EPOCH{946684800};
+
+	/**
+	 * Microseconds since #POSTGRES_EPOCH in big-endian byte
+	 * order.
+	 */
+	uint64_t value;
+
+public:
+	explicit constexpr BinaryTimestamp(std::chrono::system_clock::time_point t) noexcept
+		:value(ToBE64(std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch() - POSTGRES_EPOCH).count())) {}
+
+	operator BinaryValue() const noexcept {
+		return {&value, sizeof(value)};
+	}
+};
+
+/**
+ * An "inet" value describing a host address (without netmask).
+ */
+class BinaryInet {
+	/**
+	 * Address family codes used by the binary "inet" format
+	 * (PGSQL_AF_INET and PGSQL_AF_INET6 in PostgreSQL's
+	 * utils/inet.h).
+	 */
+	static constexpr std::byte PGSQL_AF_INET{2};
+	static constexpr std::byte PGSQL_AF_INET6{3};
+
+	/**
+	 * Family, netmask bits, is_cidr, address length and the
+	 * address.
+	 */
+	std::array<std::byte, 4 + 16> buffer;
+
+	std::size_t size;
+
+public:
+	/**
+	 * @param address the raw IPv4 (4 bytes) or IPv6 (16 bytes)
+	 * address in network byte order
+	 */
+	explicit BinaryInet(std::span<const std::byte> address) noexcept
+		:size(4 + address.size())
+	{
+		assert(address.size() == 4 || address.size() == 16);
+
+		buffer[0] = address.size() == 4 ? PGSQL_AF_INET : PGSQL_AF_INET6;
+		buffer[1] = static_cast<std::byte>(address.size() * 8);
+		buffer[2] = std::byte{0};
+		buffer[3] = static_cast<std::byte>(address.size());
+		std::copy(address.begin(), address.end(), buffer.begin() + 4);
+	}
+
+	operator BinaryValue() const noexcept {
+		return {buffer.data(), size};
+	}
+};
+
+/**
+ * A PostGIS "geometry" point with SRID, encoded as EWKB.
+ */
+class BinaryPoint {
+	struct Packed {
+		/**
+		 * 0 = big-endian (XDR).
+		 */
+		std::byte byte_order;
+
+		/* unaligned, hence the byte arrays */
+		std::array<std::byte, 4> type, srid;
+		std::array<std::byte, 8> x, y;
+	} value;
+
+	static_assert(sizeof(Packed) == 25);
+
+	/**
+	 * The EWKB geometry type flag which says that a SRID follows.
+	 */
+	static constexpr uint32_t EWKB_SRID_FLAG = 0x20000000;
+
+	static constexpr uint32_t WKB_POINT = 1;
+
+public:
+	constexpr BinaryPoint(double x, double y, uint_least32_t srid) noexcept
+		:value{
+			std::byte{0},
+			std::bit_cast<std::array<std::byte, 4>>(ToBE32(WKB_POINT|EWKB_SRID_FLAG)),
+			std::bit_cast<std::array<std::byte, 4>>(ToBE32(srid)),
+			std::bit_cast<std::array<std::byte, 8>>(ToBE64(std::bit_cast<uint64_t>(x))),
+			std::bit_cast<std::array<std::byte, 8>>(ToBE64(std::bit_cast<uint64_t>(y))),
+		} {}
+
+	operator BinaryValue() const noexcept {
+		return {&value, sizeof(value)};
+	}
+};
+
+} /* namespace Pg */
@@ -71,6 +71,61 @@ Connection::SendQueryParams(bool result_binary, const char *query,
 		throw std::runtime_error(GetErrorMessage());
 }
 
+void
+Connection::SendPrepare(const char *stmt_name, const char *query,
+			size_t n_params, const Oid *param_types)
+{
+	assert(IsDefined());
+	assert(stmt_name != nullptr);
+	assert(query != nullptr);
+
+	if (::PQsendPrepare(conn, stmt_name, query, n_params,
+			    param_types) == 0)
+		throw std::runtime_error(GetErrorMessage());
+}
+
+void
+Connection::SendPreparedParams(bool result_binary, const char *stmt_name,
+			       size_t n_params, const char *const*values,
+			       const int *lengths, const int *formats)
+{
+	assert(IsDefined());
+	assert(stmt_name != nullptr);
+
+	if (::PQsendQueryPrepared(conn, stmt_name, n_params,
+				  values, lengths, formats,
+				  result_binary) == 0)
+		throw std::runtime_error(GetErrorMessage());
+}
+
+Result
+Connection::ReceivePipelineResult()
+{
+	assert(IsDefined());
+	assert(IsPipelineMode());
+
+	auto result = ReceiveResult();
+	if (!result.IsDefined())
+		throw std::runtime_error(GetErrorMessage());
+
+	switch (result.GetStatus()) {
+	case PGRES_PIPELINE_SYNC:
+		/* a synchronization point is not followed by a
+		   nullptr result */
+		return result;
+
+	case PGRES_PIPELINE_ABORTED:
+		ReceiveResult();
+		throw std::runtime_error("Query skipped due to an earlier error in the pipeline");
+
+	default:
+		/* consume the nullptr which terminates the results of
+		   this query */
+		ReceiveResult();
+		return CheckError(std::move(result));
+	}
+}
+
 std::string
 Connection::Escape(const std::string_view src) const noexcept
 {
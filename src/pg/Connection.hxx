@@ -15,6 +15,7 @@
 #include <concepts>
 #include <new>
 #include <memory>
+#include <span>
 #include <string>
 #include <cassert>
 #include <stdexcept>
@@ -142,10 +143,112 @@ public:
 		return ::PQresetPoll(conn);
 	}
 
-	void ConsumeInput() noexcept {
+	/**
+	 * Throws on error.
+	 */
+	void ConsumeInput() {
+		assert(IsDefined());
+
+		if (::PQconsumeInput(conn) == 0)
+			throw std::runtime_error(GetErrorMessage());
+	}
+
+	/**
+	 * Enable or disable non-blocking mode.  In non-blocking mode,
+	 * the SendQuery*() methods do not wait until all data has
+	 * been written to the socket; the caller must invoke Flush()
+	 * until it returns true.
+	 *
+	 * Throws on error.
+	 */
+	void SetNonBlocking(bool value=true) {
+		assert(IsDefined());
+
+		if (::PQsetnonblocking(conn, value) != 0)
+			throw std::runtime_error(GetErrorMessage());
+	}
+
+	[[gnu::pure]]
+	bool IsNonBlocking() const noexcept {
 		assert(IsDefined());
 
-		::PQconsumeInput(conn);
+		return ::PQisnonblocking(conn) != 0;
+	}
+
+	/**
+	 * Attempt to write queued output data to the socket.
+	 *
+	 * Throws on error.
+	 *
+	 * @return true if all data has been sent, false if some data
+	 * remains in the output buffer (wait until the socket becomes
+	 * writable and call this method again)
+	 */
+	bool Flush() {
+		assert(IsDefined());
+
+		switch (::PQflush(conn)) {
+		case 0:
+			return true;
+
+		case 1:
+			return false;
+
+		default:
+			throw std::runtime_error(GetErrorMessage());
+		}
+	}
+
+	/**
+	 * Send data to the server during COPY FROM STDIN.
+	 *
+	 * Throws on error.
+	 *
+	 * @return true if the data has been queued, false if it was
+	 * not queued because the output buffer is full (only in
+	 * non-blocking mode; wait until the socket becomes writable
+	 * and try again)
+	 */
+	bool PutCopyData(std::span<const std::byte> src) {
+		assert(IsDefined());
+
+		switch (::PQputCopyData(conn, (const char *)src.data(),
+					src.size())) {
+		case 1:
+			return true;
+
+		case 0:
+			return false;
+
+		default:
+			throw std::runtime_error(GetErrorMessage());
+		}
+	}
+
+	/**
+	 * Finish COPY FROM STDIN.  After this, call ReceiveResult()
+	 * to obtain the result of the COPY command.
+	 *
+	 * Throws on error.
+	 *
+	 * @param error_message if not nullptr, then the COPY is
+	 * forced to fail with this error message
+	 * @return true if the termination message has been queued,
+	 * false if the output buffer is full (see PutCopyData())
+	 */
+	bool PutCopyEnd(const char *error_message=nullptr) {
+		assert(IsDefined());
+
+		switch (::PQputCopyEnd(conn, error_message)) {
+		case 1:
+			return true;
+
+		case 0:
+			return false;
+
+		default:
+			throw std::runtime_error(GetErrorMessage());
+		}
 	}
 
 	Notify GetNextNotify() noexcept {
@@ -323,6 +426,134 @@ public:
 		return ExecutePrepared(false, stmt_name, params...);
 	}
 
+	/**
+	 * Send a request to prepare a statement, but don't wait for
+	 * the result.
+	 *
+	 * Throws on error.
+	 */
+	void SendPrepare(const char *stmt_name, const char *query,
+			 size_t n_params = 0, const Oid *param_types = nullptr);
+
+	/**
+	 * Send a request to execute a prepared statement, but don't
+	 * wait for the result.  In pipeline mode, this can be called
+	 * many times in a row.
+	 *
+	 * Throws on error.
+	 */
+	void SendPreparedParams(bool result_binary, const char *stmt_name,
+				size_t n_params, const char *const*values,
+				const int *lengths, const int *formats);
+
+	template<ParamArray A>
+	void SendPrepared(bool result_binary, const char *stmt_name,
+			  const A &params) {
+		SendPreparedParams(result_binary, stmt_name, params.size(),
+				   params.GetValues(), params.GetLengths(),
+				   params.GetFormats());
+	}
+
+	template<typename... Params>
+	void SendPrepared(bool result_binary,
+			  const char *stmt_name, const Params&... _params) {
+		assert(IsDefined());
+		assert(stmt_name != nullptr);
+
+		const AutoParamArray<Params...> params(_params...);
+		SendPrepared(result_binary, stmt_name, params);
+	}
+
+	template<typename... Params>
+	void SendPrepared(const char *stmt_name, const Params&... params) {
+		SendPrepared(false, stmt_name, params...);
+	}
+
+	[[gnu::pure]]
+	PGpipelineStatus GetPipelineStatus() const noexcept {
+		assert(IsDefined());
+
+		return ::PQpipelineStatus(conn);
+	}
+
+	[[gnu::pure]]
+	bool IsPipelineMode() const noexcept {
+		return GetPipelineStatus() != PQ_PIPELINE_OFF;
+	}
+
+	/**
+	 * Enter pipeline mode.  After that, queries are sent with the
+	 * Send*() methods without waiting for the previous ones to
+	 * finish; their results are obtained in the same order with
+	 * ReceivePipelineResult().  This saves one round-trip per
+	 * query.
+	 *
+	 * This is only possible while the connection is idle.
+	 *
+	 * Throws on error.
+	 */
+	void EnterPipelineMode() {
+		assert(IsDefined());
+
+		if (::PQenterPipelineMode(conn) == 0)
+			throw std::runtime_error(GetErrorMessage());
+	}
+
+	/**
+	 * Leave pipeline mode.  All results must have been received
+	 * before.
+	 *
+	 * Throws on error.
+	 */
+	void ExitPipelineMode() {
+		assert(IsDefined());
+
+		if (::PQexitPipelineMode(conn) == 0)
+			throw std::runtime_error(GetErrorMessage());
+	}
+
+	/**
+	 * Mark a synchronization point in the pipeline and flush
+	 * the output buffer.  If a query fails, all following
+	 * queries up to the next synchronization point are skipped
+	 * (#PGRES_PIPELINE_ABORTED), and each synchronization point
+	 * produces a #PGRES_PIPELINE_SYNC result.
+	 *
+	 * Throws on error.
+	 */
+	void PipelineSync() {
+		assert(IsDefined());
+
+		if (::PQpipelineSync(conn) == 0)
+			throw std::runtime_error(GetErrorMessage());
+	}
+
+	/**
+	 * Ask the server to flush its output buffer, so the results
+	 * of the queries sent so far arrive without waiting for the
+	 * next PipelineSync().
+	 *
+	 * Throws on error.
+	 */
+	void SendFlushRequest() {
+		assert(IsDefined());
+
+		if (::PQsendFlushRequest(conn) == 0)
+			throw std::runtime_error(GetErrorMessage());
+	}
+
+	/**
+	 * Wait for the result of the next query in the pipeline (in
+	 * the order in which they were sent).  Each call to
+	 * PipelineSync() produces one #PGRES_PIPELINE_SYNC result,
+	 * which is returned by this method as well.
+	 *
+	 * Throws #Error if the query has failed, and
+	 * std::runtime_error if it was skipped due to an earlier
+	 * error or if the connection has failed.
+	 */
+	Result ReceivePipelineResult();
+
 	/**
 	 * Wrapper for "SET ROLE ...".
 	 *
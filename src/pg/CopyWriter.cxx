@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "CopyWriter.hxx"
+
+namespace Pg {
+
+/**
+ * The signature at the beginning of each binary COPY stream.
+ */
+static constexpr std::byte copy_signature[] = {
+	std::byte{'P'}, std::byte{'G'}, std::byte{'C'}, std::byte{'O'},
+	std::byte{'P'}, std::byte{'Y'}, std::byte{'\n'}, std::byte{0xff},
+	std::byte{'\r'}, std::byte{'\n'}, std::byte{0},
+};
+
+void
+CopyWriter::Clear() noexcept
+{
+	buffer.clear();
+
+	Append(copy_signature);
+
+	/* flags */
+	AppendBE32(0);
+
+	/* header extension length */
+	AppendBE32(0);
+}
+
+} /* namespace Pg */
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "BinaryTypes.hxx"
+#include "util/ByteOrder.hxx"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Pg {
+
+/**
+ * Encodes rows in the PostgreSQL binary COPY format ("PGCOPY"), to
+ * be sent with Connection::PutCopyData() after "COPY ... FROM STDIN
+ * (FORMAT binary)".  The buffer is reused after Clear(), so
+ * encoding batches of similar size does not allocate memory.
+ *
+ * For each row, call BeginRow() and then one Append*() method per
+ * column.  Call Finish() after the last row.
+ */
+class CopyWriter {
+	std::vector<std::byte> buffer;
+
+public:
+	CopyWriter() noexcept {
+		Clear();
+	}
+
+	/**
+	 * Discard all rows and start a new stream (beginning with
+	 * the file header).
+	 */
+	void Clear() noexcept;
+
+	/**
+	 * Begin a new row with the given number of columns.
+	 */
+	void BeginRow(uint_least16_t n_columns) noexcept {
+		AppendBE16(n_columns);
+	}
+
+	void AppendNull() noexcept {
+		AppendBE32(uint32_t(-1));
+	}
+
+	/**
+	 * Append a value in its binary representation, e.g. one of
+	 * the encoders from BinaryTypes.hxx.
+	 */
+	void AppendBinary(BinaryValue value) noexcept {
+		AppendBE32(value.size());
+		Append(value);
+	}
+
+	void AppendInt2(int_least16_t value) noexcept {
+		AppendBE32(sizeof(int16_t));
+		AppendBE16(value);
+	}
+
+	void AppendInt4(int_least32_t value) noexcept {
+		AppendBinary(BinaryInt4{value});
+	}
+
+	void AppendInt8(int_least64_t value) noexcept {
+		AppendBinary(BinaryInt8{value});
+	}
+
+	void AppendFloat4(float value) noexcept {
+		AppendBinary(BinaryFloat4{value});
+	}
+
+	void AppendFloat8(double value) noexcept {
+		AppendBinary(BinaryFloat8{value});
+	}
+
+	/**
+	 * Append a "timestamp" (without time zone) value.  The time
+	 * point is stored as UTC.
+	 */
+	void AppendTimestamp(std::chrono::system_clock::time_point value) noexcept {
+		AppendBinary(BinaryTimestamp{value});
+	}
+
+	/**
+	 * Append an "inet" value (a host address, without netmask).
+	 *
+	 * @param address the raw IPv4 (4 bytes) or IPv6 (16 bytes)
+	 * address in network byte order
+	 */
+	void AppendInet(std::span<const std::byte> address) noexcept {
+		AppendBinary(BinaryInet{address});
+	}
+
+	/**
+	 * Append a PostGIS "geometry" point as EWKB.
+	 */
+	void AppendPoint(double x, double y, uint_least32_t srid) noexcept {
+		AppendBinary(BinaryPoint{x, y, srid});
+	}
+
+	/**
+	 * Append the file trailer and return the whole buffer.  After
+	 * this, only Clear() may be called.
+	 */
+	std::span<const std::byte> Finish() noexcept {
+		AppendBE16(uint16_t(-1));
+		return buffer;
+	}
+
+private:
+	void Append(std::span<const std::byte> src) noexcept {
+		buffer.insert(buffer.end(), src.begin(), src.end());
+	}
+
+	void AppendBE16(uint16_t value) noexcept {
+		value = ToBE16(value);
+		Append(std::as_bytes(std::span{&value, 1}));
+	}
+
+	void AppendBE32(uint32_t value) noexcept {
+		value = ToBE32(value);
+		Append(std::as_bytes(std::span{&value, 1}));
+	}
+};
+
+} /* namespace Pg */
@@ -6,6 +6,7 @@
 
 #include "Serial.hxx"
 #include "BinaryValue.hxx"
+#include "BinaryTypes.hxx"
 #include "Array.hxx"
 
 #include <fmt/format.h>
@@ -122,6 +123,17 @@ struct ParamWrapper<BinaryValue> {
 	}
 };
 
+/**
+ * Specialization for the binary encoders from BinaryTypes.hxx (and
+ * other types which can be converted to #BinaryValue).
+ */
+template<typename T>
+requires std::convertible_to<T, BinaryValue> && (!std::same_as<T, BinaryValue>)
+struct ParamWrapper<T> : ParamWrapper<BinaryValue> {
+	ParamWrapper(const T &_value) noexcept
+		:ParamWrapper<BinaryValue>(_value) {}
+};
+
 template<>
 struct ParamWrapper<const char *> {
 	const char *value;
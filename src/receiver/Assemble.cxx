@@ -11,17 +11,21 @@
 namespace Beacon::Protocol {
 
 AckPacket
-MakeAck(uint64_t key, uint16_t id, uint32_t flags) noexcept
+MakeAck(uint64_t key, uint16_t id, uint32_t flags,
+        uint16_t interval) noexcept
 {
   assert(key != 0);
 
+  if (interval != 0)
+    flags |= AckPacket::FLAG_INTERVAL;
+
   AckPacket packet;
   packet.header.magic = ToBE32(MAGIC);
   packet.header.crc = 0;
   packet.header.type = ToBE16(uint16_t(ResponseType::ACK));
   packet.header.key = ToBE64(key);
   packet.id = ToBE16(id);
-  packet.reserved = 0;
+  packet.interval = ToBE16(interval);
   packet.flags = ToBE32(flags);
 
   packet.header.crc = ToBE16(UpdateCRC16CCITT(&packet, sizeof(packet), 0));
@@ -9,8 +9,13 @@ namespace Beacon::Protocol {
 
 struct AckPacket;
 
+/**
+ * @param interval the recommended fix interval in seconds; if
+ * non-zero, #AckPacket::FLAG_INTERVAL is set
+ */
 [[gnu::const]]
 AckPacket
-MakeAck(uint64_t key, uint16_t id, uint32_t flags) noexcept;
+MakeAck(uint64_t key, uint16_t id, uint32_t flags,
+	uint16_t interval=0) noexcept;
 
 } /* namespace Beacon::Protocol */
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "CommandLine.hxx"
+#include "FixFilter.hxx"
+#include "FloodFilter.hxx"
+#include "event/config.h" // for HAVE_URING
+#include "lib/fmt/RuntimeError.hxx"
+#include "util/NumberParser.hxx"
+
+#include <fmt/core.h>
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace Beacon {
+
+template<typename T>
+static T
+ParsePositive(const char *name, const char *s)
+{
+	T value;
+	if (!ParseIntegerTo(s, value) || value <= 0)
+		throw FmtRuntimeError("Invalid {}: '{}'", name, s);
+
+	return value;
+}
+
+[[noreturn]]
+static void
+Usage(const char *argv0, int status) noexcept
+{
+	fmt::print(status == EXIT_SUCCESS ? stdout : stderr,
+		   "Usage: {} [OPTIONS]\n"
+		   "\n"
+		   "Options:\n"
+		   "  -d, --database=CONNINFO  PostgreSQL connection string (default: dbname=beacon)\n"
+		   "  -j, --journal=DIR        keep queued fixes in journal files in this directory\n"
+		   "  -t, --threads=N          number of worker threads (default: number of CPUs)\n"
+		   "  -b, --batch=N            maximum number of datagrams per recvmmsg() call\n"
+		   "  -i, --insert-batch=N     maximum number of fixes per INSERT\n"
+		   "  -q, --max-queue=N        maximum number of fixes queued per thread\n"
+		   "  -m, --ingest-memory=MB   memory for the newest fix per key while the\n"
+		   "                           queue is full, all threads (default: 4)\n"
+		   "  -u, --io-uring           receive datagrams using io_uring\n"
+		   "  -k, --max-keys=N         number of client keys tracked by the fix filter,\n"
+		   "                           all threads (default: 786432)\n"
+		   "  -r, --rate=N             maximum number of fixes per second and key (default: 2)\n"
+		   "  -B, --burst=N            maximum burst of fixes per key (default: 10)\n"
+		   "  -a, --address-rate=N     maximum datagrams per second from one address\n"
+		   "                           or IPv6 /64 prefix, per thread (default: 1000)\n"
+		   "  -K, --check-keys         accept only keys listed in the \"keys\" table\n"
+		   "  -S, --max-skew=SECONDS   maximum time client clocks may be ahead (default: 30)\n"
+		   "  -A, --max-age=SECONDS    maximum age of client-timestamped fixes (default: 86400)\n"
+		   "  -M, --metrics=ADDRESS    serve Prometheus metrics on a local socket\n"
+		   "                           (/PATH or @ABSTRACT) or on HOST:PORT\n"
+		   "  -l, --listen=ADDRESS     receive on this address (may be repeated;\n"
+		   "                           default: all IPv6 and IPv4 addresses)\n"
+		   "  -H, --handover=PATH      take over from a running process and allow\n"
+		   "                           the next one to take over via this local socket\n"
+		   "  -p, --profile            measure event loop busy/wait time, slow callbacks\n"
+		   "                           and timer delays\n"
+		   "  -h, --help               show this help\n",
+		   argv0);
+	exit(status);
+}
+
+void
+ParseCommandLine(ReceiverConfig &config, int argc, char **argv)
+{
+	static constexpr struct option long_options[] = {
+		{"database", required_argument, nullptr, 'd'},
+		{"journal", required_argument, nullptr, 'j'},
+		{"threads", required_argument, nullptr, 't'},
+		{"batch", required_argument, nullptr, 'b'},
+		{"insert-batch", required_argument, nullptr, 'i'},
+		{"max-queue", required_argument, nullptr, 'q'},
+		{"ingest-memory", required_argument, nullptr, 'm'},
+		{"io-uring", no_argument, nullptr, 'u'},
+		{"max-keys", required_argument, nullptr, 'k'},
+		{"rate", required_argument, nullptr, 'r'},
+		{"burst", required_argument, nullptr, 'B'},
+		{"address-rate", required_argument, nullptr, 'a'},
+		{"check-keys", no_argument, nullptr, 'K'},
+		{"max-skew", required_argument, nullptr, 'S'},
+		{"max-age", required_argument, nullptr, 'A'},
+		{"metrics", required_argument, nullptr, 'M'},
+		{"profile", no_argument, nullptr, 'p'},
+		{"listen", required_argument, nullptr, 'l'},
+		{"handover", required_argument, nullptr, 'H'},
+		{"help", no_argument, nullptr, 'h'},
+		{},
+	};
+
+	int o;
+	while ((o = getopt_long(argc, argv, "d:j:t:b:i:q:m:uk:r:B:a:KS:A:M:pl:H:h",
+				long_options, nullptr)) != -1) {
+		switch (o) {
+		case 'd':
+			config.database = optarg;
+			break;
+
+		case 'j':
+			config.journal_directory = optarg;
+			break;
+
+		case 't':
+			config.n_threads = ParsePositive<unsigned>("thread count", optarg);
+			break;
+
+		case 'b':
+			config.batch_size = ParsePositive<std::size_t>("batch size", optarg);
+			break;
+
+		case 'i':
+			config.insert_batch_size = ParsePositive<std::size_t>("insert batch size", optarg);
+			break;
+
+		case 'q':
+			config.max_queued_fixes = ParsePositive<std::size_t>("queue size", optarg);
+			break;
+
+		case 'm':
+			config.max_ingest_memory = ParsePositive<std::size_t>("ingest memory", optarg);
+			if (config.max_ingest_memory > SIZE_MAX / (1024 * 1024))
+				throw FmtRuntimeError("Invalid ingest memory: '{}'", optarg);
+
+			config.max_ingest_memory *= 1024 * 1024;
+			break;
+
+		case 'u':
+#ifdef HAVE_URING
+			config.io_uring = true;
+			break;
+#else
+			throw std::runtime_error("io_uring support is disabled at compile time");
+#endif
+
+		case 'k':
+			config.max_keys = ParsePositive<std::size_t>("key count", optarg);
+			break;
+
+		case 'r':
+			config.fix_rate = ParsePositive<unsigned>("fix rate", optarg);
+			if (config.fix_rate > FixFilter::MAX_RATE)
+				throw FmtRuntimeError("Fix rate too large (maximum {})",
+						      FixFilter::MAX_RATE);
+			break;
+
+		case 'B':
+			config.fix_burst = ParsePositive<unsigned>("burst size", optarg);
+			if (config.fix_burst > FixFilter::MAX_BURST)
+				throw FmtRuntimeError("Burst size too large (maximum {})",
+						      FixFilter::MAX_BURST);
+			break;
+
+		case 'a':
+			config.max_address_rate = ParsePositive<unsigned>("address rate", optarg);
+			if (config.max_address_rate > FloodFilter::MAX_LIMIT)
+				throw FmtRuntimeError("Address rate too large (maximum {})",
+						      FloodFilter::MAX_LIMIT);
+			break;
+
+		case 'K':
+			config.check_keys = true;
+			break;
+
+		case 'S':
+			config.clock_window.max_skew =
+				std::chrono::seconds{ParsePositive<unsigned>("clock skew", optarg)};
+			break;
+
+		case 'A':
+			config.clock_window.max_age =
+				std::chrono::seconds{ParsePositive<unsigned>("fix age", optarg)};
+			break;
+
+		case 'M':
+			config.metrics_address = optarg;
+			break;
+
+		case 'p':
+			config.profile_loops = true;
+			break;
+
+		case 'l':
+			config.listen_addresses.push_back(optarg);
+			break;
+
+		case 'H':
+			config.handover_path = optarg;
+			break;
+
+		case 'h':
+			Usage(argv[0], EXIT_SUCCESS);
+
+		default:
+			Usage(argv[0], EXIT_FAILURE);
+		}
+	}
+
+	if (optind < argc)
+		throw FmtRuntimeError("Unexpected argument: '{}'", argv[optind]);
+
+	if (config.max_queued_fixes < config.insert_batch_size)
+		throw std::runtime_error("The queue size must not be smaller than the insert batch size");
+
+	if (config.n_threads == 0) {
+		const long n = sysconf(_SC_NPROCESSORS_ONLN);
+		config.n_threads = n > 0 ? unsigned(n) : 1;
+	}
+}
+
+} /* namespace Beacon */
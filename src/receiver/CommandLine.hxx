@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "Receiver.hxx"
+
+#include <cstddef>
+#include <vector>
+
+namespace Beacon {
+
+struct ReceiverConfig {
+	/**
+	 * The libpq connection string.
+	 */
+	const char *database = "dbname=beacon";
+
+	/**
+	 * The directory containing the journal files (one per
+	 * worker).  nullptr means fixes are queued only in memory.
+	 */
+	const char *journal_directory = nullptr;
+
+	/**
+	 * The number of worker threads, each with its own
+	 * #EventLoop, socket and database connection.  0 means one
+	 * per online CPU.
+	 */
+	unsigned n_threads = 0;
+
+	/**
+	 * The maximum number of datagrams received with one system
+	 * call.
+	 */
+	std::size_t batch_size = Receiver::DEFAULT_BATCH_SIZE;
+
+	/**
+	 * The maximum number of fixes written with one INSERT.
+	 */
+	std::size_t insert_batch_size = 256;
+
+	/**
+	 * The maximum number of fixes queued per worker while
+	 * waiting for the database.  This is the capacity of new
+	 * journal files.
+	 */
+	std::size_t max_queued_fixes = 16384;
+
+	/**
+	 * The memory ceiling (in bytes) of the ingest queues of all
+	 * workers together.  These hold the newest fix per key while
+	 * the journal is full.
+	 */
+	std::size_t max_ingest_memory = 4 * 1024 * 1024;
+
+	/**
+	 * Receive datagrams using io_uring instead of epoll and
+	 * recvmmsg()?
+	 */
+	bool io_uring = false;
+
+	/**
+	 * The number of client keys which determines the memory of
+	 * the #FixFilter instances (total of all workers).  Each key
+	 * needs 16 bytes plus 33% headroom, rounded up to the next
+	 * power of two: the default is the largest value which needs
+	 * 16 MiB.  Each worker rounds its share down to a power of
+	 * two, so with a thread count which is not a power of two,
+	 * the memory and the number of keys actually tracked are
+	 * smaller.  Fixes of keys which do not fit are accepted
+	 * without filtering.
+	 */
+	std::size_t max_keys = 768 * 1024;
+
+	/**
+	 * The permitted long-term number of fixes per second and
+	 * client key.
+	 */
+	unsigned fix_rate = 2;
+
+	/**
+	 * The number of fixes a client key may send in a burst
+	 * exceeding #fix_rate.
+	 */
+	unsigned fix_burst = 10;
+
+	/**
+	 * The maximum number of datagrams per second and worker
+	 * accepted from one source address (IPv6: one /64 prefix).
+	 * This is generous because many clients may share one
+	 * address behind a (carrier-grade) NAT.
+	 */
+	unsigned max_address_rate = 1000;
+
+	/**
+	 * Accept only keys listed in the "keys" table (see
+	 * #KeyDatabase)?
+	 */
+	bool check_keys = false;
+
+	/**
+	 * The accepted range of client-supplied fix times.
+	 */
+	ClockWindow clock_window;
+
+	/**
+	 * Serve metrics in the Prometheus text format on this
+	 * address (see MetricsServer::CreateSocket()).  nullptr
+	 * disables the metrics server.
+	 */
+	const char *metrics_address = nullptr;
+
+	/**
+	 * Measure how the worker event loops spend their time (see
+	 * #LoopProfiler)?
+	 */
+	bool profile_loops = false;
+
+	/**
+	 * The addresses to receive datagrams on ("HOST[:PORT]").  If
+	 * empty, then the IPv6 wildcard address (dual-stack) is
+	 * used.  Ignored if sockets are passed by systemd or by the
+	 * old process (see #handover_path).
+	 */
+	std::vector<const char *> listen_addresses;
+
+	/**
+	 * The path of a local socket where a new process can take
+	 * over the receiver sockets and the queued fixes (see
+	 * Handover.hxx), and where this process tries to take over
+	 * from a running one.  nullptr disables the handover.
+	 */
+	const char *handover_path = nullptr;
+};
+
+/**
+ * Parse the command line into the given #ReceiverConfig.
+ *
+ * Throws on error.
+ */
+void
+ParseCommandLine(ReceiverConfig &config, int argc, char **argv);
+
+} /* namespace Beacon */
@@ -2,56 +2,219 @@
 // Copyright Max Kellermann <max.kellermann@gmail.com>
 
 #include "Database.hxx"
-#include "geo/GeoPoint.hxx"
-#include "lib/fmt/Unsafe.hxx"
-#include "net/FormatAddress.hxx"
-#include "net/SocketAddress.hxx"
 
 #include <fmt/format.h>
 
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <stdexcept>
+
 namespace Beacon {
 
-ReceiverDatabase::ReceiverDatabase(const char *conninfo)
-	:db(conninfo)
+/**
+ * The number of columns in each row sent by SendFixes() and
+ * CopyFixes().
+ */
+static constexpr unsigned N_COLUMNS = 7;
+
+ReceiverDatabase::FixRow::FixRow(uint_least64_t _key,
+				 std::chrono::system_clock::time_point _time,
+				 std::span<const std::byte> _address,
+				 const Fix &_fix) noexcept
+	:key(_key), time(_time), fix(_fix),
+	 address_size(_address.size())
+{
+	assert(_address.empty() || _address.size() == 4 || _address.size() == 16);
+
+	std::copy(_address.begin(), _address.end(), address.begin());
+}
+
+/**
+ * The binary parameters of one row.
+ */
+struct ReceiverDatabase::InsertParams::Row {
+	Pg::BinaryInt8 key;
+	Pg::BinaryTimestamp time;
+	std::optional<Pg::BinaryInet> address;
+	std::optional<Pg::BinaryPoint> location;
+	std::optional<Pg::BinaryInt4> direction;
+	std::optional<Pg::BinaryFloat4> speed, altitude;
+
+	explicit Row(const FixRow &src) noexcept
+		/* the "key" column is a signed bigint; store the bit
+		   pattern of the unsigned key */
+		:key(static_cast<int_least64_t>(src.key)),
+		 time(src.time)
+	{
+		if (src.address_size > 0)
+			address.emplace(std::span{src.address}.first(src.address_size));
+
+		const auto &fix = src.fix;
+
+		if (fix.location.IsValid())
+			location.emplace(fix.location.longitude.Degrees(),
+					 fix.location.latitude.Degrees(),
+					 4326);
+
+		if (fix.HasDirection())
+			direction.emplace(fix.direction);
+
+		if (fix.HasSpeed())
+			speed.emplace(fix.GetSpeed());
+
+		if (fix.HasAltitude())
+			altitude.emplace(fix.altitude);
+	}
+};
+
+ReceiverDatabase::InsertParams::InsertParams()
 {
-	Prepare();
+	/* push_back() must not allocate */
+	rows.reserve(MAX_INSERT_ROWS);
+	values.reserve(MAX_INSERT_ROWS * N_COLUMNS);
+	lengths.reserve(MAX_INSERT_ROWS * N_COLUMNS);
+	formats.reserve(MAX_INSERT_ROWS * N_COLUMNS);
 }
 
+ReceiverDatabase::InsertParams::~InsertParams() noexcept = default;
+
 void
-ReceiverDatabase::AutoReconnect()
+ReceiverDatabase::InsertParams::clear() noexcept
 {
-	if (db.GetStatus() == CONNECTION_BAD) {
-		fmt::print(stderr, "Reconnecting to database\n");
-		db.Reconnect();
-		Prepare();
-	}
+	rows.clear();
+	values.clear();
+	lengths.clear();
+	formats.clear();
+}
+
+inline void
+ReceiverDatabase::InsertParams::Add(Pg::BinaryValue value) noexcept
+{
+	assert(values.size() < values.capacity());
+
+	values.push_back(reinterpret_cast<const char *>(value.data()));
+	lengths.push_back(value.size());
+	formats.push_back(1);
+}
+
+template<typename T>
+inline void
+ReceiverDatabase::InsertParams::Add(const std::optional<T> &value) noexcept
+{
+	if (value)
+		Add(*value);
+	else
+		Add({});
+}
+
+inline void
+ReceiverDatabase::InsertParams::push_back(const FixRow &src) noexcept
+{
+	/* the parameter arrays point into #rows, which must not be
+	   reallocated */
+	assert(rows.size() < rows.capacity());
+
+	const auto &row = rows.emplace_back(src);
+
+	Add(row.key);
+	Add(row.time);
+	Add(row.address);
+	Add(row.location);
+	Add(row.direction);
+	Add(row.speed);
+	Add(row.altitude);
 }
 
 void
-ReceiverDatabase::InsertFix(SocketAddress _address, uint_least64_t key, GeoPoint location)
+ReceiverDatabase::SendFixes(Pg::AsyncResultHandler &handler,
+			    std::span<const FixRow> rows)
 {
-	const fmt::format_int key_buffer{key};
-	const char *key_s = key_buffer.c_str();
+	assert(!rows.empty());
+
+	if (rows.size() > MAX_INSERT_ROWS) {
+		db.SendQuery(handler, "COPY fixes(key, time, client_address, location, direction, speed, altitude)"
+			     " FROM STDIN (FORMAT binary)");
+		return;
+	}
 
-	char location_buffer[128];
-	const char *location_s = nullptr;
-	if (location.IsValid())
-		location_s = FmtUnsafeC(location_buffer, "POINT({} {})",
-					location.longitude.Degrees(),
-					location.latitude.Degrees());
+	if (rows.size() != insert_query_rows) {
+		insert_query = "INSERT INTO fixes(key, time, client_address, location, direction, speed, altitude) VALUES";
 
-	char address_buffer[256];
-	const char *address = nullptr;
-	if (HostToString(address_buffer, _address))
-		address = address_buffer;
+		unsigned n = 0;
+		for (std::size_t i = 0; i < rows.size(); ++i) {
+			if (i > 0)
+				insert_query.push_back(',');
 
-	db.ExecutePrepared("insert_fix", key_s, address, location_s);
+			for (unsigned column = 0; column < N_COLUMNS; ++column)
+				fmt::format_to(std::back_inserter(insert_query),
+					       "{}${}",
+					       column == 0 ? '(' : ',', ++n);
+
+			insert_query.push_back(')');
+		}
+
+		insert_query_rows = rows.size();
+	}
+
+	insert_params.clear();
+	for (const auto &i : rows)
+		insert_params.push_back(i);
+
+	db.SendQuery(handler, false, insert_query.c_str(), insert_params);
 }
 
 void
-ReceiverDatabase::Prepare()
+ReceiverDatabase::CopyFixes(std::span<const FixRow> rows)
 {
-	db.Prepare("insert_fix", "INSERT INTO fixes(key, client_address, location) VALUES($1, $2, ST_GeomFromText($3, 4326))", 3);
+	assert(!rows.empty());
+
+	copy_writer.Clear();
+
+	for (const auto &i : rows) {
+		copy_writer.BeginRow(N_COLUMNS);
+
+		/* the "key" column is a signed bigint; store the bit
+		   pattern of the unsigned key */
+		copy_writer.AppendInt8(static_cast<int_least64_t>(i.key));
+
+		copy_writer.AppendTimestamp(i.time);
+
+		if (i.address_size > 0)
+			copy_writer.AppendInet(std::span{i.address}.first(i.address_size));
+		else
+			copy_writer.AppendNull();
+
+		const auto &fix = i.fix;
+
+		if (fix.location.IsValid())
+			copy_writer.AppendPoint(fix.location.longitude.Degrees(),
+						fix.location.latitude.Degrees(),
+						4326);
+		else
+			copy_writer.AppendNull();
+
+		if (fix.HasDirection())
+			copy_writer.AppendInt4(fix.direction);
+		else
+			copy_writer.AppendNull();
+
+		if (fix.HasSpeed())
+			copy_writer.AppendFloat4(fix.GetSpeed());
+		else
+			copy_writer.AppendNull();
+
+		if (fix.HasAltitude())
+			copy_writer.AppendFloat4(fix.altitude);
+		else
+			copy_writer.AppendNull();
+	}
+
+	/* in non-blocking mode, libpq enlarges its output buffer
+	   instead of refusing the data, so "false" can only mean
+	   that something is seriously wrong */
+	if (!db.PutCopyData(copy_writer.Finish()) || !db.PutCopyEnd())
+		throw std::runtime_error("Failed to queue COPY data");
 }
 
 } /* namespace Beacon */
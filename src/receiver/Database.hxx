@@ -3,28 +3,181 @@
 
 #pragma once
 
-#include "pg/Connection.hxx"
+#include "pg/AsyncConnection.hxx"
+#include "pg/CopyWriter.hxx"
+#include "Fix.hxx"
 
+#include <array>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
-
-struct GeoPoint;
-class SocketAddress;
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
 
 namespace Beacon {
 
 class ReceiverDatabase {
-	Pg::Connection db;
+	Pg::AsyncConnection db;
+
+	/**
+	 * Encodes the rows for CopyFixes().  Its buffer is reused to
+	 * avoid allocating memory for each batch.
+	 */
+	Pg::CopyWriter copy_writer;
 
 public:
-	[[nodiscard]]
-	explicit ReceiverDatabase(const char *conninfo);
+	/**
+	 * Batches up to this size are sent as INSERT with binary
+	 * parameters, larger ones with COPY.  COPY is cheaper per row,
+	 * but it needs one more round-trip.
+	 */
+	static constexpr std::size_t MAX_INSERT_ROWS = 16;
+
+	/**
+	 * One row of the "fixes" table.
+	 */
+	struct FixRow {
+		uint_least64_t key;
+
+		std::chrono::system_clock::time_point time;
+
+		/**
+		 * The decoded fix; unknown values are stored as
+		 * NULL.
+		 */
+		Fix fix;
+
+		/**
+		 * The raw client IP address in network byte order.
+		 */
+		std::array<std::byte, 16> address;
 
-	void AutoReconnect();
+		/**
+		 * The number of bytes used in #address (4 or 16); 0
+		 * means NULL.
+		 */
+		uint_least8_t address_size;
 
-	void InsertFix(SocketAddress address, uint_least64_t key, GeoPoint location);
+		/**
+		 * @param address the raw IPv4 or IPv6 address (4 or
+		 * 16 bytes) or an empty span if unknown
+		 */
+		FixRow(uint_least64_t key,
+		       std::chrono::system_clock::time_point time,
+		       std::span<const std::byte> address,
+		       const Fix &fix) noexcept;
+	};
 
 private:
-	void Prepare();
+	/**
+	 * Binary query parameters for small batches which are sent
+	 * as INSERT.  The buffers are reused.
+	 */
+	class InsertParams {
+		struct Row;
+		std::vector<Row> rows;
+
+		std::vector<const char *> values;
+		std::vector<int> lengths, formats;
+
+	public:
+		/**
+		 * Throws on error.
+		 */
+		InsertParams();
+		~InsertParams() noexcept;
+
+		void clear() noexcept;
+		void push_back(const FixRow &row) noexcept;
+
+		/* implement the Pg::ParamArray concept */
+
+		std::size_t size() const noexcept {
+			return values.size();
+		}
+
+		const char *const*GetValues() const noexcept {
+			return values.data();
+		}
+
+		const int *GetLengths() const noexcept {
+			return lengths.data();
+		}
+
+		const int *GetFormats() const noexcept {
+			return formats.data();
+		}
+
+	private:
+		void Add(Pg::BinaryValue value) noexcept;
+
+		/**
+		 * Add the value or NULL.
+		 */
+		template<typename T>
+		void Add(const std::optional<T> &value) noexcept;
+	} insert_params;
+
+	/**
+	 * The INSERT statement for #insert_query_rows rows.
+	 */
+	std::string insert_query;
+	std::size_t insert_query_rows = 0;
+
+public:
+	/**
+	 * The connection is not established until Connect() is
+	 * called.
+	 *
+	 * Throws on error.
+	 */
+	ReceiverDatabase(EventLoop &event_loop, const char *conninfo,
+			 Pg::AsyncConnectionHandler &handler)
+		:db(event_loop, conninfo, handler) {}
+
+	Pg::AsyncConnection &GetConnection() noexcept {
+		return db;
+	}
+
+	/**
+	 * Begin connecting to the database; see
+	 * Pg::AsyncConnection::Connect().
+	 */
+	void Connect() noexcept {
+		db.Connect();
+	}
+
+	/**
+	 * Is the connection ready for SendFixes()?
+	 */
+	bool IsIdle() const noexcept {
+		return db.IsIdle();
+	}
+
+	/**
+	 * Begin inserting the given rows.  Small batches are sent
+	 * as one INSERT; for larger ones, the "COPY fixes FROM STDIN"
+	 * command is sent, and after the server has replied with
+	 * #PGRES_COPY_IN, the handler shall call CopyFixes() with
+	 * the same rows.
+	 *
+	 * Throws on error.
+	 */
+	void SendFixes(Pg::AsyncResultHandler &handler,
+		       std::span<const FixRow> rows);
+
+	/**
+	 * Send all given rows in the binary COPY format and finish
+	 * the COPY.  This is meant to be called from
+	 * Pg::AsyncResultHandler::OnResult(); the connection sends
+	 * the data when the socket becomes writable and delivers the
+	 * result of the COPY to the same handler.
+	 *
+	 * Throws on error.
+	 */
+	void CopyFixes(std::span<const FixRow> rows);
 };
 
 } /* namespace Beacon */
@@ -4,9 +4,13 @@
 #pragma once
 
 #include "Protocol.hxx"
+#include "Fix.hxx"
 #include "geo/GeoPoint.hxx"
 #include "util/ByteOrder.hxx"
 
+#include <algorithm>
+#include <chrono>
+
 namespace Beacon::Protocol {
 
 constexpr Angle
@@ -23,4 +27,32 @@ ExportGeoPoint(::GeoPoint src) noexcept
 		: GeoPoint::MakeInvalid();
 }
 
+/**
+ * Encode a time for #TimedFixPacket::time.
+ */
+constexpr uint64_t
+ExportTime(std::chrono::system_clock::time_point src) noexcept
+{
+	return ToBE64(std::chrono::duration_cast<std::chrono::milliseconds>(src.time_since_epoch()).count());
+}
+
+/**
+ * Encode a #Fix as a #FixBatchItem.
+ *
+ * @param age the time between the fix and sending the packet; it
+ * is clamped to the range of #FixBatchItem::age
+ */
+constexpr FixBatchItem
+ExportFixBatchItem(const Fix &src, std::chrono::seconds age) noexcept
+{
+	return {
+		ExportGeoPoint(src.location),
+		ToBE16(src.direction),
+		ToBE16(src.speed),
+		int16_t(ToBE16(src.altitude)),
+		ToBE16(uint16_t(std::clamp<std::chrono::seconds::rep>(age.count(),
+								      0, 0xffff))),
+	};
+}
+
 } /* namespace Beacon::Protocol */
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "geo/GeoPoint.hxx"
+
+#include <chrono>
+#include <cstdint>
+
+namespace Beacon {
+
+/**
+ * A decoded #Protocol::FixPacket.  Integers are in host byte order,
+ * but they use the units and "unknown" values of the protocol.
+ */
+struct Fix {
+	static constexpr uint16_t UNKNOWN_DIRECTION = 0xffff;
+	static constexpr uint16_t UNKNOWN_SPEED = 0xffff;
+	static constexpr int16_t UNKNOWN_ALTITUDE = 0x7fff;
+
+	/**
+	 * The location; invalid means unknown.
+	 */
+	GeoPoint location;
+
+	/**
+	 * Movement direction in degrees (0..359) or
+	 * #UNKNOWN_DIRECTION.
+	 */
+	uint16_t direction;
+
+	/**
+	 * Speed in m/16s or #UNKNOWN_SPEED.
+	 */
+	uint16_t speed;
+
+	/**
+	 * Altitude in m above MSL or #UNKNOWN_ALTITUDE.
+	 */
+	int16_t altitude;
+
+	constexpr bool HasDirection() const noexcept {
+		return direction != UNKNOWN_DIRECTION;
+	}
+
+	constexpr bool HasSpeed() const noexcept {
+		return speed != UNKNOWN_SPEED;
+	}
+
+	constexpr bool HasAltitude() const noexcept {
+		return altitude != UNKNOWN_ALTITUDE;
+	}
+
+	/**
+	 * Returns the speed in m/s.  Only valid if HasSpeed()
+	 * returns true.
+	 */
+	constexpr float GetSpeed() const noexcept {
+		return speed / 16.f;
+	}
+};
+
+/**
+ * A #Fix and the time it was taken.
+ */
+struct TimedFix {
+	std::chrono::system_clock::time_point time;
+
+	Fix fix;
+};
+
+} /* namespace Beacon */
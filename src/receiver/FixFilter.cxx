@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "FixFilter.hxx"
+#include "Fix.hxx"
+#include "event/Loop.hxx"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <random>
+
+namespace Beacon {
+
+/**
+ * The resolution of #FixFilter::Entry::time.  With 16 bits, the
+ * counter wraps after 4096 seconds, which is much longer than
+ * #IDLE_TIMEOUT.
+ */
+using Tick = std::chrono::duration<int64_t, std::ratio<1, 16>>;
+
+/**
+ * A fix whose fingerprint matches one of the recent fixes of the
+ * same key is only considered a duplicate if it arrives within this
+ * duration after the last accepted one; this way, a stationary
+ * client which keeps sending the same location gets one fix through
+ * per window.
+ */
+static constexpr uint16_t DUPLICATE_WINDOW = Tick{std::chrono::seconds{10}}.count();
+
+/**
+ * Keys which have not sent an accepted fix for this duration are
+ * removed from the table.
+ */
+static constexpr uint16_t IDLE_TIMEOUT = Tick{std::chrono::minutes{5}}.count();
+
+static constexpr Event::Duration EXPIRE_INTERVAL = std::chrono::seconds{1};
+
+/**
+ * Each OnExpireTimer() call examines this fraction of the table, so
+ * a full sweep takes about one minute.
+ */
+static constexpr std::size_t SWEEP_DIVISOR = 60;
+
+/**
+ * One token in the units of #FixFilter::Entry::tokens.
+ */
+static constexpr uint32_t TOKEN = 256;
+
+static constexpr uint64_t
+Mix(uint64_t h) noexcept
+{
+	h *= 0x9e3779b97f4a7c15ULL;
+	return h ^ (h >> 32);
+}
+
+static uint64_t
+Hash(uint64_t h, const Fix &fix) noexcept
+{
+	h = Mix(h ^ std::bit_cast<uint64_t>(fix.location.latitude.Radians()));
+	h = Mix(h ^ std::bit_cast<uint64_t>(fix.location.longitude.Radians()));
+	return Mix(h ^ (uint64_t(fix.direction) |
+			(uint64_t(fix.speed) << 16) |
+			(uint64_t(uint16_t(fix.altitude)) << 32)));
+}
+
+/**
+ * Convert a hash to a (non-zero) 16-bit fingerprint.
+ */
+static constexpr uint16_t
+ToFingerprint(uint64_t h) noexcept
+{
+	const uint16_t fingerprint = h >> 48;
+	return fingerprint != 0 ? fingerprint : 1;
+}
+
+/**
+ * Calculate a fingerprint of all fix attributes.
+ */
+static uint16_t
+Fingerprint(const Fix &fix) noexcept
+{
+	return ToFingerprint(Hash(0, fix));
+}
+
+/**
+ * Calculate a fingerprint of all fixes of a batch.
+ */
+static uint16_t
+Fingerprint(std::span<const TimedFix> fixes) noexcept
+{
+	uint64_t h = fixes.size();
+	for (const auto &i : fixes)
+		h = Hash(h, i.fix);
+	return ToFingerprint(h);
+}
+
+static uint16_t
+GetTick(const EventLoop &event_loop) noexcept
+{
+	const auto t = event_loop.SteadyNow().time_since_epoch();
+	return std::chrono::duration_cast<Tick>(t).count();
+}
+
+static uint64_t
+GenerateSeed()
+{
+	std::random_device rd;
+	return (uint64_t(rd()) << 32) | rd();
+}
+
+/**
+ * Calculate the number of slots which fit into the given amount of
+ * memory.
+ */
+static constexpr std::size_t
+CalcTableSize(std::size_t max_memory, std::size_t entry_size,
+	      std::size_t min_slots) noexcept
+{
+	return std::max(std::bit_floor(max_memory / entry_size), min_slots);
+}
+
+FixFilter::FixFilter(EventLoop &event_loop, std::size_t max_memory,
+		     unsigned rate, unsigned burst)
+	:expire_timer(event_loop, BIND_THIS_METHOD(OnExpireTimer)),
+	 table(new Entry[CalcTableSize(max_memory, sizeof(Entry), MIN_SLOTS)]()),
+	 mask(CalcTableSize(max_memory, sizeof(Entry), MIN_SLOTS) - 1),
+	 /* keep the load factor at or below 75% */
+	 max_entries((mask + 1) / 4 * 3),
+	 seed(GenerateSeed()),
+	 refill_per_tick(rate * TOKEN / (Tick::period::den / Tick::period::num)),
+	 bucket_size(burst * TOKEN)
+{
+	assert(rate > 0);
+	assert(rate <= MAX_RATE);
+	assert(burst > 0);
+	assert(burst <= MAX_BURST);
+}
+
+FixFilter::~FixFilter() noexcept = default;
+
+inline std::size_t
+FixFilter::GetHomeSlot(uint64_t key) const noexcept
+{
+	return Mix(key ^ seed) & mask;
+}
+
+FixFilter::Result
+FixFilter::Check(uint64_t key, const Fix &fix) noexcept
+{
+	if (key == 0)
+		return Result::ACCEPT;
+
+	return Check(key, Fingerprint(fix));
+}
+
+FixFilter::Result
+FixFilter::CheckBatch(uint64_t key, std::span<const TimedFix> fixes) noexcept
+{
+	if (key == 0)
+		return Result::ACCEPT;
+
+	return Check(key, Fingerprint(fixes));
+}
+
+FixFilter::Result
+FixFilter::Check(uint64_t key, uint16_t fingerprint) noexcept
+{
+	assert(key != 0);
+
+	const uint16_t now = GetTick(expire_timer.GetEventLoop());
+
+	for (std::size_t i = GetHomeSlot(key);; i = (i + 1) & mask) {
+		auto &entry = table[i];
+
+		if (entry.key == key) {
+			/* rejected fixes leave the entry alone: the
+			   refill is calculated from the time of the
+			   last accepted fix, and the duplicate window
+			   starts there, so a client repeating the same
+			   location is accepted again after the window */
+			const uint16_t elapsed = now - entry.time;
+
+			const uint32_t tokens =
+				std::min<uint64_t>(entry.tokens + uint64_t(elapsed) * refill_per_tick,
+						   bucket_size);
+
+			if (elapsed < DUPLICATE_WINDOW &&
+			    (fingerprint == entry.fingerprints[0] ||
+			     fingerprint == entry.fingerprints[1])) {
+				++counters.duplicate;
+				return Result::DUPLICATE;
+			}
+
+			if (tokens < TOKEN) {
+				++counters.over_rate;
+				return Result::OVER_RATE;
+			}
+
+			entry.time = now;
+			entry.tokens = tokens - TOKEN;
+			entry.fingerprints[1] = entry.fingerprints[0];
+			entry.fingerprints[0] = fingerprint;
+			return Result::ACCEPT;
+		}
+
+		if (entry.key == 0) {
+			/* the load factor limit guarantees that the
+			   probe sequence ends with an empty slot */
+
+			if (n_entries >= max_entries) {
+				++counters.table_full;
+				return Result::ACCEPT;
+			}
+
+			entry.key = key;
+			entry.time = now;
+			entry.tokens = bucket_size - TOKEN;
+			entry.fingerprints[0] = fingerprint;
+			entry.fingerprints[1] = 0;
+
+			if (n_entries++ == 0)
+				expire_timer.Schedule(EXPIRE_INTERVAL);
+
+			return Result::ACCEPT;
+		}
+	}
+}
+
+void
+FixFilter::Remove(std::size_t i) noexcept
+{
+	assert(table[i].key != 0);
+	assert(n_entries > 0);
+
+	for (std::size_t j = (i + 1) & mask; table[j].key != 0; j = (j + 1) & mask) {
+		/* the entry at "j" may be moved to "i" only if "i"
+		   is not before its home slot */
+		const std::size_t home = GetHomeSlot(table[j].key);
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			table[i] = table[j];
+			i = j;
+		}
+	}
+
+	table[i].key = 0;
+	--n_entries;
+}
+
+void
+FixFilter::OnExpireTimer() noexcept
+{
+	const uint16_t now = GetTick(expire_timer.GetEventLoop());
+
+	for (std::size_t n = (mask + 1) / SWEEP_DIVISOR + 1; n > 0; --n) {
+		const auto &entry = table[sweep_position];
+		if (entry.key != 0 && uint16_t(now - entry.time) >= IDLE_TIMEOUT)
+			/* Remove() may move another entry into this
+			   slot; examine it in the next iteration */
+			Remove(sweep_position);
+		else
+			sweep_position = (sweep_position + 1) & mask;
+	}
+
+	if (n_entries > 0)
+		expire_timer.Schedule(EXPIRE_INTERVAL);
+}
+
+} /* namespace Beacon */
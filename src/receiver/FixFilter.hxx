@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "event/CoarseTimerEvent.hxx"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+namespace Beacon {
+
+struct Fix;
+struct TimedFix;
+
+/**
+ * Discards fixes which are exact duplicates of a recent fix of the
+ * same client key and fixes which exceed the permitted rate (a token
+ * bucket per key).
+ *
+ * The state is kept in a fixed-size open-addressing hash table
+ * (linear probing) which is allocated in the constructor; there are
+ * no allocations after that.  Each key occupies one 16-byte slot.
+ * Idle keys are removed by a periodic incremental sweep.  If the
+ * table is full, fixes of new keys are accepted without filtering.
+ *
+ * Key 0 is used internally to mark empty slots; fixes with that key
+ * are never filtered.
+ */
+class FixFilter {
+	/**
+	 * One hash table slot.
+	 */
+	struct Entry {
+		/**
+		 * The client key; 0 means this slot is empty.
+		 */
+		uint64_t key;
+
+		/**
+		 * The time of the last accepted fix from this key in
+		 * #Tick units (truncated, compared with modular
+		 * arithmetic).
+		 */
+		uint16_t time;
+
+		/**
+		 * The number of tokens in the bucket, in 1/256
+		 * units.
+		 */
+		uint16_t tokens;
+
+		/**
+		 * Fingerprints of the most recently accepted fixes,
+		 * newest first.  0 means none.
+		 */
+		uint16_t fingerprints[2];
+	};
+
+	static_assert(sizeof(Entry) == 16);
+
+	static constexpr std::size_t MIN_SLOTS = 16;
+
+	CoarseTimerEvent expire_timer;
+
+	const std::unique_ptr<Entry[]> table;
+
+	/**
+	 * The number of slots minus one (the number of slots is a
+	 * power of two).
+	 */
+	const std::size_t mask;
+
+	/**
+	 * The maximum number of occupied slots; this keeps the load
+	 * factor at or below 75%.
+	 */
+	const std::size_t max_entries;
+
+	std::size_t n_entries = 0;
+
+	/**
+	 * The next slot to be examined by OnExpireTimer().
+	 */
+	std::size_t sweep_position = 0;
+
+	/**
+	 * A random value mixed into the hash function, so clients
+	 * cannot choose keys which collide.
+	 */
+	const uint64_t seed;
+
+	/**
+	 * Token bucket parameters in 1/256 units.
+	 */
+	const uint32_t refill_per_tick, bucket_size;
+
+public:
+	/**
+	 * Counters of fixes which were discarded (or not filtered),
+	 * by reason.
+	 */
+	struct Counters {
+		uint64_t duplicate = 0;
+		uint64_t over_rate = 0;
+
+		/**
+		 * Fixes of new keys which were accepted without
+		 * filtering because the table was full.
+		 */
+		uint64_t table_full = 0;
+	};
+
+private:
+	Counters counters;
+
+public:
+	enum class Result {
+		ACCEPT,
+		DUPLICATE,
+		OVER_RATE,
+	};
+
+	/**
+	 * The largest permitted value of the "burst" parameter.
+	 */
+	static constexpr unsigned MAX_BURST = 255;
+
+	/**
+	 * The largest permitted value of the "rate" parameter.
+	 */
+	static constexpr unsigned MAX_RATE = 4095;
+
+	/**
+	 * Calculate the memory needed by one instance which tracks
+	 * the given number of keys.
+	 */
+	static constexpr std::size_t CalcMemory(std::size_t max_keys) noexcept {
+		return std::bit_ceil(std::max<std::size_t>((max_keys * 4 + 2) / 3,
+							   MIN_SLOTS)) * sizeof(Entry);
+	}
+
+	/**
+	 * @param max_memory the memory for the hash table; its
+	 * number of slots is rounded down to a power of two (but it
+	 * has at least #MIN_SLOTS), so several instances can share a
+	 * budget calculated by CalcMemory()
+	 * @param rate the permitted long-term number of fixes per
+	 * second and key (up to #MAX_RATE)
+	 * @param burst the number of fixes a key may send in a burst
+	 * (up to #MAX_BURST)
+	 */
+	FixFilter(EventLoop &event_loop, std::size_t max_memory,
+		  unsigned rate, unsigned burst);
+
+	~FixFilter() noexcept;
+
+	FixFilter(const FixFilter &) = delete;
+	FixFilter &operator=(const FixFilter &) = delete;
+
+	const Counters &GetCounters() const noexcept {
+		return counters;
+	}
+
+	/**
+	 * Check whether the given fix shall be stored and update the
+	 * state of its key.
+	 */
+	Result Check(uint64_t key, const Fix &fix) noexcept;
+
+	/**
+	 * Check whether the given batch of fixes shall be stored.
+	 * The batch is treated like one fix: it consumes one token,
+	 * because its fixes were usually recorded over a long
+	 * period, and it is a duplicate if it is identical to a
+	 * recent batch (i.e. it was retransmitted because the #ACK
+	 * was lost).  The times of the fixes are ignored.
+	 */
+	Result CheckBatch(uint64_t key, std::span<const TimedFix> fixes) noexcept;
+
+private:
+	Result Check(uint64_t key, uint16_t fingerprint) noexcept;
+
+	std::size_t GetHomeSlot(uint64_t key) const noexcept;
+
+	/**
+	 * Clear the given slot and move following entries of the
+	 * probe sequence back, so lookups keep working without
+	 * tombstones.
+	 */
+	void Remove(std::size_t i) noexcept;
+
+	void OnExpireTimer() noexcept;
+};
+
+} /* namespace Beacon */
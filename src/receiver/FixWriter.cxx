@@ -0,0 +1,386 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "FixWriter.hxx"
+#include "event/Loop.hxx"
+#include "lib/fmt/ExceptionFormatter.hxx"
+#include "net/SocketAddress.hxx"
+#include "util/StringCompare.hxx"
+#include "util/StringStrip.hxx"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <string_view>
+
+namespace Beacon {
+
+/**
+ * Flush a partial batch after this duration.
+ */
+static constexpr Event::Duration FLUSH_DELAY = std::chrono::seconds{1};
+
+/**
+ * Start writing new journal records back to disk after this
+ * duration.
+ */
+static constexpr Event::Duration WRITEBACK_DELAY = std::chrono::seconds{1};
+
+/**
+ * The delay before sending a failed batch again for the first
+ * time.
+ */
+static constexpr Event::Duration MIN_RETRY_DELAY = std::chrono::seconds{1};
+
+/**
+ * The upper limit for the growing delay before sending a failed
+ * batch again.
+ */
+static constexpr Event::Duration MAX_RETRY_DELAY = std::chrono::minutes{1};
+
+/**
+ * A database latency which makes GetPressure() return 1.
+ */
+static constexpr Event::Duration MAX_LATENCY = std::chrono::seconds{2};
+
+FixWriter::FixWriter(EventLoop &event_loop, const char *conninfo,
+		     const char *journal_path,
+		     std::size_t _batch_size, std::size_t max_pending,
+		     std::size_t max_ingest_memory)
+	:db(event_loop, conninfo, *this),
+	 journal(journal_path, max_pending),
+	 ingest(max_ingest_memory),
+	 flush_timer(event_loop, BIND_THIS_METHOD(OnFlushTimer)),
+	 writeback_timer(event_loop, BIND_THIS_METHOD(OnWritebackTimer)),
+	 retry_timer(event_loop, BIND_THIS_METHOD(OnRetryTimer)),
+	 append_times(new Event::TimePoint[journal.GetCapacity()]()),
+	 retry_delay(MIN_RETRY_DELAY),
+	 batch_size(_batch_size)
+{
+	assert(batch_size > 0);
+
+	in_flight.reserve(batch_size);
+
+	if (!journal.empty())
+		fmt::print(stderr, "Replaying {} fixes from journal {}\n",
+			   journal.size(), journal_path);
+}
+
+FixWriter::~FixWriter() noexcept
+{
+	if (!ingest.empty())
+		fmt::print(stderr, "Discarding {} fixes from the ingest queue\n",
+			   ingest.size());
+
+	if (journal.empty())
+		return;
+
+	if (journal.IsPersistent()) {
+		journal.StartWriteback();
+		fmt::print(stderr, "Keeping {} unsaved fixes in the journal\n",
+			   journal.size());
+	} else
+		fmt::print(stderr, "Discarding {} unsaved fixes\n",
+			   journal.size());
+}
+
+void
+FixWriter::Push(std::chrono::system_clock::time_point time,
+		SocketAddress address, uint64_t key,
+		const Fix &fix) noexcept
+{
+	/* if the ingest queue is not empty, the journal is full, and
+	   this fix must wait as well */
+	if (!ingest.empty() || !journal.Append(time, address, key, fix)) [[unlikely]] {
+		/* a batch is in flight (or the database is
+		   unavailable); MoveIngested() will be called when
+		   the journal has room again */
+		if (!ingest.Push(time, address, key, fix))
+			++n_discarded;
+		return;
+	}
+
+	OnAppended();
+
+	if (journal.IsPersistent() && !writeback_timer.IsPending())
+		writeback_timer.Schedule(WRITEBACK_DELAY);
+
+	if (journal.size() - in_flight.size() >= batch_size)
+		Flush();
+	else if (!flush_timer.IsPending() && !IsBusy())
+		flush_timer.Schedule(FLUSH_DELAY);
+}
+
+void
+FixWriter::Import(const JournalRecord &record) noexcept
+{
+	if (!journal.Append(record)) {
+		++n_discarded;
+		return;
+	}
+
+	/* like replayed records, imported ones have no append
+	   time */
+	append_times[(journal.GetHead() - 1) % journal.GetCapacity()] = {};
+}
+
+void
+FixWriter::ExportQueued(std::vector<JournalRecord> &dest) const
+{
+	dest.reserve(dest.size() + journal.size() + ingest.size());
+
+	for (uint64_t i = journal.GetCheckpoint(); i < journal.GetHead(); ++i)
+		dest.push_back(journal[i]);
+
+	ingest.ForEach([&dest](const JournalRecord &record){
+		dest.push_back(record);
+	});
+}
+
+void
+FixWriter::DiscardQueued() noexcept
+{
+	in_flight.clear();
+	journal.Commit(journal.GetHead());
+	ingest.clear();
+	n_suspect = 0;
+}
+
+double
+FixWriter::GetPressure() const noexcept
+{
+	if (!ingest.empty())
+		return 1;
+
+	using FloatDuration = std::chrono::duration<double>;
+
+	const double depth = double(journal.size()) / journal.GetCapacity();
+	const double delay = FloatDuration{latency} / FloatDuration{MAX_LATENCY};
+	return std::min(std::max(depth, delay), 1.);
+}
+
+inline void
+FixWriter::OnAppended() noexcept
+{
+	append_times[(journal.GetHead() - 1) % journal.GetCapacity()] =
+		flush_timer.GetEventLoop().SteadyNow();
+}
+
+static ReceiverDatabase::FixRow
+ToFixRow(const JournalRecord &record) noexcept
+{
+	return {
+		record.key,
+		record.GetTime(),
+		record.GetAddress(),
+		record.fix,
+	};
+}
+
+void
+FixWriter::Flush() noexcept
+{
+	if (IsBusy() || journal.empty() || !db.IsIdle() ||
+	    retry_timer.IsPending())
+		/* OnResultEnd(), OnConnect() or OnRetryTimer() will
+		   call us again */
+		return;
+
+	flush_timer.Cancel();
+
+	if (n_discarded > 0) {
+		fmt::print(stderr, "Discarded {} fixes because the queue was full\n",
+			   std::exchange(n_discarded, 0));
+	}
+
+	/* convert the oldest records to the batch; after a data
+	   error, send the first half of the rejected rows to find
+	   the bad ones */
+	const std::size_t n = n_suspect > 0
+		? std::max<std::size_t>(n_suspect / 2, 1)
+		: std::min(journal.size(), batch_size);
+	const uint64_t checkpoint = journal.GetCheckpoint();
+	for (std::size_t i = 0; i < n; ++i)
+		in_flight.push_back(ToFixRow(journal[checkpoint + i]));
+
+	try {
+		/* if this is a COPY, the rows will be sent by
+		   OnResult() as soon as the server is ready to accept
+		   them */
+		db.SendFixes(*this, in_flight);
+		send_time = flush_timer.GetEventLoop().SteadyNow();
+		batch_error = BatchError::NONE;
+	} catch (...) {
+		Requeue();
+		db.GetConnection().Fail(std::current_exception());
+	}
+}
+
+void
+FixWriter::MoveIngested() noexcept
+{
+	bool moved = false;
+	while (!ingest.empty() && journal.Append(ingest.front())) {
+		OnAppended();
+		ingest.pop_front();
+		moved = true;
+	}
+
+	if (moved && journal.IsPersistent() && !writeback_timer.IsPending())
+		writeback_timer.Schedule(WRITEBACK_DELAY);
+}
+
+void
+FixWriter::OnFlushTimer() noexcept
+{
+	Flush();
+}
+
+void
+FixWriter::OnWritebackTimer() noexcept
+{
+	journal.StartWriteback();
+}
+
+void
+FixWriter::OnRetryTimer() noexcept
+{
+	Flush();
+}
+
+void
+FixWriter::OnConnect() noexcept
+{
+	fmt::print(stderr, "Connected to database\n");
+
+	if (std::exchange(was_connected, true))
+		++counters.reconnects;
+
+	Flush();
+}
+
+void
+FixWriter::OnError(std::exception_ptr e) noexcept
+{
+	fmt::print(stderr, "Database error: {}\n", e);
+}
+
+/**
+ * Was the statement rejected because of its data (SQLSTATE class 22
+ * "data exception" or 23 "integrity constraint violation")?
+ */
+[[gnu::pure]]
+static bool
+IsDataError(const Pg::Result &result) noexcept
+{
+	const char *type = result.GetErrorType();
+	return type != nullptr &&
+		(StringStartsWith(type, "22") || StringStartsWith(type, "23"));
+}
+
+void
+FixWriter::OnResult(Pg::Result &&result)
+{
+	assert(IsBusy());
+
+	if (result.GetStatus() == PGRES_COPY_IN) {
+		/* the server is ready: send the rows */
+		db.CopyFixes(in_flight);
+		return;
+	}
+
+	if (result.IsError()) {
+		batch_error = IsDataError(result)
+			? BatchError::DATA
+			: BatchError::OTHER;
+
+		/* while looking for the bad rows, only the final
+		   error is interesting */
+		if (batch_error == BatchError::OTHER || in_flight.size() == 1)
+			fmt::print(stderr, "Failed to insert {} fixes into database: {}\n",
+				   in_flight.size(),
+				   StripRight(std::string_view{result.GetErrorMessage()}));
+	}
+}
+
+void
+FixWriter::OnResultEnd() noexcept
+{
+	assert(IsBusy());
+
+	const auto now = flush_timer.GetEventLoop().SteadyNow();
+	const uint64_t checkpoint = journal.GetCheckpoint();
+
+	const auto sample = now - send_time;
+	latency += (sample - latency) / 8;
+	statement_time.Add(sample);
+
+	switch (batch_error) {
+	case BatchError::NONE:
+		counters.committed += in_flight.size();
+
+		/* if these were the first half of the suspect rows,
+		   the bad ones are in the rest */
+		n_suspect -= std::min(n_suspect, in_flight.size());
+
+		for (uint64_t i = checkpoint; i < checkpoint + in_flight.size(); ++i)
+			if (const auto t = append_times[i % journal.GetCapacity()];
+			    t != Event::TimePoint{})
+				commit_latency.Add(now - t);
+
+		retry_delay = MIN_RETRY_DELAY;
+		break;
+
+	case BatchError::DATA:
+		retry_delay = MIN_RETRY_DELAY;
+
+		if (in_flight.size() > 1) {
+			/* at least one of these rows is bad;
+			   Flush() sends them again in halves */
+			n_suspect = in_flight.size();
+			Requeue();
+			Flush();
+			return;
+		}
+
+		/* the error has been logged already, and sending
+		   this row again would fail again: skip it */
+		++counters.insert_errors;
+		n_suspect = 0;
+		break;
+
+	case BatchError::OTHER:
+		/* keep the batch in the journal and send it again
+		   later */
+		++counters.insert_errors;
+		fmt::print(stderr, "Retrying in {}s\n",
+			   std::chrono::duration_cast<std::chrono::seconds>(retry_delay).count());
+		Requeue();
+		retry_timer.Schedule(retry_delay);
+		retry_delay = std::min(retry_delay * 2, MAX_RETRY_DELAY);
+		return;
+	}
+
+	journal.Commit(checkpoint + in_flight.size());
+	in_flight.clear();
+
+	MoveIngested();
+
+	/* the rest of a rejected batch was due already: don't wait
+	   for #flush_timer */
+	if (journal.size() >= batch_size || n_suspect > 0 ||
+	    batch_error == BatchError::DATA)
+		Flush();
+	else if (!journal.empty())
+		flush_timer.Schedule(FLUSH_DELAY);
+}
+
+void
+FixWriter::OnResultError() noexcept
+{
+	Requeue();
+}
+
+} /* namespace Beacon */
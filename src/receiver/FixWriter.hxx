@@ -0,0 +1,353 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "Database.hxx"
+#include "Journal.hxx"
+#include "IngestQueue.hxx"
+#include "Metrics.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "net/SocketAddress.hxx"
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace Beacon {
+
+/**
+ * Queues fixes in a #Journal and writes them to the database in
+ * batches, as one binary COPY or INSERT each.  The database connection is
+ * driven by the #EventLoop, so callers never wait for a database
+ * round-trip, not even while (re)connecting.
+ *
+ * A batch is flushed when it reaches the configured size or when
+ * the flush timer expires, whichever comes first.  Only one batch
+ * is in flight at a time; meanwhile, new fixes are queued for the
+ * next one.  While the database is unavailable, fixes are queued
+ * until the connection has been reestablished.  The journal's
+ * checkpoint is advanced only after the database has confirmed a
+ * batch, so fixes left in a persistent journal are replayed after a
+ * restart.  A batch which the database rejects because of its data
+ * is split in halves which are sent again, until the rows which are
+ * rejected on their own have been found and skipped; after any
+ * other error, it is sent again after a delay which grows with each
+ * failure.
+ *
+ * When the journal is full because the database is falling behind,
+ * new fixes wait in an #IngestQueue which keeps only the newest fix
+ * per key, and they are moved to the journal as soon as it has
+ * room.  This only affects fixes; PINGs are answered by the
+ * receiver regardless.
+ */
+class FixWriter final
+	: Pg::AsyncConnectionHandler, Pg::AsyncResultHandler
+{
+	using FixRow = ReceiverDatabase::FixRow;
+
+	ReceiverDatabase db;
+
+	/**
+	 * Fixes waiting to be sent (and the batch in flight, which
+	 * is committed after the database has confirmed it).
+	 */
+	Journal journal;
+
+	/**
+	 * Fixes which did not fit into the #journal.  If this is not
+	 * empty, the #journal is full.
+	 */
+	IngestQueue ingest;
+
+	/**
+	 * Flushes a partial batch after #FLUSH_DELAY.
+	 */
+	CoarseTimerEvent flush_timer;
+
+	/**
+	 * Starts writing the #journal back to disk periodically.
+	 */
+	CoarseTimerEvent writeback_timer;
+
+	/**
+	 * Sends a failed batch again after #retry_delay.  While it
+	 * is pending, no batch is sent.
+	 */
+	CoarseTimerEvent retry_timer;
+
+	/**
+	 * The batch that has been sent to the database and whose
+	 * result has not yet been received.  These are the oldest
+	 * records of the #journal.
+	 */
+	std::vector<FixRow> in_flight;
+
+	/**
+	 * When was the batch in flight sent?
+	 */
+	Event::TimePoint send_time;
+
+	enum class BatchError : uint8_t {
+		NONE,
+
+		/**
+		 * The database has rejected the data (SQLSTATE class
+		 * 22 or 23); sending it again would fail again.
+		 */
+		DATA,
+
+		/**
+		 * Any other error (e.g. the server is shutting down
+		 * or out of disk space); the batch shall be sent
+		 * again.
+		 */
+		OTHER,
+	};
+
+	/**
+	 * Has the database reported an error for the batch in
+	 * flight?
+	 */
+	BatchError batch_error;
+
+	/**
+	 * The number of the oldest #journal records which contain at
+	 * least one row rejected by the database (#BatchError::DATA).
+	 * Flush() sends them in halves until the bad rows have been
+	 * isolated.
+	 */
+	std::size_t n_suspect = 0;
+
+	/**
+	 * Has a database connection ever been established?
+	 */
+	bool was_connected = false;
+
+	/**
+	 * When was each #journal record appended?  Indexed by the
+	 * sequence number modulo the journal capacity; records
+	 * replayed from the journal file have a zero time point.
+	 */
+	const std::unique_ptr<Event::TimePoint[]> append_times;
+
+	/**
+	 * The moving average of the time between sending a batch and
+	 * receiving the database's confirmation.
+	 */
+	Event::Duration latency{};
+
+	/**
+	 * The delay before sending a failed batch again; doubled
+	 * after each failure and reset after a success.
+	 */
+	Event::Duration retry_delay;
+
+	/**
+	 * The maximum number of rows per batch.
+	 */
+	const std::size_t batch_size;
+
+	/**
+	 * The number of fixes which were discarded because the
+	 * #journal and the #ingest queue were full and which have not
+	 * yet been reported.
+	 */
+	std::size_t n_discarded = 0;
+
+public:
+	struct Counters {
+		/**
+		 * The number of fixes which were confirmed by the
+		 * database.
+		 */
+		uint64_t committed = 0;
+
+		/**
+		 * The number of fixes which were dropped because the
+		 * database rejected them, plus the number of batches
+		 * which failed for other reasons (and were sent
+		 * again).
+		 */
+		uint64_t insert_errors = 0;
+
+		/**
+		 * The number of connections established after the
+		 * first one.
+		 */
+		uint64_t reconnects = 0;
+	};
+
+private:
+	Counters counters;
+
+	/**
+	 * The time between appending a fix to the #journal and the
+	 * database confirming it.
+	 */
+	DurationHistogram commit_latency;
+
+	/**
+	 * The time between sending a batch and receiving its result.
+	 */
+	DurationHistogram statement_time;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param journal_path the path of the journal file; nullptr
+	 * queues fixes only in memory
+	 * @param max_pending the capacity of a new journal
+	 * @param max_ingest_memory the memory ceiling of the
+	 * #IngestQueue in bytes
+	 */
+	FixWriter(EventLoop &event_loop, const char *conninfo,
+		  const char *journal_path,
+		  std::size_t _batch_size, std::size_t max_pending,
+		  std::size_t max_ingest_memory);
+	~FixWriter() noexcept;
+
+	FixWriter(const FixWriter &) = delete;
+	FixWriter &operator=(const FixWriter &) = delete;
+
+	/**
+	 * Begin connecting to the database.  Must be called from
+	 * the #EventLoop thread.
+	 */
+	void Connect() noexcept {
+		db.Connect();
+	}
+
+	/**
+	 * Queue a fix.  This method never blocks.
+	 *
+	 * @param time the time the fix was taken
+	 */
+	void Push(std::chrono::system_clock::time_point time,
+		  SocketAddress address, uint64_t key,
+		  const Fix &fix) noexcept;
+
+	/**
+	 * Queue a fix which was exported by another process (see
+	 * ExportQueued()).  Unlike Push(), this does not start
+	 * sending; call it before the #EventLoop runs, and the fixes
+	 * will be sent as soon as the database connection is
+	 * established.  Fixes which do not fit into the #journal are
+	 * discarded.
+	 */
+	void Import(const JournalRecord &record) noexcept;
+
+	/**
+	 * Returns the number of fixes which can be passed to
+	 * Import() without being discarded.
+	 */
+	std::size_t GetImportCapacity() const noexcept {
+		return journal.GetCapacity() - journal.size();
+	}
+
+	/**
+	 * Copy all fixes which have not yet been confirmed by the
+	 * database (including the batch in flight) and the
+	 * #IngestQueue's fixes to the given vector; this object is
+	 * not modified.  This is used to pass them to a new process;
+	 * if the new process has taken them over, call
+	 * DiscardQueued().
+	 *
+	 * The #EventLoop must not be running.
+	 */
+	void ExportQueued(std::vector<JournalRecord> &dest) const;
+
+	/**
+	 * Mark all queued fixes as committed, because another
+	 * process has taken them over.
+	 *
+	 * The #EventLoop must not be running.
+	 */
+	void DiscardQueued() noexcept;
+
+	/**
+	 * Returns the number of fixes waiting in the #journal (not
+	 * yet confirmed by the database) and in the #IngestQueue.
+	 */
+	std::size_t GetQueueDepth() const noexcept {
+		return journal.size() + ingest.size();
+	}
+
+	const IngestQueue::Counters &GetIngestCounters() const noexcept {
+		return ingest.GetCounters();
+	}
+
+	Event::Duration GetLatency() const noexcept {
+		return latency;
+	}
+
+	const Counters &GetCounters() const noexcept {
+		return counters;
+	}
+
+	const DurationHistogram &GetCommitLatency() const noexcept {
+		return commit_latency;
+	}
+
+	const DurationHistogram &GetStatementTime() const noexcept {
+		return statement_time;
+	}
+
+	/**
+	 * Estimate how far the database is falling behind, based on
+	 * the queue depth and the database latency.
+	 *
+	 * @return a value between 0 (idle) and 1 (overloaded: the
+	 * #journal is full or the latency is very high)
+	 */
+	[[gnu::pure]]
+	double GetPressure() const noexcept;
+
+private:
+	bool IsBusy() const noexcept {
+		return !in_flight.empty();
+	}
+
+	/**
+	 * Remember when the newest #journal record was appended.
+	 */
+	void OnAppended() noexcept;
+
+	/**
+	 * Send the next batch unless one is still in flight or the
+	 * database is not connected.
+	 */
+	void Flush() noexcept;
+
+	/**
+	 * Move as many fixes as possible from the #IngestQueue to
+	 * the #journal.
+	 */
+	void MoveIngested() noexcept;
+
+	/**
+	 * The batch in flight has failed because the connection is
+	 * broken.  Its records are still in the #journal; they will
+	 * be sent again after the connection has been reestablished.
+	 */
+	void Requeue() noexcept {
+		in_flight.clear();
+	}
+
+	void OnFlushTimer() noexcept;
+	void OnWritebackTimer() noexcept;
+	void OnRetryTimer() noexcept;
+
+	/* virtual methods from class Pg::AsyncConnectionHandler */
+	void OnConnect() noexcept override;
+	void OnError(std::exception_ptr e) noexcept override;
+
+	/* virtual methods from class Pg::AsyncResultHandler */
+	void OnResult(Pg::Result &&result) override;
+	void OnResultEnd() noexcept override;
+	void OnResultError() noexcept override;
+};
+
+} /* namespace Beacon */
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "FloodFilter.hxx"
+#include "net/IPv4Address.hxx"
+#include "net/IPv6Address.hxx"
+#include "net/SocketAddress.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <optional>
+#include <random>
+
+namespace Beacon {
+
+static constexpr Event::Duration RESET_INTERVAL = std::chrono::seconds{1};
+
+/**
+ * The splitmix64 finalizer.
+ */
+static constexpr uint64_t
+Mix(uint64_t h) noexcept
+{
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
+}
+
+static constexpr uint64_t
+GetSourceKey(uint32_t ipv4_be) noexcept
+{
+	/* this tag distinguishes IPv4 addresses from IPv6 prefixes
+	   which would otherwise have the same key */
+	return 0x4000'0000'0000'0000ULL | ipv4_be;
+}
+
+/**
+ * Determine the key which identifies the source of a datagram: the
+ * whole IPv4 address or the /64 prefix of an IPv6 address.
+ *
+ * @return the key or std::nullopt if the address family is not
+ * supported
+ */
+static std::optional<uint64_t>
+GetSourceKey(SocketAddress address) noexcept
+{
+	switch (address.GetFamily()) {
+	case AF_INET:
+		return GetSourceKey(IPv4Address::Cast(address).GetNumericAddressBE());
+
+	case AF_INET6:
+		if (const auto &v6 = IPv6Address::Cast(address); v6.IsV4Mapped()) {
+			return GetSourceKey(v6.UnmapV4().GetNumericAddressBE());
+		} else {
+			uint64_t prefix;
+			memcpy(&prefix, &v6.GetAddress(), sizeof(prefix));
+			return prefix;
+		}
+
+	default:
+		return std::nullopt;
+	}
+}
+
+static uint64_t
+GenerateSeed()
+{
+	std::random_device rd;
+	return (uint64_t(rd()) << 32) | rd();
+}
+
+FloodFilter::FloodFilter(EventLoop &event_loop, unsigned _limit)
+	:reset_timer(event_loop, BIND_THIS_METHOD(OnResetTimer)),
+	 table(new uint16_t[DEPTH * WIDTH]()),
+	 seed(GenerateSeed()),
+	 limit(_limit)
+{
+	assert(limit > 0);
+	assert(limit <= MAX_LIMIT);
+}
+
+FloodFilter::~FloodFilter() noexcept = default;
+
+bool
+FloodFilter::Check(SocketAddress address) noexcept
+{
+	const auto key = GetSourceKey(address);
+	if (!key)
+		return true;
+
+	static_assert(DEPTH * 16 <= 64);
+	static_assert(WIDTH == 0x10000);
+	const uint64_t hash = Mix(*key ^ seed);
+
+	uint16_t *row_counters[DEPTH];
+	uint16_t estimate = 0xffff;
+	for (std::size_t i = 0; i < DEPTH; ++i) {
+		row_counters[i] = &table[i * WIDTH + uint16_t(hash >> (i * 16))];
+		estimate = std::min(estimate, *row_counters[i]);
+	}
+
+	if (estimate > limit)
+		/* this source has already been counted in
+		   "flooding_sources" */
+		return false;
+
+	/* conservative update: increment only the counters which
+	   determine the estimate; this reduces the overestimation
+	   caused by collisions */
+	for (auto *i : row_counters)
+		if (*i == estimate)
+			++*i;
+
+	if (estimate == limit) {
+		++counters.flooding_sources;
+		return false;
+	}
+
+	if (!reset_timer.IsPending())
+		reset_timer.Schedule(RESET_INTERVAL);
+
+	return true;
+}
+
+void
+FloodFilter::OnResetTimer() noexcept
+{
+	std::fill_n(table.get(), DEPTH * WIDTH, 0);
+}
+
+} /* namespace Beacon */
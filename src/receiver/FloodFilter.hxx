@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "event/CoarseTimerEvent.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class SocketAddress;
+
+namespace Beacon {
+
+/**
+ * Limits the number of datagrams accepted from one source address
+ * per second.  IPv6 addresses are aggregated by their /64 prefix,
+ * because that is what one subscriber usually gets.
+ *
+ * The datagram counts are estimated with a count-min sketch (with
+ * conservative update) which has a fixed size regardless of the
+ * number of source addresses.  Collisions can only make the
+ * estimate larger, so a busy address is never missed, but an
+ * innocent address may be limited if it collides with busy
+ * addresses in all rows; the table is large enough to make this
+ * unlikely.  The sketch is cleared one second after the first
+ * datagram was counted.
+ */
+class FloodFilter {
+	/**
+	 * The number of rows (independent hash functions).
+	 */
+	static constexpr std::size_t DEPTH = 4;
+
+	/**
+	 * The number of counters per row.  Each row is indexed with
+	 * 16 bits of a 64-bit hash.
+	 */
+	static constexpr std::size_t WIDTH = 65536;
+
+	CoarseTimerEvent reset_timer;
+
+	const std::unique_ptr<uint16_t[]> table;
+
+	/**
+	 * A random value mixed into the hash function, so attackers
+	 * cannot choose addresses which collide with a victim.
+	 */
+	const uint64_t seed;
+
+	const uint16_t limit;
+
+public:
+	struct Counters {
+		/**
+		 * The number of times a source address exceeded the
+		 * limit (once per second and address).
+		 */
+		uint64_t flooding_sources = 0;
+	};
+
+private:
+	Counters counters;
+
+public:
+	/**
+	 * The largest permitted value of the "limit" parameter.
+	 */
+	static constexpr unsigned MAX_LIMIT = 0xfffe;
+
+	/**
+	 * @param limit the maximum number of datagrams per second
+	 * from one source address (up to #MAX_LIMIT)
+	 */
+	FloodFilter(EventLoop &event_loop, unsigned limit);
+	~FloodFilter() noexcept;
+
+	FloodFilter(const FloodFilter &) = delete;
+	FloodFilter &operator=(const FloodFilter &) = delete;
+
+	const Counters &GetCounters() const noexcept {
+		return counters;
+	}
+
+	/**
+	 * Count a datagram from the given address.
+	 *
+	 * @return true if the datagram shall be handled, false if the
+	 * source has exceeded the limit
+	 */
+	bool Check(SocketAddress address) noexcept;
+
+private:
+	void OnResetTimer() noexcept;
+};
+
+} /* namespace Beacon */
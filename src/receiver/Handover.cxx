@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "Handover.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+#include "net/LocalSocketAddress.hxx"
+#include "net/MsgHdr.hxx"
+#include "net/PeerCredentials.hxx"
+#include "net/ReceiveMessage.hxx"
+#include "net/SocketError.hxx"
+#include "io/Iovec.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Beacon::Handover {
+
+/**
+ * The maximum number of file descriptors in one SCM_RIGHTS message
+ * (SCM_MAX_FD in the Linux kernel).
+ */
+static constexpr std::size_t MAX_SOCKETS = 253;
+
+/**
+ * Give up if the peer does not respond for this duration.
+ */
+static constexpr struct timeval TIMEOUT{.tv_sec = 30, .tv_usec = 0};
+
+UniqueSocketDescriptor
+Listen(const char *path)
+{
+	if (*path != '/')
+		throw FmtRuntimeError("Handover socket must be an absolute path: '{}'",
+				      path);
+
+	if (strlen(path) > LocalSocketAddress::MAX_LENGTH)
+		throw FmtRuntimeError("Socket path too long: '{}'", path);
+
+	UniqueSocketDescriptor fd;
+	if (!fd.CreateNonBlock(AF_LOCAL, SOCK_STREAM, 0))
+		throw MakeSocketError("Failed to create socket");
+
+	/* replace the socket of the old process (which is still
+	   listening, but it has already handed over or it will
+	   never hear from us) */
+	unlink(path);
+
+	/* whoever can connect gets all sockets and fixes: only the
+	   current user may */
+	const mode_t old_umask = umask(0077);
+	const bool success = fd.Bind(LocalSocketAddress{path});
+	umask(old_umask);
+	if (!success)
+		throw MakeSocketError("Failed to bind handover socket");
+
+	if (!fd.Listen(1))
+		throw MakeSocketError("Failed to listen");
+
+	return fd;
+}
+
+bool
+CheckPeer(SocketDescriptor s) noexcept
+{
+	const auto cred = s.GetPeerCredentials();
+	return cred.IsDefined() && cred.GetUid() == geteuid();
+}
+
+/**
+ * Switch the connection to blocking mode with a timeout.
+ */
+static void
+SetupConnection(SocketDescriptor s)
+{
+	s.SetBlocking();
+
+	if (!s.SetOption(SOL_SOCKET, SO_RCVTIMEO, &TIMEOUT, sizeof(TIMEOUT)) ||
+	    !s.SetOption(SOL_SOCKET, SO_SNDTIMEO, &TIMEOUT, sizeof(TIMEOUT)))
+		throw MakeSocketError("Failed to configure handover socket");
+}
+
+static void
+SendAll(SocketDescriptor s, std::span<const std::byte> src)
+{
+	while (!src.empty()) {
+		const auto nbytes = s.Send(src);
+		if (nbytes < 0)
+			throw MakeSocketError("Failed to send handover data");
+
+		src = src.subspan(nbytes);
+	}
+}
+
+static void
+ReceiveAll(SocketDescriptor s, std::span<std::byte> dest)
+{
+	while (!dest.empty()) {
+		const auto nbytes = s.Receive(dest);
+		if (nbytes < 0)
+			throw MakeSocketError("Failed to receive handover data");
+
+		if (nbytes == 0)
+			throw std::runtime_error("Handover aborted by peer");
+
+		dest = dest.subspan(nbytes);
+	}
+}
+
+/**
+ * Send the #Header with the sockets attached.
+ */
+static void
+SendHeader(SocketDescriptor s, const Header &header,
+	   std::span<const UniqueSocketDescriptor> sockets)
+{
+	assert(sockets.size() == header.n_sockets);
+	assert(sockets.size() <= MAX_SOCKETS);
+
+	const struct iovec iov[] = {MakeIovecT(header)};
+	auto msg = MakeMsgHdr(iov);
+
+	alignas(struct cmsghdr) std::byte control[CMSG_SPACE(MAX_SOCKETS * sizeof(int))];
+
+	if (!sockets.empty()) {
+		msg.msg_control = control;
+		msg.msg_controllen = CMSG_SPACE(sockets.size() * sizeof(int));
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sockets.size() * sizeof(int));
+
+		int *fds = reinterpret_cast<int *>(CMSG_DATA(cmsg));
+		std::transform(sockets.begin(), sockets.end(), fds,
+			       [](const auto &i){ return i.Get(); });
+	}
+
+	const auto nbytes = s.Send(msg);
+	if (nbytes < 0)
+		throw MakeSocketError("Failed to send handover header");
+
+	/* the ancillary data was sent with the first byte; send
+	   the rest of the header if it was a partial send */
+	SendAll(s, std::as_bytes(std::span{&header, 1}).subspan(nbytes));
+}
+
+void
+Give(SocketDescriptor s, std::span<const UniqueSocketDescriptor> sockets,
+     std::span<const JournalRecord> records)
+{
+	if (sockets.size() > MAX_SOCKETS)
+		throw FmtRuntimeError("Too many sockets for handover: {}",
+				      sockets.size());
+
+	SetupConnection(s);
+
+	const Header header{
+		.magic = Header::MAGIC,
+		.n_sockets = uint32_t(sockets.size()),
+		.n_records = records.size(),
+	};
+
+	SendHeader(s, header, sockets);
+	SendAll(s, std::as_bytes(records));
+
+	/* wait for the confirmation */
+	std::byte ack;
+	ReceiveAll(s, std::span{&ack, 1});
+}
+
+std::optional<Received>
+TakeOver(const char *path)
+{
+	if (strlen(path) > LocalSocketAddress::MAX_LENGTH)
+		throw FmtRuntimeError("Socket path too long: '{}'", path);
+
+	UniqueSocketDescriptor s;
+	if (!s.Create(AF_LOCAL, SOCK_STREAM, 0))
+		throw MakeSocketError("Failed to create socket");
+
+	if (!s.Connect(LocalSocketAddress{path})) {
+		const auto e = GetSocketError();
+		if (e == ENOENT || e == ECONNREFUSED)
+			/* no old process */
+			return std::nullopt;
+
+		throw MakeSocketError(e, "Failed to connect to handover socket");
+	}
+
+	SetupConnection(s);
+
+	ReceiveMessageBuffer<sizeof(Header), MAX_SOCKETS * sizeof(int)> buffer;
+	auto r = ReceiveMessage(s, buffer, 0);
+	if (r.payload.empty())
+		throw std::runtime_error("Handover aborted by peer");
+
+	/* receive the rest of the header if it was split */
+	Header header;
+	std::memcpy(&header, r.payload.data(), r.payload.size());
+	ReceiveAll(s, std::as_writable_bytes(std::span{&header, 1}).subspan(r.payload.size()));
+
+	if (header.magic != Header::MAGIC)
+		throw std::runtime_error("Malformed handover header");
+
+	if (r.fds.size() != header.n_sockets)
+		throw FmtRuntimeError("Handover has {} sockets instead of {}",
+				      r.fds.size(), header.n_sockets);
+
+	Received result;
+	result.sockets.reserve(r.fds.size());
+	for (auto &i : r.fds)
+		result.sockets.emplace_back(std::move(i));
+
+	result.records.resize(header.n_records);
+	ReceiveAll(s, std::as_writable_bytes(std::span{result.records}));
+
+	/* confirm */
+	static constexpr std::byte ack{1};
+	SendAll(s, std::span{&ack, 1});
+
+	/* wait until the old process has marked its fixes as
+	   committed and closed the connection, so we can open its
+	   journal files */
+	std::byte eof;
+	if (s.Receive(std::span{&eof, 1}) < 0)
+		throw MakeSocketError("Failed to receive handover data");
+
+	return result;
+}
+
+} /* namespace Beacon::Handover */
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "Journal.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+/**
+ * Passing the receiver sockets and the queued fixes from a running
+ * process to its successor over a local stream socket, so an
+ * upgrade neither loses datagrams nor fixes:
+ *
+ * 1. the new process connects to the old one's handover socket
+ * 2. the old process stops its workers (datagrams keep queueing up
+ *    in the sockets' receive buffers) and sends a #Header with the
+ *    sockets attached (SCM_RIGHTS), followed by the queued fixes as
+ *    raw #JournalRecord structs
+ * 3. the new process confirms with one byte; now the old process
+ *    marks its fixes as committed and closes the connection
+ * 4. after that, the new process opens its journals, imports the
+ *    fixes and starts
+ *
+ * If the old process crashes after step 3, fixes may be written to
+ * the database twice, but none are lost.  Both processes must be
+ * the same version of this program on the same host.
+ */
+namespace Beacon::Handover {
+
+struct Header {
+	static constexpr uint32_t MAGIC = 0x42434e48;
+
+	uint32_t magic;
+
+	/**
+	 * The number of sockets attached to this message.
+	 */
+	uint32_t n_sockets;
+
+	/**
+	 * The number of #JournalRecord structs following this
+	 * header.
+	 */
+	uint64_t n_records;
+};
+
+/**
+ * What the new process receives from the old one.
+ */
+struct Received {
+	std::vector<UniqueSocketDescriptor> sockets;
+
+	std::vector<JournalRecord> records;
+};
+
+/**
+ * Create a socket where a new process can connect to take over.
+ * It is only accessible by the current user.  An existing socket
+ * (of the old process) is replaced.
+ *
+ * Throws on error.
+ *
+ * @param path the absolute path of the socket
+ */
+UniqueSocketDescriptor
+Listen(const char *path);
+
+/**
+ * Was the given connection made by a process of the current user?
+ */
+[[gnu::pure]]
+bool
+CheckPeer(SocketDescriptor s) noexcept;
+
+/**
+ * Send the sockets and the queued fixes to the new process and wait
+ * for its confirmation.  This blocks.
+ *
+ * Throws on error.
+ */
+void
+Give(SocketDescriptor s, std::span<const UniqueSocketDescriptor> sockets,
+     std::span<const JournalRecord> records);
+
+/**
+ * Connect to the old process and take over its sockets and queued
+ * fixes.  This blocks until the old process has given up its
+ * fixes.
+ *
+ * Throws on error.
+ *
+ * @return std::nullopt if there is no old process
+ */
+std::optional<Received>
+TakeOver(const char *path);
+
+} /* namespace Beacon::Handover */
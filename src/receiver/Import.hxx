@@ -4,9 +4,12 @@
 #pragma once
 
 #include "Protocol.hxx"
+#include "Fix.hxx"
 #include "geo/GeoPoint.hxx"
 #include "util/ByteOrder.hxx"
 
+#include <chrono>
+
 namespace Beacon::Protocol {
 
 constexpr ::Angle
@@ -26,4 +29,53 @@ ImportGeoPoint(GeoPoint src) noexcept
 		: ::GeoPoint::MakeInvalid();
 }
 
+/**
+ * Decode a #FixPacket (without its header).
+ */
+constexpr Fix
+ImportFix(const FixPacket &src) noexcept
+{
+	return {
+		ImportGeoPoint(src.location),
+		FromBE16(src.direction),
+		FromBE16(src.speed),
+		int16_t(FromBE16(src.altitude)),
+	};
+}
+
+/**
+ * Decode the time of a #TimedFixPacket (since the Unix epoch).  The
+ * value is chosen by the client, and converting it to
+ * std::chrono::system_clock may overflow; check it with
+ * ClockWindow::Check() first.
+ */
+constexpr std::chrono::milliseconds
+ImportTime(const TimedFixPacket &src) noexcept
+{
+	return std::chrono::milliseconds{int64_t(FromBE64(src.time))};
+}
+
+/**
+ * Decode a #FixBatchItem (without its age).
+ */
+constexpr Fix
+ImportFix(const FixBatchItem &src) noexcept
+{
+	return {
+		ImportGeoPoint(src.location),
+		FromBE16(src.direction),
+		FromBE16(src.speed),
+		int16_t(FromBE16(src.altitude)),
+	};
+}
+
+/**
+ * Decode the age of a #FixBatchItem.
+ */
+constexpr std::chrono::seconds
+ImportAge(const FixBatchItem &src) noexcept
+{
+	return std::chrono::seconds{FromBE16(src.age)};
+}
+
 } /* namespace Beacon::Protocol */
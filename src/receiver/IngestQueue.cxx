@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "IngestQueue.hxx"
+#include "net/SocketAddress.hxx"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <limits>
+#include <random>
+
+namespace Beacon {
+
+/**
+ * The splitmix64 finalizer.
+ */
+static constexpr uint64_t
+Mix(uint64_t h) noexcept
+{
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
+}
+
+static uint64_t
+GenerateSeed()
+{
+	std::random_device rd;
+	return (uint64_t(rd()) << 32) | rd();
+}
+
+static constexpr std::size_t
+CalcCapacity(std::size_t max_memory) noexcept
+{
+	return std::clamp<std::size_t>(max_memory / IngestQueue::ITEM_MEMORY,
+				       1, std::numeric_limits<uint32_t>::max() / 2);
+}
+
+/**
+ * The #IngestQueue::index has at least twice as many slots as there
+ * are items, so its load factor is at most 50%.
+ */
+static constexpr std::size_t
+CalcIndexSize(std::size_t capacity) noexcept
+{
+	return std::bit_ceil(capacity * 2);
+}
+
+IngestQueue::IngestQueue(std::size_t max_memory)
+	:items(new Item[CalcCapacity(max_memory)]),
+	 index(new uint32_t[CalcIndexSize(CalcCapacity(max_memory))]()),
+	 index_mask(CalcIndexSize(CalcCapacity(max_memory)) - 1),
+	 seed(GenerateSeed())
+{
+	const std::size_t capacity = CalcCapacity(max_memory);
+	for (std::size_t i = 0; i < capacity; ++i)
+		unused.push_back(items[i]);
+}
+
+IngestQueue::~IngestQueue() noexcept
+{
+	queue.clear();
+	unused.clear();
+}
+
+inline std::size_t
+IngestQueue::GetHomeSlot(uint64_t key) const noexcept
+{
+	return Mix(key ^ seed) & index_mask;
+}
+
+inline std::size_t
+IngestQueue::FindSlot(uint64_t key) const noexcept
+{
+	std::size_t i = GetHomeSlot(key);
+	while (index[i] != 0 && items[index[i] - 1].record.key != key)
+		i = (i + 1) & index_mask;
+	return i;
+}
+
+bool
+IngestQueue::Push(std::chrono::system_clock::time_point time,
+		  SocketAddress address, uint64_t key,
+		  const Fix &fix) noexcept
+{
+	const std::size_t slot = FindSlot(key);
+	if (index[slot] != 0) {
+		/* latest wins (by the time of the fix, because fixes
+		   from a batch may be older than the queued one) */
+		auto &record = items[index[slot] - 1].record;
+		if (time >= record.GetTime())
+			record.Set(time, address, key, fix);
+		++counters.superseded;
+		return true;
+	}
+
+	if (unused.empty()) {
+		++counters.dropped;
+		return false;
+	}
+
+	auto &item = unused.front();
+	unused.pop_front();
+	item.record.Set(time, address, key, fix);
+	queue.push_back(item);
+	index[slot] = &item - items.get() + 1;
+
+	if (++n_queued > counters.peak)
+		counters.peak = n_queued;
+
+	return true;
+}
+
+void
+IngestQueue::RemoveSlot(std::size_t i) noexcept
+{
+	for (std::size_t j = (i + 1) & index_mask; index[j] != 0; j = (j + 1) & index_mask) {
+		/* the entry at "j" may be moved to "i" only if "i"
+		   is not before its home slot */
+		const std::size_t home = GetHomeSlot(items[index[j] - 1].record.key);
+		if (((j - home) & index_mask) >= ((j - i) & index_mask)) {
+			index[i] = index[j];
+			i = j;
+		}
+	}
+
+	index[i] = 0;
+}
+
+void
+IngestQueue::pop_front() noexcept
+{
+	assert(!queue.empty());
+	assert(n_queued > 0);
+
+	auto &item = queue.front();
+	const std::size_t slot = FindSlot(item.record.key);
+	assert(index[slot] == std::size_t(&item - items.get() + 1));
+	RemoveSlot(slot);
+
+	queue.pop_front();
+	unused.push_front(item);
+	--n_queued;
+}
+
+} /* namespace Beacon */
@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "Journal.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class SocketAddress;
+
+namespace Beacon {
+
+/**
+ * A bounded in-memory queue which holds at most one fix per client
+ * key: a new fix replaces the queued fix of the same key ("latest
+ * wins") but keeps its position.  This is where fixes wait while
+ * the #Journal is full because the database is falling behind, so a
+ * burst from one client collapses to its newest position.
+ *
+ * All memory is allocated by the constructor.  When all items are
+ * in use, fixes of keys which are not yet queued are dropped.
+ *
+ * This class is not thread-safe.
+ */
+class IngestQueue {
+	struct Item : IntrusiveListHook<> {
+		/**
+		 * The #JournalRecord::sequence field is not used.
+		 */
+		JournalRecord record;
+	};
+
+	const std::unique_ptr<Item[]> items;
+
+	/**
+	 * Maps keys to items: an open-addressing hash table (linear
+	 * probing) of item numbers plus one; 0 means empty.
+	 */
+	const std::unique_ptr<uint32_t[]> index;
+
+	/**
+	 * The number of #index slots minus one (the number of slots
+	 * is a power of two).
+	 */
+	const std::size_t index_mask;
+
+	/**
+	 * A random value mixed into the hash function, so clients
+	 * cannot choose keys which collide.
+	 */
+	const uint64_t seed;
+
+	/**
+	 * Queued items in the order of their first fix.
+	 */
+	IntrusiveList<Item> queue;
+
+	/**
+	 * Items which are not in use.
+	 */
+	IntrusiveList<Item> unused;
+
+	std::size_t n_queued = 0;
+
+public:
+	struct Counters {
+		/**
+		 * The number of fixes which were discarded because a
+		 * newer fix of the same key was queued.
+		 */
+		uint64_t superseded = 0;
+
+		/**
+		 * The number of fixes which were dropped because the
+		 * queue was full.
+		 */
+		uint64_t dropped = 0;
+
+		/**
+		 * The largest number of fixes which were queued at
+		 * the same time.
+		 */
+		std::size_t peak = 0;
+	};
+
+private:
+	Counters counters;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param max_memory the number of bytes which may be
+	 * allocated
+	 */
+	explicit IngestQueue(std::size_t max_memory);
+	~IngestQueue() noexcept;
+
+	IngestQueue(const IngestQueue &) = delete;
+	IngestQueue &operator=(const IngestQueue &) = delete;
+
+	/**
+	 * The number of bytes needed per queued fix (including up to
+	 * four #index slots).
+	 */
+	static constexpr std::size_t ITEM_MEMORY =
+		sizeof(Item) + 4 * sizeof(uint32_t);
+
+	const Counters &GetCounters() const noexcept {
+		return counters;
+	}
+
+	std::size_t size() const noexcept {
+		return n_queued;
+	}
+
+	bool empty() const noexcept {
+		return queue.empty();
+	}
+
+	/**
+	 * Queue a fix or replace the queued fix of the same key
+	 * (unless the queued one is newer).
+	 *
+	 * @return false if the fix was dropped because the queue is
+	 * full
+	 */
+	bool Push(std::chrono::system_clock::time_point time,
+		  SocketAddress address, uint64_t key,
+		  const Fix &fix) noexcept;
+
+	/**
+	 * Returns the oldest queued fix.
+	 */
+	const JournalRecord &front() const noexcept {
+		return queue.front().record;
+	}
+
+	/**
+	 * Remove the oldest queued fix.
+	 */
+	void pop_front() noexcept;
+
+	/**
+	 * Remove all queued fixes.
+	 */
+	void clear() noexcept {
+		while (!empty())
+			pop_front();
+	}
+
+	/**
+	 * Invoke the given function for each queued fix (oldest
+	 * first).
+	 */
+	template<typename F>
+	void ForEach(F &&f) const {
+		for (const auto &i : queue)
+			f(i.record);
+	}
+
+private:
+	std::size_t GetHomeSlot(uint64_t key) const noexcept;
+
+	/**
+	 * Find the #index slot of the given key or the empty slot
+	 * where it would be inserted.
+	 */
+	std::size_t FindSlot(uint64_t key) const noexcept;
+
+	/**
+	 * Clear the given #index slot and move following entries of
+	 * the probe sequence back.
+	 */
+	void RemoveSlot(std::size_t i) noexcept;
+};
+
+} /* namespace Beacon */
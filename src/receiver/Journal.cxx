@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "Journal.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+#include "lib/fmt/ToBuffer.hxx"
+#include "net/SocketAddress.hxx"
+#include "system/Error.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+namespace Beacon {
+
+/**
+ * The first page of a journal file.
+ */
+struct Journal::Header {
+	char magic[8];
+
+	/**
+	 * Must be sizeof(JournalRecord).
+	 */
+	uint32_t record_size;
+
+	uint32_t reserved;
+
+	/**
+	 * The number of records in the file.
+	 */
+	uint64_t capacity;
+
+	/**
+	 * The sequence number of the oldest record which has not yet
+	 * been committed.
+	 */
+	uint64_t checkpoint;
+};
+
+static constexpr char JOURNAL_MAGIC[8] = {'B', 'C', 'N', 'J', 'R', 'N', 'L', '2'};
+
+/**
+ * The header occupies one page, so the records are page-aligned.
+ */
+static constexpr std::size_t HEADER_SIZE = 4096;
+
+/**
+ * The prefix of IPv4-mapped IPv6 addresses (::ffff:0:0/96).
+ */
+static constexpr std::byte V4_MAPPED_PREFIX[12] = {
+	{}, {}, {}, {}, {}, {}, {}, {}, {}, {},
+	std::byte{0xff}, std::byte{0xff},
+};
+
+std::span<const std::byte>
+JournalRecord::GetAddress() const noexcept
+{
+	const std::span<const std::byte> a{address};
+
+	if (std::all_of(a.begin(), a.end(),
+			[](std::byte b){ return b == std::byte{}; }))
+		return {};
+
+	if (std::equal(a.begin(), a.begin() + sizeof(V4_MAPPED_PREFIX),
+		       std::begin(V4_MAPPED_PREFIX)))
+		return a.last(4);
+
+	return a;
+}
+
+static void
+StoreAddress(std::array<std::byte, 16> &dest, SocketAddress address) noexcept
+{
+	dest = {};
+
+	const auto raw = address.IsNull()
+		? std::span<const std::byte>{}
+		: address.GetSteadyPart();
+
+	if (raw.size() == 4) {
+		std::copy(std::begin(V4_MAPPED_PREFIX),
+			  std::end(V4_MAPPED_PREFIX), dest.begin());
+		std::copy(raw.begin(), raw.end(),
+			  dest.begin() + sizeof(V4_MAPPED_PREFIX));
+	} else if (raw.size() == dest.size())
+		std::copy(raw.begin(), raw.end(), dest.begin());
+}
+
+void
+JournalRecord::Set(std::chrono::system_clock::time_point _time,
+		   SocketAddress _address, uint64_t _key,
+		   const Fix &_fix) noexcept
+{
+	time = std::chrono::duration_cast<std::chrono::microseconds>(_time.time_since_epoch()).count();
+	StoreAddress(address, _address);
+	key = _key;
+	fix = _fix;
+}
+
+Journal::Journal(const char *path, std::size_t _capacity)
+{
+	if (path == nullptr) {
+		Map(_capacity, true);
+
+		header->record_size = sizeof(JournalRecord);
+		header->capacity = capacity;
+		header->checkpoint = 1;
+		head = 1;
+		return;
+	}
+
+	if (!fd.Open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0600))
+		throw MakeErrno(FmtBuffer<512>("Failed to open {}", path));
+
+	const off_t size = fd.GetSize();
+	if (size < 0)
+		throw MakeErrno(FmtBuffer<512>("Failed to stat {}", path));
+
+	if (size == 0) {
+		/* a new file: allocate all blocks now, because
+		   running out of disk space while writing to a
+		   memory mapping would crash the process with
+		   SIGBUS */
+		const std::size_t new_size = HEADER_SIZE + _capacity * sizeof(JournalRecord);
+		if (int error = posix_fallocate(fd.Get(), 0, new_size); error != 0)
+			throw MakeErrno(error, FmtBuffer<512>("Failed to allocate {}", path));
+
+		Map(_capacity, false);
+
+		std::copy(std::begin(JOURNAL_MAGIC), std::end(JOURNAL_MAGIC),
+			  header->magic);
+		header->record_size = sizeof(JournalRecord);
+		header->capacity = capacity;
+
+		/* sequence number 0 marks unused slots */
+		header->checkpoint = 1;
+	} else {
+		if (std::size_t(size) <= HEADER_SIZE ||
+		    (size - HEADER_SIZE) % sizeof(JournalRecord) != 0)
+			throw FmtRuntimeError("Malformed journal file: {}", path);
+
+		Map((size - HEADER_SIZE) / sizeof(JournalRecord), false);
+
+		if (!std::equal(std::begin(JOURNAL_MAGIC), std::end(JOURNAL_MAGIC),
+				header->magic) ||
+		    header->record_size != sizeof(JournalRecord) ||
+		    header->capacity != capacity ||
+		    header->checkpoint == 0) {
+			munmap(header, mapping_size);
+			throw FmtRuntimeError("Malformed journal file: {}", path);
+		}
+	}
+
+	Recover();
+}
+
+Journal::~Journal() noexcept
+{
+	munmap(header, mapping_size);
+}
+
+void
+Journal::Map(std::size_t _capacity, bool anonymous)
+{
+	assert(_capacity > 0);
+
+	capacity = _capacity;
+	mapping_size = HEADER_SIZE + capacity * sizeof(JournalRecord);
+
+	void *p = anonymous
+		? mmap(nullptr, mapping_size, PROT_READ|PROT_WRITE,
+		       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0)
+		: mmap(nullptr, mapping_size, PROT_READ|PROT_WRITE,
+		       MAP_SHARED, fd.Get(), 0);
+	if (p == MAP_FAILED)
+		throw MakeErrno("Failed to map journal");
+
+	header = static_cast<Header *>(p);
+	records = reinterpret_cast<JournalRecord *>(static_cast<std::byte *>(p) + HEADER_SIZE);
+}
+
+inline void
+Journal::Recover()
+{
+	/* find the end of the contiguous run of valid records after
+	   the checkpoint */
+	head = header->checkpoint;
+	while (head - header->checkpoint < capacity &&
+	       (*this)[head].sequence == head)
+		++head;
+}
+
+uint64_t
+Journal::GetCheckpoint() const noexcept
+{
+	return header->checkpoint;
+}
+
+bool
+Journal::Append(std::chrono::system_clock::time_point time,
+		SocketAddress address, uint64_t key,
+		const Fix &fix) noexcept
+{
+	if (IsFull())
+		return false;
+
+	auto &record = records[head % capacity];
+	record.Set(time, address, key, fix);
+
+	/* the sequence number must be written last, so a record is
+	   never valid unless it is complete */
+	std::atomic_signal_fence(std::memory_order_release);
+	record.sequence = head++;
+
+	return true;
+}
+
+bool
+Journal::Append(const JournalRecord &src) noexcept
+{
+	if (IsFull())
+		return false;
+
+	auto &record = records[head % capacity];
+	record.time = src.time;
+	record.address = src.address;
+	record.key = src.key;
+	record.fix = src.fix;
+
+	std::atomic_signal_fence(std::memory_order_release);
+	record.sequence = head++;
+
+	return true;
+}
+
+void
+Journal::Commit(uint64_t sequence) noexcept
+{
+	assert(sequence >= header->checkpoint);
+	assert(sequence <= head);
+
+	header->checkpoint = sequence;
+}
+
+void
+Journal::StartWriteback() noexcept
+{
+	if (fd.IsDefined())
+		sync_file_range(fd.Get(), 0, 0, SYNC_FILE_RANGE_WRITE);
+}
+
+} /* namespace Beacon */
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "Fix.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+class SocketAddress;
+
+namespace Beacon {
+
+/**
+ * One fix in the #Journal.  All integers are in host byte order.
+ */
+struct JournalRecord {
+	/**
+	 * The sequence number of this record.  It is written last,
+	 * and a record is only valid if this matches its position in
+	 * the journal.  0 means the slot has never been used.
+	 */
+	uint64_t sequence;
+
+	/**
+	 * The time of the fix (usually the receive time) in
+	 * microseconds since the Unix epoch.
+	 */
+	int64_t time;
+
+	/**
+	 * The client's IPv6 address; IPv4 addresses are stored as
+	 * IPv4-mapped IPv6 addresses.  All zeroes means unknown.
+	 */
+	std::array<std::byte, 16> address;
+
+	/**
+	 * The client's key.
+	 */
+	uint64_t key;
+
+	Fix fix;
+
+	std::chrono::system_clock::time_point GetTime() const noexcept {
+		return std::chrono::system_clock::time_point{std::chrono::microseconds{time}};
+	}
+
+	/**
+	 * Set all attributes except #sequence.
+	 */
+	void Set(std::chrono::system_clock::time_point _time,
+		 SocketAddress _address, uint64_t _key,
+		 const Fix &_fix) noexcept;
+
+	/**
+	 * Returns the raw client address: 4 bytes for IPv4, 16 bytes
+	 * for IPv6 or an empty span if unknown.
+	 */
+	[[gnu::pure]]
+	std::span<const std::byte> GetAddress() const noexcept;
+};
+
+static_assert(sizeof(JournalRecord) == 64);
+
+/**
+ * A persistent queue of received fixes: each accepted fix is
+ * appended to a memory-mapped file before it is sent to the
+ * database, and the checkpoint is advanced after the database has
+ * confirmed it.  After a restart, all records after the checkpoint
+ * are still there.
+ *
+ * The file is a ring of fixed-size records addressed by a
+ * monotonically increasing sequence number.  There is no fsync()
+ * per record; the kernel writes dirty pages back in the background,
+ * and StartWriteback() can be used to speed that up.  A crash of
+ * the process loses nothing; a crash of the kernel may lose the
+ * most recent records.
+ *
+ * Without a file, the journal is backed by anonymous memory and
+ * serves as a (non-persistent) queue.
+ *
+ * This class is not thread-safe.
+ */
+class Journal {
+	struct Header;
+
+	/**
+	 * The journal file; undefined if this is an anonymous
+	 * journal.
+	 */
+	UniqueFileDescriptor fd;
+
+	Header *header;
+
+	JournalRecord *records;
+
+	/**
+	 * The number of records in the ring.
+	 */
+	std::size_t capacity;
+
+	/**
+	 * The size of the whole mapping (header and records).
+	 */
+	std::size_t mapping_size;
+
+	/**
+	 * The sequence number of the next record to be appended.
+	 */
+	uint64_t head;
+
+public:
+	/**
+	 * Open (or create) a journal file.  If the file exists
+	 * already, its capacity is used instead of the given one.
+	 *
+	 * Throws on error.
+	 *
+	 * @param path the path of the journal file; nullptr creates
+	 * an anonymous (non-persistent) journal
+	 */
+	Journal(const char *path, std::size_t _capacity);
+
+	~Journal() noexcept;
+
+	Journal(const Journal &) = delete;
+	Journal &operator=(const Journal &) = delete;
+
+	bool IsPersistent() const noexcept {
+		return fd.IsDefined();
+	}
+
+	std::size_t GetCapacity() const noexcept {
+		return capacity;
+	}
+
+	/**
+	 * Returns the sequence number of the oldest record which has
+	 * not yet been committed.
+	 */
+	[[gnu::pure]]
+	uint64_t GetCheckpoint() const noexcept;
+
+	uint64_t GetHead() const noexcept {
+		return head;
+	}
+
+	/**
+	 * Returns the number of uncommitted records.
+	 */
+	std::size_t size() const noexcept {
+		return head - GetCheckpoint();
+	}
+
+	bool empty() const noexcept {
+		return size() == 0;
+	}
+
+	bool IsFull() const noexcept {
+		return size() >= capacity;
+	}
+
+	/**
+	 * Append a record.
+	 *
+	 * @return false if the journal is full
+	 */
+	bool Append(std::chrono::system_clock::time_point time,
+		    SocketAddress address, uint64_t key,
+		    const Fix &fix) noexcept;
+
+	/**
+	 * Append a copy of the given record (which was filled with
+	 * JournalRecord::Set()).
+	 *
+	 * @return false if the journal is full
+	 */
+	bool Append(const JournalRecord &src) noexcept;
+
+	/**
+	 * Access an uncommitted record.
+	 */
+	const JournalRecord &operator[](uint64_t sequence) const noexcept {
+		return records[sequence % capacity];
+	}
+
+	/**
+	 * Mark all records before the given sequence number as
+	 * committed.  Their slots may be overwritten by Append().
+	 */
+	void Commit(uint64_t sequence) noexcept;
+
+	/**
+	 * Ask the kernel to begin writing dirty pages to disk, but
+	 * don't wait for completion.  Does nothing for anonymous
+	 * journals.
+	 */
+	void StartWriteback() noexcept;
+
+private:
+	void Map(std::size_t _capacity, bool anonymous);
+	void Recover();
+};
+
+} /* namespace Beacon */
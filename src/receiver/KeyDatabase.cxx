@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "KeyDatabase.hxx"
+#include "KeySet.hxx"
+#include "lib/fmt/ExceptionFormatter.hxx"
+#include "util/ByteOrder.hxx"
+#include "util/NumberParser.hxx"
+#include "util/StringStrip.hxx"
+
+#include <fmt/core.h>
+
+#include <cassert>
+#include <cstring>
+#include <string_view>
+
+namespace Beacon {
+
+/**
+ * The notification channel used by the triggers in sql/keys.sql.
+ * The payload is "+KEY" or "-KEY" with the (signed) key in decimal,
+ * or "reload" if the whole table has changed (TRUNCATE).
+ */
+static constexpr const char *NOTIFY_CHANNEL = "beacon_keys";
+
+KeyDatabase::KeyDatabase(EventLoop &event_loop, const char *conninfo) noexcept
+	:db(event_loop, conninfo, *this)
+{
+}
+
+KeyDatabase::~KeyDatabase() noexcept = default;
+
+KeyDatabase::Reader::~Reader() noexcept = default;
+
+inline void
+KeyDatabase::Reader::Refresh() noexcept
+{
+	version = database->version.load(std::memory_order_acquire);
+	keys = database->GetKeys();
+}
+
+bool
+KeyDatabase::Reader::IsAuthorized(uint64_t key) noexcept
+{
+	if (database == nullptr)
+		return true;
+
+	if (database->version.load(std::memory_order_relaxed) != version) [[unlikely]]
+		Refresh();
+
+	if (keys == nullptr || keys->Contains(key))
+		return true;
+
+	++n_unknown;
+	return false;
+}
+
+void
+KeyDatabase::Publish(std::unique_ptr<KeySet> &&new_keys) noexcept
+{
+	{
+		const std::scoped_lock lock{mutex};
+		keys = std::move(new_keys);
+	}
+
+	version.fetch_add(1, std::memory_order_release);
+}
+
+void
+KeyDatabase::Apply(uint64_t key, bool add) noexcept
+{
+	if (keys == nullptr)
+		/* not loaded yet (or the table does not exist) */
+		return;
+
+	if (add) {
+		if (!keys->CanInsert()) {
+			try {
+				/* readers still see the old set until
+				   they have obtained the new one */
+				Publish(keys->Rebuild());
+			} catch (...) {
+				/* keep the old set (without this
+				   key); loading the table again
+				   picks it up */
+				fmt::print(stderr, "Failed to add key: {}\n",
+					   std::current_exception());
+				if (state == State::READY)
+					Reload();
+				return;
+			}
+		}
+
+		keys->Insert(key);
+	} else
+		keys->Remove(key);
+}
+
+inline void
+KeyDatabase::SendListen()
+{
+	db.SendQuery(*this, "LISTEN beacon_keys");
+	state = State::LISTEN;
+}
+
+inline void
+KeyDatabase::SendLoad()
+{
+	loading = std::make_unique<KeySet>(keys != nullptr ? keys->size() : 0);
+	load_failed = false;
+	reload_pending = false;
+
+	/* receive one row at a time, so libpq doesn't need to hold
+	   the whole table in memory */
+	db.SendQuery(*this, true, "SELECT key FROM keys");
+	db.SetSingleRowMode();
+	state = State::LOAD;
+}
+
+void
+KeyDatabase::Reload() noexcept
+{
+	try {
+		SendLoad();
+	} catch (...) {
+		db.Fail(std::current_exception());
+	}
+}
+
+void
+KeyDatabase::OnConnect() noexcept
+{
+	try {
+		SendListen();
+	} catch (...) {
+		db.Fail(std::current_exception());
+	}
+}
+
+void
+KeyDatabase::OnDisconnect() noexcept
+{
+	state = State::IDLE;
+}
+
+void
+KeyDatabase::OnNotify(const char *name, const char *payload) noexcept
+{
+	if (strcmp(name, NOTIFY_CHANNEL) != 0)
+		return;
+
+	const std::string_view p{payload};
+	if (p == "reload") {
+		switch (state) {
+		case State::IDLE:
+		case State::LISTEN:
+			/* the table will be loaded anyway */
+			break;
+
+		case State::LOAD:
+			/* the snapshot may be older than the
+			   TRUNCATE */
+			reload_pending = true;
+			break;
+
+		case State::READY:
+			Reload();
+			break;
+		}
+
+		return;
+	}
+
+	const auto key = p.empty()
+		? std::nullopt
+		: ParseInteger<int64_t>(p.substr(1));
+	if (!key || (p.front() != '+' && p.front() != '-')) {
+		fmt::print(stderr, "Malformed key notification: '{}'\n", p);
+		return;
+	}
+
+	/* the "key" column is a signed bigint which stores the bit
+	   pattern of the unsigned key */
+	const bool add = p.front() == '+';
+	if (state == State::LOAD)
+		pending.emplace_back(static_cast<uint64_t>(*key), add);
+	else
+		Apply(static_cast<uint64_t>(*key), add);
+}
+
+void
+KeyDatabase::OnError(std::exception_ptr e) noexcept
+{
+	fmt::print(stderr, "Key database error: {}\n", e);
+}
+
+void
+KeyDatabase::OnResult(Pg::Result &&result)
+{
+	switch (state) {
+	case State::IDLE:
+	case State::READY:
+		assert(false);
+		break;
+
+	case State::LISTEN:
+		if (result.IsError())
+			fmt::print(stderr, "LISTEN failed: {}\n",
+				   StripRight(std::string_view{result.GetErrorMessage()}));
+		break;
+
+	case State::LOAD:
+		if (result.GetStatus() == PGRES_SINGLE_TUPLE) {
+			const auto value = result.GetBinaryValue(0, 0);
+			if (value.size() != sizeof(uint64_t)) {
+				load_failed = true;
+				break;
+			}
+
+			uint64_t key;
+			memcpy(&key, value.data(), sizeof(key));
+
+			if (!loading->CanInsert())
+				loading = loading->Rebuild();
+
+			loading->Insert(FromBE64(key));
+		} else if (result.IsError()) {
+			/* the table does not exist or we don't have
+			   permission; keep accepting all keys (or
+			   the previous set) */
+			fmt::print(stderr, "Failed to load keys: {}\n",
+				   StripRight(std::string_view{result.GetErrorMessage()}));
+			load_failed = true;
+		}
+
+		break;
+	}
+}
+
+void
+KeyDatabase::OnResultEnd() noexcept
+{
+	switch (state) {
+	case State::IDLE:
+	case State::READY:
+		assert(false);
+		break;
+
+	case State::LISTEN:
+		Reload();
+		break;
+
+	case State::LOAD:
+		state = State::READY;
+
+		if (!load_failed) {
+			try {
+				for (const auto &[key, add] : pending) {
+					if (add) {
+						if (!loading->CanInsert())
+							loading = loading->Rebuild();
+
+						loading->Insert(key);
+					} else
+						loading->Remove(key);
+				}
+			} catch (...) {
+				/* keep the old set */
+				fmt::print(stderr, "Failed to load keys: {}\n",
+					   std::current_exception());
+				load_failed = true;
+			}
+		}
+
+		pending.clear();
+
+		if (load_failed) {
+			loading.reset();
+			break;
+		}
+
+		fmt::print(stderr, "Loaded {} keys ({} kB)\n",
+			   loading->size(), loading->GetMemoryUsage() / 1024);
+		Publish(std::move(loading));
+		break;
+	}
+
+	if (state == State::READY && reload_pending)
+		Reload();
+}
+
+void
+KeyDatabase::OnResultError() noexcept
+{
+	loading.reset();
+	pending.clear();
+	state = State::IDLE;
+}
+
+} /* namespace Beacon */
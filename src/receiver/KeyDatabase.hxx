@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "pg/AsyncConnection.hxx"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Beacon {
+
+class KeySet;
+
+/**
+ * Maintains an in-memory copy of the "keys" table (the set of
+ * authorized client keys) which can be queried by all worker
+ * threads without a database round-trip.
+ *
+ * After connecting, it sends "LISTEN" and then loads the whole
+ * table into a new #KeySet, which replaces the previous one.  After
+ * that, the set is updated incrementally by notifications which are
+ * generated by triggers on the table (see sql/keys.sql).  While the
+ * connection is broken, the last set remains in use.
+ *
+ * This object lives in the main thread; worker threads access the
+ * current #KeySet through a #Reader.
+ */
+class KeyDatabase final
+	: Pg::AsyncConnectionHandler, Pg::AsyncResultHandler
+{
+	Pg::AsyncConnection db;
+
+	enum class State {
+		/**
+		 * Not connected, or the connection is not yet ready.
+		 */
+		IDLE,
+
+		/**
+		 * The "LISTEN" command is in progress.
+		 */
+		LISTEN,
+
+		/**
+		 * The "SELECT" is in progress; rows are added to
+		 * #loading.
+		 */
+		LOAD,
+
+		READY,
+	} state = State::IDLE;
+
+	/**
+	 * Protects #keys (the pointer, not the object).
+	 */
+	mutable std::mutex mutex;
+
+	/**
+	 * The current set; nullptr if it has never been loaded.  It
+	 * is modified only by this object (in the main thread).
+	 */
+	std::shared_ptr<KeySet> keys;
+
+	/**
+	 * Incremented each time #keys is replaced, so #Reader
+	 * instances can check cheaply whether they need to obtain
+	 * the new pointer.
+	 */
+	std::atomic_uint version{0};
+
+	/**
+	 * The set being loaded while #state is #State::LOAD.
+	 */
+	std::unique_ptr<KeySet> loading;
+
+	/**
+	 * Notifications which were received during #State::LOAD;
+	 * they are applied after the table has been loaded, because
+	 * the snapshot may be older than some of them.  Each item is
+	 * a key and whether it was added (true) or removed.
+	 */
+	std::vector<std::pair<uint64_t, bool>> pending;
+
+	/**
+	 * Has the "SELECT" failed?  Then #loading is discarded.
+	 */
+	bool load_failed;
+
+	/**
+	 * Has a "reload" notification been received during
+	 * #State::LOAD?  Then the table is loaded again.
+	 */
+	bool reload_pending;
+
+public:
+	/**
+	 * A per-thread view of the current #KeySet.  It holds a
+	 * reference to the #KeySet which was current when it last
+	 * checked, so it never blocks (except briefly after a
+	 * reload) and the #KeySet is not freed while in use.
+	 */
+	class Reader {
+		const KeyDatabase *const database;
+
+		std::shared_ptr<const KeySet> keys;
+
+		unsigned version = 0;
+
+		/**
+		 * The number of IsAuthorized() calls which returned
+		 * false.
+		 */
+		uint64_t n_unknown = 0;
+
+	public:
+		/**
+		 * @param _database the #KeyDatabase or nullptr if keys
+		 * shall not be checked
+		 */
+		explicit Reader(const KeyDatabase *_database) noexcept
+			:database(_database) {}
+
+		~Reader() noexcept;
+
+		uint64_t GetUnknownCount() const noexcept {
+			return n_unknown;
+		}
+
+		/**
+		 * Is the given key in the "keys" table?  All keys
+		 * are authorized before the table has been loaded.
+		 */
+		bool IsAuthorized(uint64_t key) noexcept;
+
+	private:
+		void Refresh() noexcept;
+	};
+
+	/**
+	 * The connection is not established until Connect() is
+	 * called.
+	 */
+	KeyDatabase(EventLoop &event_loop, const char *conninfo) noexcept;
+	~KeyDatabase() noexcept;
+
+	KeyDatabase(const KeyDatabase &) = delete;
+	KeyDatabase &operator=(const KeyDatabase &) = delete;
+
+	/**
+	 * Begin connecting to the database.  Must be called from
+	 * the #EventLoop thread.
+	 */
+	void Connect() noexcept {
+		db.Connect();
+	}
+
+private:
+	/**
+	 * Replace #keys and notify the #Reader instances.
+	 */
+	void Publish(std::unique_ptr<KeySet> &&new_keys) noexcept;
+
+	std::shared_ptr<const KeySet> GetKeys() const noexcept {
+		const std::scoped_lock lock{mutex};
+		return keys;
+	}
+
+	/**
+	 * Apply one change to #keys.
+	 */
+	void Apply(uint64_t key, bool add) noexcept;
+
+	void SendListen();
+	void SendLoad();
+
+	/**
+	 * Load the whole table again (calls SendLoad()).  Must be
+	 * called while no query is in progress.
+	 */
+	void Reload() noexcept;
+
+	/* virtual methods from class Pg::AsyncConnectionHandler */
+	void OnConnect() noexcept override;
+	void OnDisconnect() noexcept override;
+	void OnNotify(const char *name, const char *payload) noexcept override;
+	void OnError(std::exception_ptr e) noexcept override;
+
+	/* virtual methods from class Pg::AsyncResultHandler */
+	void OnResult(Pg::Result &&result) override;
+	void OnResultEnd() noexcept override;
+	void OnResultError() noexcept override;
+};
+
+} /* namespace Beacon */
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "KeySet.hxx"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+namespace Beacon {
+
+/**
+ * The number of slots per expected key.  With up to 75% of the
+ * slots used (including tombstones), lookups of unknown keys, which
+ * scan to the next empty slot, stay within one or two cache lines.
+ */
+static constexpr std::size_t
+CalcCapacity(std::size_t expected_keys) noexcept
+{
+	/* a power of two, so a mask maps hashes to slots */
+	return std::bit_ceil(std::max<std::size_t>(expected_keys * 3 / 2, 64));
+}
+
+/**
+ * The splitmix64 finalizer.
+ */
+static constexpr uint64_t
+Mix(uint64_t h) noexcept
+{
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
+}
+
+KeySet::KeySet(std::size_t expected_keys)
+	:slots(new std::atomic<uint64_t>[CalcCapacity(expected_keys)]()),
+	 capacity(CalcCapacity(expected_keys)),
+	 max_used(capacity * 3 / 4)
+{
+}
+
+KeySet::~KeySet() noexcept = default;
+
+inline std::size_t
+KeySet::GetHomeSlot(uint64_t key) const noexcept
+{
+	return Mix(key) & (capacity - 1);
+}
+
+std::unique_ptr<KeySet>
+KeySet::Rebuild() const
+{
+	auto result = std::make_unique<KeySet>(n_keys + n_keys / 2);
+
+	for (std::size_t i = 0; i < capacity; ++i)
+		if (const uint64_t key = slots[i].load(std::memory_order_relaxed);
+		    !IsSpecial(key))
+			result->Insert(key);
+
+	for (std::size_t i = 0; i < std::size(special_keys); ++i)
+		if (special_keys[i].load(std::memory_order_relaxed))
+			result->Insert(i);
+
+	return result;
+}
+
+bool
+KeySet::Contains(uint64_t key) const noexcept
+{
+	if (IsSpecial(key)) [[unlikely]]
+		return special_keys[key].load(std::memory_order_relaxed);
+
+	/* the table always contains an empty slot, which ends the
+	   loop */
+	for (std::size_t i = GetHomeSlot(key);; i = Next(i)) {
+		const uint64_t value = slots[i].load(std::memory_order_relaxed);
+		if (value == key)
+			return true;
+
+		if (value == EMPTY)
+			return false;
+	}
+}
+
+void
+KeySet::Insert(uint64_t key) noexcept
+{
+	if (IsSpecial(key)) [[unlikely]] {
+		if (!special_keys[key].exchange(true, std::memory_order_relaxed))
+			++n_keys;
+		return;
+	}
+
+	std::size_t i = GetHomeSlot(key), tombstone = capacity;
+	for (;; i = Next(i)) {
+		const uint64_t value = slots[i].load(std::memory_order_relaxed);
+		if (value == key)
+			return;
+
+		if (value == EMPTY)
+			break;
+
+		if (value == TOMBSTONE && tombstone == capacity)
+			tombstone = i;
+	}
+
+	if (tombstone != capacity) {
+		/* reuse the first tombstone of the probe sequence */
+		i = tombstone;
+	} else {
+		assert(CanInsert());
+		++n_used;
+	}
+
+	slots[i].store(key, std::memory_order_relaxed);
+	++n_keys;
+}
+
+void
+KeySet::Remove(uint64_t key) noexcept
+{
+	if (IsSpecial(key)) [[unlikely]] {
+		if (special_keys[key].exchange(false, std::memory_order_relaxed))
+			--n_keys;
+		return;
+	}
+
+	for (std::size_t i = GetHomeSlot(key);; i = Next(i)) {
+		const uint64_t value = slots[i].load(std::memory_order_relaxed);
+		if (value == key) {
+			/* a tombstone (not EMPTY) keeps the probe
+			   sequences of other keys intact */
+			slots[i].store(TOMBSTONE, std::memory_order_relaxed);
+			--n_keys;
+			return;
+		}
+
+		if (value == EMPTY)
+			return;
+	}
+}
+
+} /* namespace Beacon */
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace Beacon {
+
+/**
+ * A set of client keys: a fixed-capacity open-addressing hash table
+ * (linear probing) of 64-bit keys without any per-key overhead, so
+ * a lookup touches usually only one cache line.
+ *
+ * One thread may modify the set while other threads call
+ * Contains(); each slot is an atomic word, and removed keys leave a
+ * tombstone, so concurrent lookups never see a partially modified
+ * table.  The set must be rebuilt (with a larger capacity and
+ * without tombstones) when CanInsert() returns false.
+ */
+class KeySet {
+	/**
+	 * Slot values which mark empty slots and removed keys.  The
+	 * keys with these values are stored in #special_keys.
+	 */
+	static constexpr uint64_t EMPTY = 0, TOMBSTONE = 1;
+
+	const std::unique_ptr<std::atomic<uint64_t>[]> slots;
+
+	/**
+	 * The number of slots; always a power of two.
+	 */
+	const std::size_t capacity;
+
+	/**
+	 * The maximum number of used slots (including tombstones).
+	 */
+	const std::size_t max_used;
+
+	/**
+	 * The number of slots which are not #EMPTY.  Only accessed
+	 * by the modifying thread.
+	 */
+	std::size_t n_used = 0;
+
+	/**
+	 * The number of keys.  Only accessed by the modifying thread.
+	 */
+	std::size_t n_keys = 0;
+
+	/**
+	 * Are the keys #EMPTY and #TOMBSTONE in the set?
+	 */
+	std::atomic_bool special_keys[2]{};
+
+public:
+	/**
+	 * @param expected_keys the number of keys the caller is going
+	 * to insert; there will be room for more
+	 */
+	explicit KeySet(std::size_t expected_keys);
+	~KeySet() noexcept;
+
+	KeySet(const KeySet &) = delete;
+	KeySet &operator=(const KeySet &) = delete;
+
+	/**
+	 * Create a copy with room for more keys and without
+	 * tombstones.
+	 */
+	std::unique_ptr<KeySet> Rebuild() const;
+
+	std::size_t size() const noexcept {
+		return n_keys;
+	}
+
+	/**
+	 * The number of bytes allocated by this object.
+	 */
+	std::size_t GetMemoryUsage() const noexcept {
+		return sizeof(*this) + capacity * sizeof(slots[0]);
+	}
+
+	/**
+	 * May be called from any thread.
+	 */
+	[[gnu::pure]]
+	bool Contains(uint64_t key) const noexcept;
+
+	/**
+	 * Is there room for one more Insert() call?
+	 */
+	bool CanInsert() const noexcept {
+		return n_used < max_used;
+	}
+
+	/**
+	 * Add a key.  Does nothing if the key is already in the set.
+	 * The caller must check CanInsert() first.
+	 */
+	void Insert(uint64_t key) noexcept;
+
+	/**
+	 * Remove a key.  Does nothing if the key is not in the set.
+	 */
+	void Remove(uint64_t key) noexcept;
+
+private:
+	std::size_t GetHomeSlot(uint64_t key) const noexcept;
+
+	std::size_t Next(std::size_t i) const noexcept {
+		return (i + 1) & (capacity - 1);
+	}
+
+	static constexpr bool IsSpecial(uint64_t key) noexcept {
+		return key == EMPTY || key == TOMBSTONE;
+	}
+};
+
+} /* namespace Beacon */
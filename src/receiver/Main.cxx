@@ -2,13 +2,30 @@
 // Copyright Max Kellermann <max.kellermann@gmail.com>
 
 #include "Protocol.hxx"
-#include "Receiver.hxx"
-#include "Database.hxx"
-#include "geo/GeoPoint.hxx"
-#include "lib/fmt/ExceptionFormatter.hxx"
+#include "CommandLine.hxx"
+#include "Worker.hxx"
+#include "KeyDatabase.hxx"
+#include "Handover.hxx"
+#include "Journal.hxx"
+#include "Metrics.hxx"
+#include "MetricsServer.hxx"
+#include "event/CoarseTimerEvent.hxx"
 #include "event/Loop.hxx"
-#include "net/IPv4Address.hxx"
+#include "event/PipeEvent.hxx"
+#include "event/ShutdownListener.hxx"
+#include "event/SignalEvent.hxx"
+#include "event/SocketEvent.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+#include "lib/fmt/ToBuffer.hxx"
+#include "net/AddressInfo.hxx"
+#include "net/PeerCredentials.hxx"
+#include "net/Resolver.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "system/Error.hxx"
+#include "util/NumberParser.hxx"
 #include "util/PrintException.hxx"
+#include "util/ScopeExit.hxx"
 #include "config.h"
 
 #ifdef HAVE_LIBSYSTEMD
@@ -17,91 +34,729 @@
 
 #include <fmt/core.h>
 
+#include <algorithm>
 #include <forward_list>
-#include <sstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
 
-#include <inttypes.h>
+#include <dirent.h>
+#include <netdb.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-class Instance;
+#ifdef HAVE_LIBSYSTEMD
+/**
+ * How often is the status line shown by systemd updated?
+ */
+static constexpr Event::Duration STATUS_INTERVAL = std::chrono::seconds{10};
+
+/**
+ * A worker whose heartbeat is older than this is considered stuck
+ * (unless the systemd watchdog timeout is even longer).  Workers
+ * update it every second, but timers may be late by another
+ * second.
+ */
+static constexpr Event::Duration MIN_STUCK_DURATION = std::chrono::seconds{5};
+#endif
+
+class Instance {
+	EventLoop event_loop;
+
+	ShutdownListener shutdown_listener{event_loop, BIND_THIS_METHOD(OnShutdown)};
+
+	/**
+	 * SIGHUP launches a new process which takes over (see
+	 * SpawnSuccessor()); only used if
+	 * ReceiverConfig::handover_path is set.
+	 */
+	SignalEvent reload_listener{event_loop, SIGHUP, BIND_THIS_METHOD(OnReload)};
+
+	/**
+	 * Our command line, for SpawnSuccessor().
+	 */
+	char *const*const argv;
+
+	/**
+	 * The process launched by OnReload(), or -1.  It is reaped
+	 * by the next OnReload() call if it fails to take over.
+	 */
+	pid_t successor = -1;
+
+	/**
+	 * The write end of the "quit" pipe.  Closing it asks all
+	 * workers to quit.
+	 */
+	UniqueFileDescriptor quit_w;
+
+	/**
+	 * The read end of the "done" pipe.  It reports end of file
+	 * after all workers have finished.
+	 */
+	PipeEvent done_event{event_loop, BIND_THIS_METHOD(OnWorkersDone)};
+
+	/**
+	 * The set of authorized keys; only used if
+	 * ReceiverConfig::check_keys is enabled.  This must be
+	 * destructed after the #workers.
+	 */
+	std::optional<Beacon::KeyDatabase> key_database;
 
-class MyReceiver final : public Beacon::Receiver {
-	Instance &instance;
+	/**
+	 * The receiver sockets.  Each worker has duplicates of some
+	 * of them.  They are kept open here, so datagrams queue up
+	 * while the workers stop, until they are passed to a new
+	 * process (see #handover_listener).
+	 */
+	std::vector<UniqueSocketDescriptor> sockets;
+
+	std::forward_list<Worker> workers;
+
+	/**
+	 * Serves the workers' metrics; only used if
+	 * ReceiverConfig::metrics_address is set.
+	 */
+	std::optional<Beacon::MetricsServer> metrics_server;
+
+	/**
+	 * Accepts a connection from a new process which takes over
+	 * (see ReceiverConfig::handover_path).
+	 */
+	SocketEvent handover_listener{event_loop, BIND_THIS_METHOD(OnHandoverConnect)};
+
+	/**
+	 * The connection to the new process which takes over after
+	 * the workers have stopped.
+	 */
+	UniqueSocketDescriptor handover_peer;
+
+	/**
+	 * The process id of #handover_peer.
+	 */
+	pid_t handover_peer_pid;
+
+#ifdef HAVE_LIBSYSTEMD
+	/**
+	 * Updates the status line shown by systemd periodically.
+	 */
+	CoarseTimerEvent status_timer{event_loop, BIND_THIS_METHOD(OnStatusTimer)};
+
+	/**
+	 * The totals at the previous status update, for calculating
+	 * rates.
+	 */
+	uint64_t last_datagrams = 0, last_fixes = 0;
+
+	/**
+	 * Sends "WATCHDOG=1" to systemd, but only while all workers
+	 * are alive; only used if the systemd watchdog is enabled.
+	 */
+	CoarseTimerEvent watchdog_timer{event_loop, BIND_THIS_METHOD(OnWatchdogTimer)};
+
+	/**
+	 * The systemd watchdog timeout ("WatchdogSec").
+	 */
+	Event::Duration watchdog_timeout;
+#endif
 
 public:
-	MyReceiver(Instance &instance,
-		   SocketAddress address) noexcept;
+	Instance(const Beacon::ReceiverConfig &config, char *const*_argv);
+	~Instance() noexcept;
 
-	void OnFix(const Client &client, GeoPoint location) noexcept override;
+	void Run();
 
-	void OnError(std::exception_ptr e) noexcept override {
-		PrintException(e);
-	}
+private:
+	std::vector<const Beacon::WorkerMetrics *> GetWorkerMetrics() const;
+
+	std::string GenerateMetrics();
+
+	/**
+	 * Pass duplicates of the #sockets to the workers.
+	 *
+	 * Throws on error.
+	 */
+	void DistributeSockets();
+
+	/**
+	 * Queue the fixes taken over from the old process (or from
+	 * orphaned journals) in the workers' writers.
+	 */
+	void Import(std::span<const Beacon::JournalRecord> records) noexcept;
+
+	/**
+	 * Move the fixes from journals of workers which do not exist
+	 * anymore (because the thread count has been reduced) to the
+	 * workers' journals and delete those files.  Refuses to start
+	 * (throws) if the fixes do not fit.
+	 *
+	 * Throws on error.
+	 */
+	void MergeOrphanedJournals(const char *directory,
+				   unsigned n_threads);
+
+	/**
+	 * Pass the #sockets and all queued fixes to the new process.
+	 * Called after all workers have stopped.
+	 */
+	void HandOver() noexcept;
+
+	void OnHandoverConnect(unsigned events) noexcept;
+
+	void OnReload(int signo) noexcept;
+
+#ifdef HAVE_LIBSYSTEMD
+	void OnStatusTimer() noexcept;
+
+	/**
+	 * Are all workers alive, i.e. is no #EventLoop stuck?
+	 */
+	[[gnu::pure]]
+	bool CheckWorkers() const noexcept;
+
+	void OnWatchdogTimer() noexcept;
+#endif
+
+	void OnShutdown() noexcept;
+	void OnWorkersDone(unsigned events) noexcept;
 };
 
-class Instance {
-	EventLoop event_loop;
+#ifdef HAVE_LIBSYSTEMD
 
-	Beacon::ReceiverDatabase db;
+/**
+ * Adopt the sockets passed by systemd (socket activation).
+ *
+ * Throws on error.
+ */
+static std::vector<UniqueSocketDescriptor>
+GetSystemdSockets()
+{
+	const int n = sd_listen_fds(true);
+	if (n < 0)
+		throw MakeErrno(-n, "sd_listen_fds() failed");
 
-	std::forward_list<MyReceiver> receivers;
+	std::vector<UniqueSocketDescriptor> result;
+	result.reserve(n);
 
-public:
-	explicit Instance(const char *_db)
-		:db(_db) {}
+	for (int i = 0; i < n; ++i) {
+		UniqueSocketDescriptor fd{AdoptTag{}, SD_LISTEN_FDS_START + i};
+		fd.EnableCloseOnExec();
+
+		if (fd.GetType() != SOCK_DGRAM)
+			throw FmtRuntimeError("Socket {} passed by systemd is not a datagram socket",
+					      i);
 
-	auto &GetEventLoop() noexcept {
-		return event_loop;
+		Beacon::Receiver::SetupSocket(fd);
+		result.emplace_back(std::move(fd));
 	}
 
-	auto &GetDatabase() noexcept {
-		return db;
+	return result;
+}
+
+#endif
+
+/**
+ * Create and bind the receiver sockets specified by
+ * ReceiverConfig::listen_addresses.
+ *
+ * Throws on error.
+ */
+static std::vector<UniqueSocketDescriptor>
+CreateSockets(const Beacon::ReceiverConfig &config)
+{
+	/* with SO_REUSEPORT, each worker gets its own socket per
+	   address, and the kernel distributes clients among them */
+	const bool reuse_port = config.n_threads > 1;
+
+	std::vector<UniqueSocketDescriptor> result;
+
+	const auto add = [&](const char *address){
+		const auto ai = Resolve(address, Beacon::Protocol::DEFAULT_PORT,
+					AI_PASSIVE, SOCK_DGRAM);
+		const SocketAddress best = ai.GetBest();
+
+		for (unsigned i = 0; i < config.n_threads; ++i)
+			result.emplace_back(Beacon::Receiver::CreateSocket(best, reuse_port));
+	};
+
+	if (config.listen_addresses.empty())
+		add("*");
+	else
+		for (const char *i : config.listen_addresses)
+			add(i);
+
+	return result;
+}
+
+Instance::Instance(const Beacon::ReceiverConfig &config, char *const*_argv)
+	:argv(_argv)
+{
+	/* this must be done before creating the workers, because
+	   they open the journal files which the old process may
+	   still be using */
+	std::optional<Beacon::Handover::Received> handover;
+	if (config.handover_path != nullptr) {
+		handover = Beacon::Handover::TakeOver(config.handover_path);
+		if (handover) {
+			fmt::print(stderr, "Took over {} sockets and {} queued fixes\n",
+				   handover->sockets.size(), handover->records.size());
+			sockets = std::move(handover->sockets);
+		}
 	}
 
-	void AddReceiver(SocketAddress address);
+#ifdef HAVE_LIBSYSTEMD
+	if (sockets.empty())
+		sockets = GetSystemdSockets();
+#endif
+
+	if (sockets.empty())
+		sockets = CreateSockets(config);
+
+	UniqueFileDescriptor quit_r, done_r, done_w;
+	if (!UniqueFileDescriptor::CreatePipe(quit_r, quit_w) ||
+	    !UniqueFileDescriptor::CreatePipe(done_r, done_w))
+		throw MakeErrno("pipe() failed");
+
+	done_event.Open(done_r.Release());
+
+	if (config.check_keys)
+		key_database.emplace(event_loop, config.database);
 
-	void Run() {
-		event_loop.Run();
+	for (unsigned i = 0; i < config.n_threads; ++i)
+		workers.emplace_front(config, i,
+				      key_database ? &*key_database : nullptr,
+				      quit_r.Duplicate(),
+				      done_w.Duplicate());
+
+	DistributeSockets();
+
+	/* orphaned fixes are older than those of the old process */
+	if (config.journal_directory != nullptr)
+		MergeOrphanedJournals(config.journal_directory,
+				      config.n_threads);
+
+	if (handover)
+		Import(handover->records);
+
+	if (config.metrics_address != nullptr)
+		metrics_server.emplace(event_loop,
+				       Beacon::MetricsServer::CreateSocket(config.metrics_address),
+				       BIND_THIS_METHOD(GenerateMetrics));
+
+	if (config.handover_path != nullptr) {
+		handover_listener.Open(Beacon::Handover::Listen(config.handover_path).Release());
+		reload_listener.Enable();
 	}
-};
+}
 
-MyReceiver::MyReceiver(Instance &_instance,
-		       SocketAddress address) noexcept
-	:Beacon::Receiver(_instance.GetEventLoop(), address),
-	 instance(_instance)
+void
+Instance::DistributeSockets()
 {
+	std::vector<Worker *> w;
+	for (auto &i : workers)
+		w.push_back(&i);
+
+	/* every worker gets at least one socket, and every socket is
+	   served by at least one worker: if there are fewer sockets
+	   than workers (e.g. one socket from systemd), the workers
+	   share them, and only the first one counts the socket's
+	   kernel drops */
+	const std::size_t n = std::max(sockets.size(), w.size());
+	for (std::size_t i = 0; i < n; ++i) {
+		auto fd = sockets[i % sockets.size()].Duplicate();
+		if (!fd.IsDefined())
+			throw MakeErrno("Failed to duplicate socket");
+
+		w[i % w.size()]->AddReceiver(std::move(fd), i < sockets.size());
+	}
 }
 
 void
-MyReceiver::OnFix(const Client &client, GeoPoint location) noexcept
-try {
-	auto &db = instance.GetDatabase();
-	db.AutoReconnect();
-	db.InsertFix(client.address, client.key, location);
-} catch (...) {
-	fmt::print(stderr, "Failed to insert fix into database: {}\n",
-		   std::current_exception());
+Instance::Import(std::span<const Beacon::JournalRecord> records) noexcept
+{
+	std::vector<Worker *> w;
+	for (auto &i : workers)
+		w.push_back(&i);
+
+	/* assign each key to one worker, preserving the order of
+	   its fixes */
+	for (const auto &i : records)
+		w[i.key % w.size()]->GetWriter().Import(i);
+}
+
+/**
+ * Parse the worker index from a journal file name created by
+ * MakeJournalPath().
+ */
+static std::optional<unsigned>
+ParseJournalIndex(std::string_view name) noexcept
+{
+	static constexpr std::string_view prefix = "fixes-", suffix = ".journal";
+	if (!name.starts_with(prefix) || !name.ends_with(suffix))
+		return std::nullopt;
+
+	name.remove_prefix(prefix.size());
+	name.remove_suffix(suffix.size());
+	return ParseInteger<unsigned>(name);
 }
 
 void
-Instance::AddReceiver(SocketAddress address)
+Instance::MergeOrphanedJournals(const char *directory, unsigned n_threads)
 {
-	receivers.emplace_front(*this, address);
+	std::vector<std::string> paths;
+
+	{
+		DIR *dir = opendir(directory);
+		if (dir == nullptr)
+			throw MakeErrno(FmtBuffer<512>("Failed to open {}", directory));
+
+		AtScopeExit(dir) { closedir(dir); };
+
+		while (const auto *e = readdir(dir))
+			if (const auto index = ParseJournalIndex(e->d_name);
+			    index && *index >= n_threads)
+				paths.emplace_back(fmt::format("{}/{}", directory,
+							       e->d_name));
+	}
+
+	if (paths.empty())
+		return;
+
+	std::sort(paths.begin(), paths.end());
+
+	std::vector<Beacon::JournalRecord> records;
+	for (const auto &path : paths) {
+		const Beacon::Journal journal{path.c_str(), 1};
+		fmt::print(stderr, "Found {} fixes in orphaned journal {}\n",
+			   journal.size(), path);
+		for (uint64_t i = journal.GetCheckpoint(); i < journal.GetHead(); ++i)
+			records.push_back(journal[i]);
+	}
+
+	std::vector<Worker *> w;
+	for (auto &i : workers)
+		w.push_back(&i);
+
+	/* check the room in each worker's journal before importing
+	   anything, so a failed attempt leaves no duplicates behind
+	   (same key mapping as in Import()) */
+	std::vector<std::size_t> needed(w.size());
+	for (const auto &i : records)
+		++needed[i.key % w.size()];
+
+	for (std::size_t i = 0; i < w.size(); ++i)
+		if (needed[i] > w[i]->GetWriter().GetImportCapacity())
+			throw FmtRuntimeError("The {} fixes in orphaned journals in {} do not fit into the journals of {} threads; increase the thread count or the queue size",
+					      records.size(), directory, n_threads);
+
+	Import(records);
+
+	/* the fixes are in the workers' journals now; a crash
+	   before the files are deleted only leads to duplicates */
+	for (const auto &path : paths)
+		if (unlink(path.c_str()) < 0)
+			throw MakeErrno(FmtBuffer<512>("Failed to delete {}", path));
 }
 
-int
-main(int, char **) noexcept
-try {
-	const char *db = "dbname=beacon"; // TODO make configurable
+Instance::~Instance() noexcept
+{
+	quit_w.Close();
+
+	for (auto &i : workers)
+		i.Join();
 
-	Instance instance(db);
-	instance.AddReceiver(IPv4Address{Beacon::Protocol::DEFAULT_PORT});
+	handover_listener.Close();
+	done_event.Close();
+}
+
+void
+Instance::Run()
+{
+	/* block the shutdown signals before launching the threads,
+	   so they inherit the signal mask and only our signalfd
+	   receives them */
+	shutdown_listener.Enable();
+
+	for (auto &i : workers)
+		i.Start();
+
+	done_event.ScheduleRead();
+
+	if (handover_listener.IsDefined())
+		handover_listener.ScheduleRead();
+
+	if (key_database)
+		key_database->Connect();
 
 #ifdef HAVE_LIBSYSTEMD
 	/* tell systemd we're ready */
 	sd_notify(0, "READY=1");
+
+	status_timer.Schedule(STATUS_INTERVAL);
+
+	if (uint64_t usec; sd_watchdog_enabled(false, &usec) > 0) {
+		watchdog_timeout = std::chrono::microseconds{usec};
+		watchdog_timer.Schedule(watchdog_timeout / 2);
+	}
+#endif
+
+	event_loop.Run();
+}
+
+std::vector<const Beacon::WorkerMetrics *>
+Instance::GetWorkerMetrics() const
+{
+	std::vector<const Beacon::WorkerMetrics *> result;
+	for (const auto &i : workers)
+		result.push_back(&i.GetMetrics());
+	return result;
+}
+
+std::string
+Instance::GenerateMetrics()
+{
+	return Beacon::FormatMetrics(GetWorkerMetrics());
+}
+
+#ifdef HAVE_LIBSYSTEMD
+
+void
+Instance::OnStatusTimer() noexcept
+{
+	using Beacon::WorkerMetrics;
+
+	const auto metrics = GetWorkerMetrics();
+	const uint64_t datagrams = Beacon::SumMetric(metrics, &WorkerMetrics::datagrams);
+	const uint64_t fixes = Beacon::SumMetric(metrics, &WorkerMetrics::fixes);
+	const auto interval = std::chrono::duration_cast<std::chrono::seconds>(STATUS_INTERVAL).count();
+
+	sd_notify(0, FmtBuffer<256>("STATUS={} datagrams/s, {} fixes/s, {} queued, database latency {} ms, {} dropped by the kernel",
+				    (datagrams - last_datagrams) / interval,
+				    (fixes - last_fixes) / interval,
+				    Beacon::SumMetric(metrics, &WorkerMetrics::queue_depth),
+				    Beacon::MaxMetric(metrics, &WorkerMetrics::db_latency_us) / 1000,
+				    Beacon::SumMetric(metrics, &WorkerMetrics::kernel_drops)));
+
+	last_datagrams = datagrams;
+	last_fixes = fixes;
+
+	status_timer.Schedule(STATUS_INTERVAL);
+}
+
+bool
+Instance::CheckWorkers() const noexcept
+{
+	const auto max_age = std::max<Event::Duration>(watchdog_timeout / 2,
+						      MIN_STUCK_DURATION);
+	const auto now = Event::Clock::now();
+
+	bool result = true;
+	unsigned i = 0;
+	for (const auto &worker : workers) {
+		const auto age = now - worker.GetHeartbeat();
+		if (age > max_age) {
+			fmt::print(stderr, "Worker {} is stuck for {} seconds\n", i,
+				   std::chrono::duration_cast<std::chrono::seconds>(age).count());
+			result = false;
+		}
+
+		++i;
+	}
+
+	return result;
+}
+
+void
+Instance::OnWatchdogTimer() noexcept
+{
+	/* this timer firing proves that the main thread is alive;
+	   if a worker is stuck, stop sending pings and let systemd
+	   restart the service */
+	if (CheckWorkers())
+		sd_notify(0, "WATCHDOG=1");
+
+	watchdog_timer.Schedule(watchdog_timeout / 2);
+}
+
+#endif
+
+void
+Instance::OnShutdown() noexcept
+{
+	/* closing the write end wakes up all workers at once */
+	quit_w.Close();
+
+#ifdef HAVE_LIBSYSTEMD
+	/* the workers stop updating their heartbeats now; systemd
+	   does not apply the watchdog while the service is
+	   stopping */
+	watchdog_timer.Cancel();
 #endif
+}
+
+void
+Instance::HandOver() noexcept
+{
+	/* the workers have stopped using their writers, but wait
+	   for them to exit completely */
+	for (auto &i : workers)
+		i.Join();
+
+	try {
+		std::vector<Beacon::JournalRecord> records;
+		for (auto &i : workers)
+			i.GetWriter().ExportQueued(records);
+
+		Beacon::Handover::Give(handover_peer, sockets, records);
+
+		/* the new process has confirmed; don't replay these
+		   fixes from our journals */
+		for (auto &i : workers)
+			i.GetWriter().DiscardQueued();
+
+		fmt::print(stderr, "Handed over {} sockets and {} queued fixes\n",
+			   sockets.size(), records.size());
+
+#ifdef HAVE_LIBSYSTEMD
+		/* the service continues in the new process; this is
+		   only accepted if it was launched inside the
+		   service (e.g. by OnReload()) */
+		sd_notifyf(0, "MAINPID=%d", (int)handover_peer_pid);
+#endif
+	} catch (...) {
+		PrintException(std::current_exception());
+	}
+
+	/* this tells the new process that it can open our journal
+	   files now */
+	handover_peer.Close();
+}
+
+void
+Instance::OnHandoverConnect(unsigned) noexcept
+{
+	UniqueSocketDescriptor fd{AdoptTag{}, handover_listener.GetSocket().AcceptNonBlock()};
+	if (!fd.IsDefined())
+		return;
+
+	if (!Beacon::Handover::CheckPeer(fd)) {
+		fmt::print(stderr, "Handover refused: peer is a different user\n");
+		return;
+	}
+
+	handover_peer_pid = fd.GetPeerCredentials().GetPid();
+
+	fmt::print(stderr, "Handing over to a new process\n");
+
+	handover_peer = std::move(fd);
+
+	/* the new process will listen on this path (and maybe on
+	   our metrics address) */
+	handover_listener.Close();
+	reload_listener.Disable();
+	metrics_server.reset();
+
+	OnShutdown();
+}
+
+/**
+ * Launch a new process with our command line; it takes over via
+ * ReceiverConfig::handover_path.  This runs the executable found at
+ * argv[0] now, i.e. after a package upgrade, the new version.
+ *
+ * Throws on error.
+ */
+static pid_t
+SpawnSuccessor(char *const*argv)
+{
+	/* the new process shall ping the systemd watchdog
+	   (WATCHDOG_USEC is inherited), but sd_watchdog_enabled()
+	   ignores it if WATCHDOG_PID names another process */
+	std::vector<char *> env;
+	for (char **i = environ; *i != nullptr; ++i)
+		if (!std::string_view{*i}.starts_with("WATCHDOG_PID="))
+			env.push_back(*i);
+	env.push_back(nullptr);
+
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	AtScopeExit(&attr) { posix_spawnattr_destroy(&attr); };
+
+	/* don't inherit the signals blocked for our signalfds */
+	sigset_t mask;
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+	/* some of our descriptors (e.g. the duplicates passed to
+	   the workers) lack O_CLOEXEC; the new process needs only
+	   stdin/stdout/stderr, and an inherited "done" pipe would
+	   keep us from ever exiting */
+	posix_spawn_file_actions_t file_actions;
+	posix_spawn_file_actions_init(&file_actions);
+	AtScopeExit(&file_actions) { posix_spawn_file_actions_destroy(&file_actions); };
+	posix_spawn_file_actions_addclosefrom_np(&file_actions, 3);
+
+	pid_t pid;
+	if (int error = posix_spawnp(&pid, argv[0], &file_actions, &attr,
+				     argv, env.data());
+	    error != 0)
+		throw MakeErrno(error, FmtBuffer<512>("Failed to execute {}", argv[0]));
+
+	return pid;
+}
+
+void
+Instance::OnReload(int) noexcept
+{
+	if (successor > 0) {
+		int status;
+		const pid_t pid = waitpid(successor, &status, WNOHANG);
+		if (pid == 0) {
+			fmt::print(stderr, "Reload ignored: process {} is still taking over\n",
+				   successor);
+			return;
+		}
+
+		if (pid > 0)
+			fmt::print(stderr, "Process {} has failed to take over (status {})\n",
+				   successor, status);
+
+		successor = -1;
+	}
+
+	try {
+		successor = SpawnSuccessor(argv);
+		fmt::print(stderr, "Launched process {} to take over\n", successor);
+	} catch (...) {
+		PrintException(std::current_exception());
+	}
+}
+
+void
+Instance::OnWorkersDone(unsigned) noexcept
+{
+	/* all workers have closed their end of the "done" pipe */
+	done_event.Cancel();
+
+	if (handover_peer.IsDefined())
+		HandOver();
+
+	shutdown_listener.Disable();
+	event_loop.Break();
+}
+
+int
+main(int argc, char **argv) noexcept
+try {
+	Beacon::ReceiverConfig config;
+	Beacon::ParseCommandLine(config, argc, argv);
 
+	Instance instance(config, argv);
 	instance.Run();
 
 	return EXIT_SUCCESS;
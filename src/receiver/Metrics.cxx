@@ -0,0 +1,344 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "Metrics.hxx"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <string_view>
+
+namespace Beacon {
+
+void
+DurationHistogram::Add(Event::Duration d) noexcept
+{
+	const auto i = std::lower_bound(BOUNDS.begin(), BOUNDS.end(), d);
+	++buckets[std::distance(BOUNDS.begin(), i)];
+	sum += d;
+}
+
+void
+SharedHistogram::Store(const DurationHistogram &src) noexcept
+{
+	for (std::size_t i = 0; i < buckets.size(); ++i)
+		buckets[i].Set(src.buckets[i]);
+
+	sum_us.Set(std::chrono::duration_cast<std::chrono::microseconds>(src.sum).count());
+}
+
+uint64_t
+SumMetric(std::span<const WorkerMetrics *const> workers,
+	  SharedValue WorkerMetrics::*value) noexcept
+{
+	uint64_t sum = 0;
+	for (const auto *i : workers)
+		sum += (i->*value).Get();
+	return sum;
+}
+
+uint64_t
+MaxMetric(std::span<const WorkerMetrics *const> workers,
+	  SharedValue WorkerMetrics::*value) noexcept
+{
+	uint64_t max = 0;
+	for (const auto *i : workers)
+		max = std::max(max, (i->*value).Get());
+	return max;
+}
+
+namespace {
+
+struct MetricDescription {
+	const char *name;
+	const char *type;
+
+	/**
+	 * nullptr if this is another sample of the previous
+	 * metric, which only differs in #labels.
+	 */
+	const char *help;
+
+	/**
+	 * An optional label set (e.g. <tt>reason="bad_crc"</tt>).
+	 */
+	const char *labels;
+
+	SharedValue WorkerMetrics::*value;
+
+	enum class Kind : uint8_t {
+		/**
+		 * The sum of all workers is exported.
+		 */
+		SUM,
+
+		/**
+		 * Like #SUM, but the value is in microseconds and
+		 * is exported in seconds.
+		 */
+		SUM_US,
+
+		/**
+		 * A duration in microseconds, exported in seconds.
+		 * Durations of different workers are not additive,
+		 * so the maximum is exported instead of the sum.
+		 */
+		MAX_US,
+	} kind = Kind::SUM;
+};
+
+struct HistogramDescription {
+	const char *name;
+	const char *help;
+	SharedHistogram WorkerMetrics::*value;
+};
+
+} // anonymous namespace
+
+static constexpr MetricDescription metrics[] = {
+	{"beacon_receiver_datagrams_total", "counter",
+	 "Datagrams received", nullptr, &WorkerMetrics::datagrams},
+	{"beacon_receiver_pings_total", "counter",
+	 "PING packets received", nullptr, &WorkerMetrics::pings},
+	{"beacon_receiver_fixes_total", "counter",
+	 "Valid fixes received (including those in batches)", nullptr,
+	 &WorkerMetrics::fixes},
+	{"beacon_receiver_fix_batches_total", "counter",
+	 "FIX_BATCH packets received", nullptr, &WorkerMetrics::batches},
+
+	{"beacon_receiver_rejected_datagrams_total", "counter",
+	 "Datagrams discarded by userspace checks", "reason=\"flood\"",
+	 &WorkerMetrics::rejected_flood},
+	{"beacon_receiver_rejected_datagrams_total", "counter",
+	 nullptr, "reason=\"too_short\"",
+	 &WorkerMetrics::rejected_too_short},
+	{"beacon_receiver_rejected_datagrams_total", "counter",
+	 nullptr, "reason=\"bad_magic\"",
+	 &WorkerMetrics::rejected_bad_magic},
+	{"beacon_receiver_rejected_datagrams_total", "counter",
+	 nullptr, "reason=\"bad_type\"",
+	 &WorkerMetrics::rejected_bad_type},
+	{"beacon_receiver_rejected_datagrams_total", "counter",
+	 nullptr, "reason=\"bad_crc\"",
+	 &WorkerMetrics::rejected_bad_crc},
+	{"beacon_receiver_rejected_datagrams_total", "counter",
+	 nullptr, "reason=\"bad_batch\"",
+	 &WorkerMetrics::rejected_bad_batch},
+	{"beacon_receiver_rejected_datagrams_total", "counter",
+	 nullptr, "reason=\"bad_time\"",
+	 &WorkerMetrics::rejected_bad_time},
+
+	{"beacon_receiver_kernel_dropped_datagrams_total", "counter",
+	 "Datagrams dropped by the kernel because the receive buffer was full",
+	 nullptr, &WorkerMetrics::kernel_drops},
+
+	{"beacon_receiver_filtered_fixes_total", "counter",
+	 "Fixes discarded by the per-key filter", "reason=\"duplicate\"",
+	 &WorkerMetrics::filtered_duplicate},
+	{"beacon_receiver_filtered_fixes_total", "counter",
+	 nullptr, "reason=\"over_rate\"",
+	 &WorkerMetrics::filtered_over_rate},
+	{"beacon_receiver_unfiltered_fixes_total", "counter",
+	 "Fixes accepted without filtering because the key table was full",
+	 nullptr, &WorkerMetrics::unfiltered},
+
+	{"beacon_receiver_flooding_sources_total", "counter",
+	 "Source addresses which have exceeded the datagram rate limit",
+	 nullptr, &WorkerMetrics::flooding_sources},
+	{"beacon_receiver_unknown_key_requests_total", "counter",
+	 "Requests with keys which are not in the \"keys\" table",
+	 nullptr, &WorkerMetrics::unknown_keys},
+
+	{"beacon_receiver_committed_fixes_total", "counter",
+	 "Fixes confirmed by the database", nullptr,
+	 &WorkerMetrics::committed_fixes},
+	{"beacon_receiver_db_insert_errors_total", "counter",
+	 "Fixes rejected by the database plus failed batches which were sent again", nullptr,
+	 &WorkerMetrics::insert_errors},
+	{"beacon_receiver_db_reconnects_total", "counter",
+	 "Database connections reestablished after a failure", nullptr,
+	 &WorkerMetrics::reconnects},
+
+	{"beacon_receiver_ingest_fixes_total", "counter",
+	 "Fixes which did not make it from the ingest queue to the journal",
+	 "result=\"superseded\"", &WorkerMetrics::ingest_superseded},
+	{"beacon_receiver_ingest_fixes_total", "counter",
+	 nullptr, "result=\"dropped\"", &WorkerMetrics::ingest_dropped},
+
+	{"beacon_receiver_queue_depth", "gauge",
+	 "Fixes waiting for the database", nullptr,
+	 &WorkerMetrics::queue_depth},
+	{"beacon_receiver_db_latency_seconds", "gauge",
+	 "Moving average of the database latency (maximum of all workers)",
+	 nullptr, &WorkerMetrics::db_latency_us, MetricDescription::Kind::MAX_US},
+
+	{"beacon_receiver_loop_wakeups_total", "counter",
+	 "Number of times the event loops have finished waiting (requires --profile)",
+	 nullptr, &WorkerMetrics::loop_wakeups},
+	{"beacon_receiver_loop_seconds_total", "counter",
+	 "Time spent by the event loops (requires --profile)", "state=\"busy\"",
+	 &WorkerMetrics::loop_busy_us, MetricDescription::Kind::SUM_US},
+	{"beacon_receiver_loop_seconds_total", "counter",
+	 nullptr, "state=\"wait\"",
+	 &WorkerMetrics::loop_wait_us, MetricDescription::Kind::SUM_US},
+	{"beacon_receiver_loop_max_busy_seconds", "gauge",
+	 "Longest time an event loop was busy without checking for new events, since the previous update (requires --profile)",
+	 nullptr, &WorkerMetrics::loop_max_busy_us, MetricDescription::Kind::MAX_US},
+	{"beacon_receiver_timers_total", "counter",
+	 "Timer callbacks invoked (requires --profile)",
+	 nullptr, &WorkerMetrics::timers},
+	{"beacon_receiver_timer_delay_seconds_total", "counter",
+	 "Sum of the delays between the due time of timers and their invocation (requires --profile)",
+	 nullptr, &WorkerMetrics::timer_delay_us, MetricDescription::Kind::SUM_US},
+	{"beacon_receiver_timer_max_delay_seconds", "gauge",
+	 "Longest timer delay since the previous update (requires --profile)",
+	 nullptr, &WorkerMetrics::timer_max_delay_us, MetricDescription::Kind::MAX_US},
+};
+
+static constexpr HistogramDescription histograms[] = {
+	{"beacon_receiver_commit_latency_seconds",
+	 "Time between queueing a fix (usually right after receiving it) and the database confirming it",
+	 &WorkerMetrics::commit_latency},
+	{"beacon_receiver_db_statement_seconds",
+	 "Time between sending a batch to the database and receiving its result",
+	 &WorkerMetrics::statement_time},
+};
+
+static void
+FormatHistogram(std::string &out,
+		std::span<const WorkerMetrics *const> workers,
+		const HistogramDescription &h)
+{
+	fmt::format_to(std::back_inserter(out),
+		       "# HELP {0} {1}\n"
+		       "# TYPE {0} histogram\n",
+		       h.name, h.help);
+
+	/* Prometheus buckets are cumulative */
+	uint64_t count = 0;
+	for (std::size_t i = 0; i < DurationHistogram::BOUNDS.size() + 1; ++i) {
+		for (const auto *w : workers)
+			count += (w->*h.value).buckets[i].Get();
+
+		if (i < DurationHistogram::BOUNDS.size())
+			fmt::format_to(std::back_inserter(out),
+				       "{}_bucket{{le=\"{}\"}} {}\n", h.name,
+				       std::chrono::duration<double>{DurationHistogram::BOUNDS[i]}.count(),
+				       count);
+		else
+			fmt::format_to(std::back_inserter(out),
+				       "{}_bucket{{le=\"+Inf\"}} {}\n", h.name,
+				       count);
+	}
+
+	uint64_t sum_us = 0;
+	for (const auto *w : workers)
+		sum_us += (w->*h.value).sum_us.Get();
+
+	fmt::format_to(std::back_inserter(out),
+		       "{0}_sum {1}\n"
+		       "{0}_count {2}\n",
+		       h.name, sum_us / 1e6, count);
+}
+
+/**
+ * Append a string to a Prometheus label value, escaping special
+ * characters.
+ */
+static void
+AppendLabelValue(std::string &out, std::string_view value)
+{
+	for (const char ch : value) {
+		switch (ch) {
+		case '\\':
+		case '"':
+			out.push_back('\\');
+			out.push_back(ch);
+			break;
+
+		case '\n':
+			out.append("\\n");
+			break;
+
+		default:
+			out.push_back(ch);
+		}
+	}
+}
+
+static void
+FormatSlowest(std::string &out, std::span<const WorkerMetrics *const> workers)
+{
+	/* merge the lists of all workers (the maximum per
+	   function) */
+	std::map<uint64_t, uint64_t> slowest;
+	for (const auto *w : workers) {
+		for (std::size_t i = 0; i < LoopProfiler::N_SLOWEST; ++i) {
+			const uint64_t duration_us = w->slowest_duration_us[i].Get();
+			if (duration_us == 0)
+				continue;
+
+			auto &value = slowest[w->slowest_function[i].Get()];
+			value = std::max(value, duration_us);
+		}
+	}
+
+	if (slowest.empty())
+		return;
+
+	out.append("# HELP beacon_receiver_slowest_callback_seconds Longest invocation of the slowest event loop callbacks (requires --profile)\n"
+		   "# TYPE beacon_receiver_slowest_callback_seconds gauge\n");
+
+	for (const auto &[function, duration_us] : slowest) {
+		out.append("beacon_receiver_slowest_callback_seconds{function=\"");
+		AppendLabelValue(out, LoopProfiler::GetFunctionName(reinterpret_cast<const void *>(function)));
+		fmt::format_to(std::back_inserter(out), "\"}} {}\n",
+			       duration_us / 1e6);
+	}
+}
+
+std::string
+FormatMetrics(std::span<const WorkerMetrics *const> workers)
+{
+	std::string out;
+
+	for (const auto &i : metrics) {
+		if (i.help != nullptr)
+			fmt::format_to(std::back_inserter(out),
+				       "# HELP {0} {1}\n"
+				       "# TYPE {0} {2}\n",
+				       i.name, i.help, i.type);
+
+		out += i.name;
+		if (i.labels != nullptr)
+			fmt::format_to(std::back_inserter(out), "{{{}}}", i.labels);
+
+		switch (i.kind) {
+		case MetricDescription::Kind::SUM:
+			fmt::format_to(std::back_inserter(out), " {}\n",
+				       SumMetric(workers, i.value));
+			break;
+
+		case MetricDescription::Kind::SUM_US:
+			fmt::format_to(std::back_inserter(out), " {}\n",
+				       SumMetric(workers, i.value) / 1e6);
+			break;
+
+		case MetricDescription::Kind::MAX_US:
+			fmt::format_to(std::back_inserter(out), " {}\n",
+				       MaxMetric(workers, i.value) / 1e6);
+			break;
+		}
+	}
+
+	for (const auto &i : histograms)
+		FormatHistogram(out, workers, i);
+
+	FormatSlowest(out, workers);
+
+	return out;
+}
+
+} /* namespace Beacon */
@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "event/Chrono.hxx"
+#include "event/LoopProfiler.hxx"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace Beacon {
+
+/**
+ * A histogram of durations with fixed buckets.  Recording a sample
+ * is cheap and never allocates.
+ *
+ * This class is not thread-safe; see #SharedHistogram.
+ */
+struct DurationHistogram {
+	/**
+	 * The upper bounds of the buckets; the last bucket
+	 * ("+Inf") has none.
+	 */
+	static constexpr std::array<std::chrono::milliseconds, 13> BOUNDS{
+		std::chrono::milliseconds{1},
+		std::chrono::milliseconds{2},
+		std::chrono::milliseconds{5},
+		std::chrono::milliseconds{10},
+		std::chrono::milliseconds{20},
+		std::chrono::milliseconds{50},
+		std::chrono::milliseconds{100},
+		std::chrono::milliseconds{200},
+		std::chrono::milliseconds{500},
+		std::chrono::seconds{1},
+		std::chrono::seconds{2},
+		std::chrono::seconds{5},
+		std::chrono::seconds{10},
+	};
+
+	/**
+	 * The number of samples in each bucket (not cumulative).
+	 */
+	std::array<uint64_t, BOUNDS.size() + 1> buckets{};
+
+	/**
+	 * The sum of all samples.
+	 */
+	Event::Duration sum{};
+
+	void Add(Event::Duration d) noexcept;
+};
+
+/**
+ * A value which is written by one thread and may be read by other
+ * threads at any time.
+ */
+class SharedValue {
+	std::atomic_uint64_t value{0};
+
+public:
+	void Set(uint64_t _value) noexcept {
+		value.store(_value, std::memory_order_relaxed);
+	}
+
+	uint64_t Get() const noexcept {
+		return value.load(std::memory_order_relaxed);
+	}
+};
+
+/**
+ * A copy of a #DurationHistogram which may be read by other
+ * threads.
+ */
+struct SharedHistogram {
+	std::array<SharedValue, DurationHistogram::BOUNDS.size() + 1> buckets;
+
+	/**
+	 * The sum of all samples in microseconds.
+	 */
+	SharedValue sum_us;
+
+	void Store(const DurationHistogram &src) noexcept;
+};
+
+/**
+ * The statistics of one worker thread.  The worker copies its
+ * (non-atomic) counters here periodically, so the hot path never
+ * pays for atomic operations and other threads can read them
+ * without locking.  Each value is consistent by itself, but the
+ * whole set is not a consistent snapshot.
+ */
+struct WorkerMetrics {
+	SharedValue datagrams, pings, fixes, batches;
+
+	SharedValue rejected_flood, rejected_too_short, rejected_bad_magic,
+		rejected_bad_type, rejected_bad_crc, rejected_bad_batch,
+		rejected_bad_time;
+
+	/**
+	 * Datagrams dropped by the kernel because the receive
+	 * buffer was full.
+	 */
+	SharedValue kernel_drops;
+
+	SharedValue filtered_duplicate, filtered_over_rate, unfiltered;
+
+	SharedValue flooding_sources;
+
+	SharedValue unknown_keys;
+
+	SharedValue committed_fixes, insert_errors, reconnects;
+
+	SharedValue ingest_superseded, ingest_dropped;
+
+	/**
+	 * The number of fixes waiting for the database (a gauge).
+	 */
+	SharedValue queue_depth;
+
+	/**
+	 * The moving average of the database latency in
+	 * microseconds (a gauge).
+	 */
+	SharedValue db_latency_us;
+
+	/**
+	 * The time between appending a fix to the journal and the
+	 * database confirming it.
+	 */
+	SharedHistogram commit_latency;
+
+	/**
+	 * The time between sending a batch to the database and
+	 * receiving its result.
+	 */
+	SharedHistogram statement_time;
+
+	/**
+	 * #EventLoop statistics from the #LoopProfiler (only if
+	 * profiling is enabled); durations in microseconds.
+	 */
+	SharedValue loop_wakeups, loop_busy_us, loop_wait_us;
+	SharedValue timers, timer_delay_us;
+
+	/**
+	 * The longest busy period and the longest timer delay
+	 * since the previous update (gauges).
+	 */
+	SharedValue loop_max_busy_us, timer_max_delay_us;
+
+	/**
+	 * The slowest callbacks (see LoopProfiler::Stats::slowest):
+	 * function addresses and durations in microseconds.
+	 */
+	std::array<SharedValue, LoopProfiler::N_SLOWEST> slowest_function,
+		slowest_duration_us;
+};
+
+/**
+ * Returns the sum of one value of all workers.
+ */
+[[gnu::pure]]
+uint64_t
+SumMetric(std::span<const WorkerMetrics *const> workers,
+	  SharedValue WorkerMetrics::*value) noexcept;
+
+/**
+ * Returns the maximum of one value of all workers.
+ */
+[[gnu::pure]]
+uint64_t
+MaxMetric(std::span<const WorkerMetrics *const> workers,
+	  SharedValue WorkerMetrics::*value) noexcept;
+
+/**
+ * Format the sum of all workers' metrics in the Prometheus text
+ * exposition format.
+ */
+std::string
+FormatMetrics(std::span<const WorkerMetrics *const> workers);
+
+} /* namespace Beacon */
@@ -0,0 +1,278 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "MetricsServer.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+#include "net/AddressInfo.hxx"
+#include "net/LocalSocketAddress.hxx"
+#include "net/Resolver.hxx"
+#include "net/SocketError.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/PrintException.hxx"
+#include "util/SpanCast.hxx"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstring>
+#include <string_view>
+
+#include <netdb.h>
+#include <unistd.h>
+
+namespace Beacon {
+
+/**
+ * Connections beyond this number are refused.
+ */
+static constexpr std::size_t MAX_CONNECTIONS = 16;
+
+/**
+ * Close connections which have not completed after this duration.
+ */
+static constexpr Event::Duration CONNECTION_TIMEOUT = std::chrono::seconds{10};
+
+class MetricsServer::Connection final : public AutoUnlinkIntrusiveListHook {
+	MetricsServer &server;
+
+	SocketEvent event;
+
+	CoarseTimerEvent timeout;
+
+	/**
+	 * The request received so far.
+	 */
+	std::array<char, 2048> request;
+	std::size_t request_length = 0;
+
+	/**
+	 * The response (after the request has been received
+	 * completely) and the number of bytes already sent.
+	 */
+	std::string response;
+	std::size_t response_position = 0;
+
+public:
+	Connection(MetricsServer &_server, EventLoop &event_loop,
+		   UniqueSocketDescriptor &&fd) noexcept
+		:server(_server),
+		 event(event_loop, BIND_THIS_METHOD(OnSocketReady), fd.Release()),
+		 timeout(event_loop, BIND_THIS_METHOD(OnTimeout))
+	{
+		event.ScheduleRead();
+		timeout.Schedule(CONNECTION_TIMEOUT);
+	}
+
+	~Connection() noexcept {
+		event.Close();
+	}
+
+	Connection(const Connection &) = delete;
+	Connection &operator=(const Connection &) = delete;
+
+	void Destroy() noexcept {
+		delete this;
+	}
+
+private:
+	/**
+	 * @return false if the connection shall be closed
+	 */
+	bool OnReadable() noexcept;
+
+	/**
+	 * Send (more of) the response.
+	 *
+	 * @return false if the connection shall be closed
+	 */
+	bool OnWritable() noexcept;
+
+	void OnRequest() noexcept;
+
+	void OnSocketReady(unsigned events) noexcept;
+
+	void OnTimeout() noexcept {
+		Destroy();
+	}
+};
+
+/**
+ * Has the (possibly incomplete) request been received completely,
+ * i.e. does it contain an empty line?
+ */
+[[gnu::pure]]
+static bool
+IsRequestComplete(std::string_view request) noexcept
+{
+	return request.find("\r\n\r\n") != request.npos ||
+		request.find("\n\n") != request.npos;
+}
+
+static std::string
+MakeResponse(std::string_view status, std::string_view content_type,
+	     std::string_view body)
+{
+	std::string response = fmt::format("HTTP/1.1 {}\r\n"
+					   "Content-Type: {}\r\n"
+					   "Content-Length: {}\r\n"
+					   "Connection: close\r\n"
+					   "\r\n",
+					   status, content_type, body.size());
+	response.append(body);
+	return response;
+}
+
+inline void
+MetricsServer::Connection::OnRequest() noexcept
+{
+	const std::string_view r{request.data(), request_length};
+
+	try {
+		if (r.starts_with("GET "))
+			response = MakeResponse("200 OK",
+						"text/plain; version=0.0.4; charset=utf-8",
+						server.callback());
+		else
+			response = MakeResponse("405 Method Not Allowed",
+						"text/plain", "Method not allowed\n");
+	} catch (...) {
+		PrintException(std::current_exception());
+		response = MakeResponse("500 Internal Server Error",
+					"text/plain", "Internal server error\n");
+	}
+}
+
+inline bool
+MetricsServer::Connection::OnReadable() noexcept
+{
+	const auto nbytes = event.GetSocket().Receive(std::as_writable_bytes(std::span{request}.subspan(request_length)));
+	if (nbytes < 0)
+		return IsSocketErrorReceiveWouldBlock(GetSocketError());
+
+	if (nbytes == 0)
+		/* the client has closed the connection */
+		return false;
+
+	request_length += nbytes;
+
+	if (!IsRequestComplete({request.data(), request_length}))
+		/* need more data; give up if the buffer is full */
+		return request_length < request.size();
+
+	OnRequest();
+
+	event.CancelRead();
+	event.ScheduleWrite();
+	return true;
+}
+
+inline bool
+MetricsServer::Connection::OnWritable() noexcept
+{
+	const auto nbytes = event.GetSocket().Send(AsBytes(std::string_view{response}.substr(response_position)));
+	if (nbytes < 0)
+		return IsSocketErrorSendWouldBlock(GetSocketError());
+
+	response_position += nbytes;
+
+	/* close the connection after the whole response has been
+	   sent */
+	return response_position < response.size();
+}
+
+void
+MetricsServer::Connection::OnSocketReady(unsigned events) noexcept
+{
+	if (events & SocketEvent::ERROR) {
+		Destroy();
+		return;
+	}
+
+	if ((events & SocketEvent::READ) && !OnReadable()) {
+		Destroy();
+		return;
+	}
+
+	if ((events & SocketEvent::WRITE) && !OnWritable()) {
+		Destroy();
+		return;
+	}
+
+	if (events & SocketEvent::HANGUP)
+		Destroy();
+}
+
+MetricsServer::MetricsServer(EventLoop &event_loop,
+			     UniqueSocketDescriptor &&socket,
+			     Callback _callback) noexcept
+	:listener(event_loop, BIND_THIS_METHOD(OnAccept), socket.Release()),
+	 callback(_callback)
+{
+	listener.ScheduleRead();
+}
+
+MetricsServer::~MetricsServer() noexcept
+{
+	connections.clear_and_dispose([](Connection *c){ c->Destroy(); });
+	listener.Close();
+}
+
+static UniqueSocketDescriptor
+CreateListener(SocketAddress address)
+{
+	UniqueSocketDescriptor fd;
+	if (!fd.CreateNonBlock(address.GetFamily(), SOCK_STREAM, 0))
+		throw MakeSocketError("Failed to create socket");
+
+	if (address.GetFamily() != AF_LOCAL && !fd.SetReuseAddress())
+		throw MakeSocketError("Failed to set SO_REUSEADDR");
+
+	if (!fd.Bind(address))
+		throw MakeSocketError("Failed to bind socket");
+
+	if (!fd.Listen(16))
+		throw MakeSocketError("Failed to listen");
+
+	return fd;
+}
+
+UniqueSocketDescriptor
+MetricsServer::CreateSocket(const char *address)
+{
+	if (*address == '/' || *address == '@') {
+		if (strlen(address) > LocalSocketAddress::MAX_LENGTH)
+			throw FmtRuntimeError("Socket path too long: '{}'", address);
+
+		if (*address == '/')
+			/* delete the socket left by a previous
+			   instance */
+			unlink(address);
+
+		return CreateListener(LocalSocketAddress{address});
+	}
+
+	const auto ai = Resolve(address, 0, AI_PASSIVE, SOCK_STREAM);
+	const SocketAddress best = ai.GetBest();
+	if (best.GetPort() == 0)
+		throw FmtRuntimeError("No port in metrics address: '{}'", address);
+
+	return CreateListener(best);
+}
+
+void
+MetricsServer::OnAccept(unsigned) noexcept
+{
+	UniqueSocketDescriptor fd{AdoptTag{}, listener.GetSocket().AcceptNonBlock()};
+	if (!fd.IsDefined())
+		return;
+
+	if (connections.size() >= MAX_CONNECTIONS)
+		/* refuse by closing it right away */
+		return;
+
+	auto *c = new Connection(*this, listener.GetEventLoop(), std::move(fd));
+	connections.push_back(*c);
+}
+
+} /* namespace Beacon */
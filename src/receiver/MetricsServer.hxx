@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "event/SocketEvent.hxx"
+#include "util/BindMethod.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <string>
+
+class UniqueSocketDescriptor;
+
+namespace Beacon {
+
+/**
+ * A minimal HTTP server which responds to every GET request with
+ * the metrics in the Prometheus text exposition format.  Each
+ * connection serves exactly one request.
+ */
+class MetricsServer {
+public:
+	/**
+	 * Generates the response body.  May throw.
+	 */
+	using Callback = BoundMethod<std::string()>;
+
+private:
+	class Connection;
+
+	SocketEvent listener;
+
+	const Callback callback;
+
+	IntrusiveList<Connection> connections;
+
+public:
+	/**
+	 * @param socket a listening stream socket (see
+	 * CreateSocket())
+	 */
+	MetricsServer(EventLoop &event_loop, UniqueSocketDescriptor &&socket,
+		      Callback _callback) noexcept;
+	~MetricsServer() noexcept;
+
+	MetricsServer(const MetricsServer &) = delete;
+	MetricsServer &operator=(const MetricsServer &) = delete;
+
+	/**
+	 * Create a listening stream socket.
+	 *
+	 * Throws on error.
+	 *
+	 * @param address an absolute path of a local socket (which
+	 * is deleted first if it exists), '@' followed by an
+	 * abstract socket name or "HOST:PORT"
+	 */
+	static UniqueSocketDescriptor CreateSocket(const char *address);
+
+private:
+	void OnAccept(unsigned events) noexcept;
+};
+
+} /* namespace Beacon */
@@ -5,6 +5,7 @@
 
 #include "util/ByteOrder.hxx"
 
+#include <cstddef>
 #include <limits>
 
 #include <stdint.h>
@@ -36,6 +37,8 @@ enum class RequestType : uint16_t {
 	NOP = 0,
 	PING = 1,
 	FIX = 2,
+	FIX_BATCH = 3,
+	TIMED_FIX = 4,
 };
 
 enum class ResponseType : uint16_t {
@@ -187,6 +190,112 @@ struct FixPacket {
 
 static_assert(sizeof(FixPacket) == 32);
 
+/**
+ * A GPS fix with the time it was taken (#TIMED_FIX).  Clients use
+ * this instead of #FIX if they have a reliable clock (e.g. GPS
+ * time), which allows them to queue fixes while offline and send
+ * them later.  The server discards fixes whose time is too far in
+ * the future or in the past.
+ */
+struct TimedFixPacket {
+	/**
+	 * The fix; its header type is #TIMED_FIX.
+	 */
+	FixPacket fix;
+
+	/**
+	 * The time of the fix in milliseconds since the Unix epoch
+	 * (UTC).
+	 */
+	uint64_t time;
+
+	TimedFixPacket() = default;
+
+	explicit TimedFixPacket(uint64_t key)
+		:fix(key), time(0) {
+		fix.header = Header{RequestType::TIMED_FIX, key};
+	}
+};
+
+static_assert(sizeof(TimedFixPacket) == 40);
+
+/**
+ * The maximum number of fixes in one #FixBatchPacket.  With this
+ * limit, the datagram fits into the minimum IPv4 MTU (576 bytes).
+ */
+static constexpr std::size_t MAX_BATCH_FIXES = 32;
+
+/**
+ * One fix in a #FixBatchPacket.  The attributes have the same
+ * meaning as in #FixPacket.
+ */
+struct FixBatchItem {
+	GeoPoint location;
+
+	uint16_t direction;
+
+	uint16_t speed;
+
+	int16_t altitude;
+
+	/**
+	 * The time between this fix and sending the packet in
+	 * seconds.  This is relative to the time of sending (not to
+	 * the client's clock), so the server can reconstruct the time
+	 * of each fix even if the client's clock is wrong, by
+	 * subtracting it from the time of reception.
+	 */
+	uint16_t age;
+};
+
+static_assert(sizeof(FixBatchItem) == 16);
+
+/**
+ * Several GPS fixes being submitted to the server at once (#FIX_BATCH),
+ * e.g. fixes which were buffered by the client to save power or
+ * while it was offline.  This header is followed by #count
+ * #FixBatchItem structs, oldest first.
+ *
+ * The server responds with #ACK (with the #id of this packet).  If
+ * the client does not receive the #ACK, it should send the same
+ * packet again; the server discards identical batches which arrive
+ * shortly after the first one.
+ */
+struct FixBatchPacket {
+	Header header;
+
+	/**
+	 * A sequence number chosen by the client, which is copied to
+	 * the #ACK.
+	 */
+	uint16_t id;
+
+	/**
+	 * The number of #FixBatchItem structs following this header
+	 * (1..#MAX_BATCH_FIXES).
+	 */
+	uint16_t count;
+
+	/**
+	 * Reserved for future use.  Set to zero.
+	 */
+	uint32_t reserved;
+
+	constexpr std::size_t GetSize() const noexcept {
+		return sizeof(*this) + FromBE16(count) * sizeof(FixBatchItem);
+	}
+
+	const FixBatchItem *GetItems() const noexcept {
+		return reinterpret_cast<const FixBatchItem *>(this + 1);
+	}
+
+	FixBatchItem *GetItems() noexcept {
+		return reinterpret_cast<FixBatchItem *>(this + 1);
+	}
+};
+
+static_assert(sizeof(FixBatchPacket) == 24);
+
 /**
  * A generic acknowledge packet sent by the server in response to
  * certain request packets.
@@ -195,21 +304,34 @@ struct AckPacket {
 	/**
 	 * The key was not valid.  Usually, requests with bad keys are
 	 * silently discarded, but the server may use this flag to respond
-	 * to a bad key in a PING packet.
+	 * to a bad key in a PING or FIX_BATCH packet.
 	 */
 	static const uint32_t FLAG_BAD_KEY = 0x1;
 
+	/**
+	 * The #interval field is valid.  Servers which don't
+	 * implement this flag set #interval to zero.
+	 */
+	static const uint32_t FLAG_INTERVAL = 0x2;
+
 	Header header;
 
 	/**
-	 * Copy of the request's id value.
+	 * Copy of the request's id value (#PingPacket::id or
+	 * #FixBatchPacket::id).
 	 */
 	uint16_t id;
 
 	/**
-	 * Reserved for future use.  Set to zero.
+	 * The minimum interval between two #FIX packets (of this
+	 * key) in seconds which the server recommends, depending on
+	 * its current load.  Clients should not send fixes more
+	 * often than this until the next #ACK; they may return to
+	 * their own (shorter) interval when the server recommends
+	 * a shorter one.  Only valid if #FLAG_INTERVAL is set;
+	 * otherwise zero.
 	 */
-	uint16_t reserved;
+	uint16_t interval;
 
 	uint32_t flags;
 };
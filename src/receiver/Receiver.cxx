@@ -3,40 +3,150 @@
 
 #include "Receiver.hxx"
 #include "Assemble.hxx"
-#include "Protocol.hxx"
+#include "FloodFilter.hxx"
 #include "Import.hxx"
+#include "Protocol.hxx"
 #include "net/SocketError.hxx"
 #include "net/UniqueSocketDescriptor.hxx"
 #include "util/ByteOrder.hxx"
 #include "util/CRC.hxx"
 
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+
+#include <linux/filter.h>
+#include <sys/socket.h>
+
 namespace Beacon {
 
 namespace P = Beacon::Protocol;
 
-static UniqueSocketDescriptor
-CreateBindDatagramSocket(SocketAddress address)
+/**
+ * The maximum size of a datagram we accept.  Larger ones are
+ * discarded by #MultiReceiveMessage.
+ */
+static constexpr std::size_t MAX_DATAGRAM_SIZE = 1024;
+
+/**
+ * The maximum size of a reply which can be queued; this must fit
+ * all response packets.
+ */
+static constexpr std::size_t MAX_REPLY_SIZE = 64;
+
+/**
+ * The maximum number of fix packets whose CRCs are verified with
+ * one CalculateCRC16CCITT32() call.
+ */
+static constexpr std::size_t MAX_CRC_BATCH = 64;
+
+static_assert(sizeof(P::FixPacket) == 32,
+	      "CalculateCRC16CCITT32() requires 32-byte packets");
+
+/**
+ * The offset of the payload in the packet seen by socket filters on
+ * UDP sockets (which begins with the UDP header).
+ */
+static constexpr uint32_t BPF_PAYLOAD = 8;
+
+/**
+ * A classic BPF program which discards datagrams which are too
+ * small, have the wrong magic or an unknown type before they get
+ * queued on the socket.  The same checks are done again in
+ * userspace (see Receiver::CheckDatagram()), so this is only an
+ * optimization.
+ */
+static constexpr struct sock_filter receiver_filter[] = {
+	/* if (length < sizeof(Header)) drop */
+	BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+	BPF_JUMP(BPF_JMP|BPF_JGE|BPF_K, BPF_PAYLOAD + sizeof(P::Header), 0, 4),
+
+	/* if (header.magic != MAGIC) drop */
+	BPF_STMT(BPF_LD|BPF_W|BPF_ABS, BPF_PAYLOAD + offsetof(P::Header, magic)),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, P::MAGIC, 0, 2),
+
+	/* if (header.type > TIMED_FIX) drop */
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, BPF_PAYLOAD + offsetof(P::Header, type)),
+	BPF_JUMP(BPF_JMP|BPF_JGT|BPF_K, uint32_t(P::RequestType::TIMED_FIX), 0, 1),
+
+	/* drop */
+	BPF_STMT(BPF_RET|BPF_K, 0),
+
+	/* accept the whole datagram */
+	BPF_STMT(BPF_RET|BPF_K, 0xffffffff),
+};
+
+static void
+AttachFilter(SocketDescriptor fd)
+{
+	const struct sock_fprog program{
+		.len = std::size(receiver_filter),
+		.filter = const_cast<struct sock_filter *>(receiver_filter),
+	};
+
+	if (!fd.SetOption(SOL_SOCKET, SO_ATTACH_FILTER,
+			  &program, sizeof(program)))
+		throw MakeSocketError("Failed to attach socket filter");
+}
+
+void
+Receiver::SetupSocket(SocketDescriptor fd)
+{
+	AttachFilter(fd);
+
+	if (!fd.SetBoolOption(SOL_SOCKET, SO_TIMESTAMPNS, true))
+		throw MakeSocketError("Failed to set SO_TIMESTAMPNS");
+
+	if (!fd.SetBoolOption(SOL_SOCKET, SO_RXQ_OVFL, true))
+		throw MakeSocketError("Failed to set SO_RXQ_OVFL");
+}
+
+UniqueSocketDescriptor
+Receiver::CreateSocket(SocketAddress address, bool reuse_port)
 {
 	UniqueSocketDescriptor fd;
 	if (!fd.Create(address.GetFamily(), SOCK_DGRAM, 0))
 		throw MakeSocketError("Failed to create socket");
 
+	/* attach the filter before binding, so no datagram gets
+	   past it */
+	SetupSocket(fd);
+
+	if (reuse_port && !fd.SetReusePort())
+		throw MakeSocketError("Failed to set SO_REUSEPORT");
+
+	/* dual-stack: the IPv6 wildcard address accepts IPv4
+	   datagrams as well (as IPv4-mapped addresses) */
+	if (address.IsV6Any() && !fd.SetV6Only(false))
+		throw MakeSocketError("Failed to clear IPV6_V6ONLY");
+
 	if (!fd.Bind(address))
 		throw MakeErrno("Failed to bind socket");
 
 	return fd;
 }
 
-Receiver::Receiver(EventLoop &event_loop, SocketAddress address)
-	:socket(event_loop, CreateBindDatagramSocket(address), *this)
+Receiver::Receiver(EventLoop &event_loop, UniqueSocketDescriptor &&_socket,
+		   std::size_t batch_size, FloodFilter *_flood_filter,
+		   const ClockWindow &_clock_window)
+	:socket(event_loop, std::move(_socket),
+		MultiReceiveMessage{batch_size, MAX_DATAGRAM_SIZE},
+		MultiSendMessage{batch_size, MAX_REPLY_SIZE},
+		*this),
+	 flood_filter(_flood_filter),
+	 clock_window(_clock_window)
+{
+}
+
+Receiver::Receiver(EventLoop &event_loop, SocketAddress address,
+		   std::size_t batch_size)
+	:Receiver(event_loop, CreateSocket(address), batch_size)
 {
 }
 
 void
 Receiver::SendBuffer(SocketAddress address, std::span<const std::byte> src)
 {
-	// TODO: use async_send_to()?
-
 	try {
 		socket.Reply(address, src);
 	} catch (...) {
@@ -51,61 +161,299 @@ Receiver::OnPing(const Client &client, unsigned id) noexcept
 		   Beacon::Protocol::MakeAck(client.key, id, 0));
 }
 
-inline void
-Receiver::OnDatagramReceived(Client &&client,
-			     void *data, size_t length)
+inline bool
+Receiver::CheckSource(SocketAddress address) noexcept
 {
-	auto &header = *(P::Header *)data;
-	if (length < sizeof(header))
-		return;
+	if (flood_filter != nullptr && !flood_filter->Check(address)) {
+		++rejects.flood;
+		return false;
+	}
+
+	return true;
+}
+
+inline std::optional<P::RequestType>
+Receiver::CheckDatagram(std::span<const std::byte> payload) noexcept
+{
+	if (payload.size() < sizeof(P::Header)) {
+		++rejects.too_short;
+		return std::nullopt;
+	}
+
+	const auto &header = *(const P::Header *)payload.data();
+	if (header.magic != ToBE32(P::MAGIC)) {
+		++rejects.bad_magic;
+		return std::nullopt;
+	}
+
+	const auto type = P::RequestType(FromBE16(header.type));
+
+	std::size_t min_size;
+	switch (type) {
+	case P::RequestType::NOP:
+		min_size = sizeof(P::Header);
+		break;
+
+	case P::RequestType::PING:
+		min_size = sizeof(P::PingPacket);
+		break;
+
+	case P::RequestType::FIX:
+		min_size = sizeof(P::FixPacket);
+		break;
+
+	case P::RequestType::FIX_BATCH:
+		min_size = sizeof(P::FixBatchPacket);
+		break;
+
+	case P::RequestType::TIMED_FIX:
+		min_size = sizeof(P::TimedFixPacket);
+		break;
+
+	default:
+		++rejects.bad_type;
+		return std::nullopt;
+	}
+
+	if (payload.size() < min_size) {
+		++rejects.too_short;
+		return std::nullopt;
+	}
+
+	if (type == P::RequestType::FIX_BATCH) {
+		const auto &packet = *(const P::FixBatchPacket *)payload.data();
+		const std::size_t count = FromBE16(packet.count);
+		if (count == 0 || count > P::MAX_BATCH_FIXES) {
+			++rejects.bad_batch;
+			return std::nullopt;
+		}
+
+		if (payload.size() < packet.GetSize()) {
+			++rejects.too_short;
+			return std::nullopt;
+		}
+	}
+
+	return type;
+}
+
+inline bool
+Receiver::VerifyCRC(std::span<const std::byte> payload) noexcept
+{
+	const auto &header = *(const P::Header *)payload.data();
 
 	const uint16_t received_crc = FromBE16(header.crc);
-	header.crc = 0;
+	const uint16_t calculated_crc =
+		CalculateCRC16CCITTSkipField(payload.data(), payload.size(),
+					     offsetof(P::Header, crc));
+	if (received_crc != calculated_crc) {
+		++rejects.bad_crc;
+		return false;
+	}
+
+	return true;
+}
 
-	const uint16_t calculated_crc = UpdateCRC16CCITT(data, length, 0);
-	if (received_crc != calculated_crc)
+void
+Receiver::OnDatagramReceived(Client &&client,
+			     std::span<const std::byte> payload)
+{
+	const auto type = CheckDatagram(payload);
+	if (!type || !VerifyCRC(payload))
 		return;
 
-	client.key = FromBE64(header.key);
+	OnPacketReceived(std::move(client), *type, payload.data());
+}
 
-	const auto &ping = *(const P::PingPacket *)data;
-	const auto &fix = *(const P::FixPacket *)data;
+inline void
+Receiver::OnPacketReceived(Client &&client, P::RequestType type,
+			   const void *data)
+{
+	const auto &header = *(const P::Header *)data;
+	client.key = FromBE64(header.key);
 
-	switch (P::RequestType(FromBE16(header.type))) {
+	switch (type) {
 	case P::RequestType::NOP:
 		break;
 
 	case P::RequestType::PING:
-		if (length < sizeof(ping))
-			return;
-
-		OnPing(client, FromBE16(ping.id));
+		++requests.pings;
+		OnPing(client, FromBE16(((const P::PingPacket *)data)->id));
 		break;
 
 	case P::RequestType::FIX:
-		if (length < sizeof(fix))
-			return;
+		++requests.fixes;
+		OnFix(client, {client.time, P::ImportFix(*(const P::FixPacket *)data)});
+		break;
+
+	case P::RequestType::FIX_BATCH:
+		OnFixBatchPacket(client, *(const P::FixBatchPacket *)data);
+		break;
 
-		OnFix(client, ImportGeoPoint(fix.location));
+	case P::RequestType::TIMED_FIX:
+		OnTimedFixPacket(client, *(const P::TimedFixPacket *)data);
 		break;
 	}
 }
 
+inline void
+Receiver::OnTimedFixPacket(const Client &client,
+			   const P::TimedFixPacket &packet) noexcept
+{
+	const auto time = P::ImportTime(packet);
+	if (!clock_window.Check(time, client.time)) {
+		++rejects.bad_time;
+		return;
+	}
+
+	++requests.fixes;
+	OnFix(client, {std::chrono::system_clock::time_point{time},
+		       P::ImportFix(packet.fix)});
+}
+
+inline void
+Receiver::OnFixBatchPacket(const Client &client,
+			   const P::FixBatchPacket &packet) noexcept
+{
+	const std::size_t count = FromBE16(packet.count);
+	assert(count > 0);
+	assert(count <= P::MAX_BATCH_FIXES);
+
+	const auto *items = packet.GetItems();
+
+	TimedFix fixes[P::MAX_BATCH_FIXES];
+	for (std::size_t i = 0; i < count; ++i)
+		fixes[i] = {client.time - P::ImportAge(items[i]), P::ImportFix(items[i])};
+
+	++requests.batches;
+	requests.fixes += count;
+	OnFixBatch(client, FromBE16(packet.id), {fixes, count});
+}
+
+/**
+ * Returns the kernel receive time of a datagram or (if the kernel
+ * did not provide one) the current time.
+ */
+static std::chrono::system_clock::time_point
+GetReceiveTime(std::chrono::system_clock::time_point timestamp) noexcept
+{
+	return timestamp != std::chrono::system_clock::time_point{}
+		? timestamp
+		: std::chrono::system_clock::now();
+}
+
 bool
 Receiver::OnUdpDatagram(std::span<const std::byte> payload,
 			std::span<UniqueFileDescriptor>,
-			SocketAddress address, int)
+			SocketAddress address, int,
+			std::chrono::system_clock::time_point timestamp)
 {
-	// TODO: use recvmmsg() on Linux
+	++requests.datagrams;
+
+	if (!CheckSource(address))
+		return true;
 
 	Client client;
 	client.address = address;
-	OnDatagramReceived(std::move(client),
-			   const_cast<std::byte *>(payload.data()), // TOOD no const_cast, please
-			   payload.size());
+	client.time = GetReceiveTime(timestamp);
+	OnDatagramReceived(std::move(client), payload);
 	return true;
 }
 
+inline void
+Receiver::OnFixDatagrams(std::span<const MultiReceiveMessage::Datagram *const> datagrams)
+{
+	assert(datagrams.size() <= MAX_CRC_BATCH);
+
+	/* the number of bytes after the CRC field */
+	static constexpr std::size_t CRC_TAIL =
+		sizeof(P::FixPacket) - offsetof(P::Header, crc) - sizeof(P::Header::crc);
+
+	const void *buffers[MAX_CRC_BATCH]{};
+	uint16_t calculated_crcs[MAX_CRC_BATCH];
+
+	for (std::size_t i = 0; i < datagrams.size(); ++i)
+		buffers[i] = datagrams[i]->payload.data();
+
+	/* this includes the received CRC field; its contribution is
+	   removed below (instead of zeroing it in the buffer) */
+	CalculateCRC16CCITT32(buffers, datagrams.size(), calculated_crcs);
+
+	for (std::size_t i = 0; i < datagrams.size(); ++i) {
+		const auto &header = *(const P::Header *)buffers[i];
+		const uint16_t received_crc = FromBE16(header.crc);
+		if (received_crc != (calculated_crcs[i] ^
+				     CRC16CCITTFieldContribution(received_crc, CRC_TAIL))) {
+			++rejects.bad_crc;
+			continue;
+		}
+
+		Client client;
+		client.address = datagrams[i]->address;
+		client.time = GetReceiveTime(datagrams[i]->timestamp);
+		OnPacketReceived(std::move(client), P::RequestType::FIX,
+				 buffers[i]);
+	}
+}
+
+bool
+Receiver::OnUdpDatagrams(std::span<const MultiReceiveMessage::Datagram> datagrams)
+{
+	/* fix packets are the most common ones; their CRCs are
+	   verified in batches */
+	const MultiReceiveMessage::Datagram *batch[MAX_CRC_BATCH];
+	std::size_t n_batch = 0;
+
+	requests.datagrams += datagrams.size();
+
+	for (const auto &i : datagrams) {
+		if (!CheckSource(i.address))
+			continue;
+
+		const auto type = CheckDatagram(i.payload);
+		if (!type)
+			continue;
+
+		if (*type == P::RequestType::FIX &&
+		    i.payload.size() == sizeof(P::FixPacket)) {
+			batch[n_batch++] = &i;
+			if (n_batch == MAX_CRC_BATCH) {
+				OnFixDatagrams({batch, n_batch});
+				n_batch = 0;
+			}
+
+			continue;
+		}
+
+		/* handle the pending batch first to preserve the
+		   order */
+		if (n_batch > 0) {
+			OnFixDatagrams({batch, n_batch});
+			n_batch = 0;
+		}
+
+		if (!VerifyCRC(i.payload))
+			continue;
+
+		Client client;
+		client.address = i.address;
+		client.time = GetReceiveTime(i.timestamp);
+		OnPacketReceived(std::move(client), *type, i.payload.data());
+	}
+
+	if (n_batch > 0)
+		OnFixDatagrams({batch, n_batch});
+
+	return true;
+}
+
+void
+Receiver::OnUdpReplyError(SocketAddress address,
+			  std::exception_ptr &&error) noexcept
+{
+	OnSendError(address, std::move(error));
+}
+
 void
 Receiver::OnUdpError(std::exception_ptr &&error) noexcept
 {
@@ -3,30 +3,212 @@
 
 #pragma once
 
-#include "event/net/UdpListener.hxx"
+#include "event/net/MultiUdpListener.hxx"
 #include "event/net/UdpHandler.hxx"
 #include "net/SocketAddress.hxx"
 
+#include <chrono>
+#include <cstddef>
 #include <exception>
+#include <optional>
 #include <span>
 
 #include <stdint.h>
 
-struct GeoPoint;
+class UniqueSocketDescriptor;
 
 namespace Beacon {
 
+struct Fix;
+struct TimedFix;
+class FloodFilter;
+namespace Protocol {
+enum class RequestType : uint16_t;
+struct FixBatchPacket;
+struct TimedFixPacket;
+}
+
+/**
+ * The range of client-supplied fix times (#Protocol::TimedFixPacket)
+ * which are accepted, relative to the receive time.
+ */
+struct ClockWindow {
+	/**
+	 * How far a client's clock may be ahead of ours.
+	 */
+	std::chrono::seconds max_skew{30};
+
+	/**
+	 * How old a fix may be, i.e. how long a client may have
+	 * queued it.
+	 */
+	std::chrono::seconds max_age = std::chrono::hours{24};
+
+	/**
+	 * @param time the client-supplied time since the Unix epoch;
+	 * any value is allowed, and it may be converted to a
+	 * std::chrono::system_clock::time_point only if this
+	 * returns true
+	 */
+	constexpr bool Check(std::chrono::milliseconds time,
+			     std::chrono::system_clock::time_point received) const noexcept {
+		const auto r = std::chrono::duration_cast<std::chrono::milliseconds>(received.time_since_epoch());
+		return time <= r + max_skew && time >= r - max_age;
+	}
+};
+
 class Receiver : UdpHandler {
-	UdpListener socket;
+	MultiUdpListener socket;
+
+	/**
+	 * If not nullptr, then datagrams from sources which exceed
+	 * the rate limit are discarded before the CRC is verified.
+	 */
+	FloodFilter *const flood_filter;
+
+	const ClockWindow clock_window;
 
 public:
+	/**
+	 * The default number of datagrams received with one
+	 * recvmmsg() call.
+	 */
+	static constexpr std::size_t DEFAULT_BATCH_SIZE = 64;
+
 	struct Client {
 		SocketAddress address;
 		uint64_t key;
+
+		/**
+		 * The time the datagram was received (from the
+		 * kernel if available).
+		 */
+		std::chrono::system_clock::time_point time;
 	};
 
+	/**
+	 * Counters of datagrams which were discarded by userspace
+	 * checks, by reason.  Most malformed datagrams are discarded
+	 * by the socket filter already and are not counted here.
+	 */
+	struct RejectCounters {
+		/**
+		 * Smaller than the header or the packet type.
+		 */
+		uint64_t too_short = 0;
+
+		uint64_t bad_magic = 0;
+		uint64_t bad_type = 0;
+		uint64_t bad_crc = 0;
+
+		/**
+		 * A #Protocol::FixBatchPacket with no fixes or more
+		 * than #Protocol::MAX_BATCH_FIXES.
+		 */
+		uint64_t bad_batch = 0;
+
+		/**
+		 * A #Protocol::TimedFixPacket whose time is outside
+		 * the #ClockWindow.
+		 */
+		uint64_t bad_time = 0;
+
+		/**
+		 * The source has exceeded the #FloodFilter limit.
+		 */
+		uint64_t flood = 0;
+
+		uint64_t Total() const noexcept {
+			return too_short + bad_magic + bad_type + bad_crc + bad_batch +
+				bad_time + flood;
+		}
+	};
+
+	/**
+	 * Counters of datagrams received and of valid requests.
+	 */
+	struct RequestCounters {
+		/**
+		 * All datagrams received from the socket (before any
+		 * checks).
+		 */
+		uint64_t datagrams = 0;
+
+		uint64_t pings = 0;
+
+		/**
+		 * Valid fixes, including those from
+		 * #Protocol::FixBatchPacket and
+		 * #Protocol::TimedFixPacket.
+		 */
+		uint64_t fixes = 0;
+
+		uint64_t batches = 0;
+	};
+
+private:
+	RejectCounters rejects;
+
+	RequestCounters requests;
+
 public:
-	Receiver(EventLoop &event_loop, SocketAddress address);
+	/**
+	 * @param socket a bound datagram socket
+	 * @param batch_size the maximum number of datagrams received
+	 * with one system call
+	 * @param flood_filter an optional per-source rate limiter
+	 * (may be shared by several receivers in the same thread)
+	 * @param clock_window the accepted range of client-supplied
+	 * fix times
+	 */
+	Receiver(EventLoop &event_loop, UniqueSocketDescriptor &&socket,
+		 std::size_t batch_size=DEFAULT_BATCH_SIZE,
+		 FloodFilter *flood_filter=nullptr,
+		 const ClockWindow &clock_window=ClockWindow{});
+
+	Receiver(EventLoop &event_loop, SocketAddress address,
+		 std::size_t batch_size=DEFAULT_BATCH_SIZE);
+
+	/**
+	 * Attach a filter which discards malformed datagrams and
+	 * enable kernel receive timestamps and drop counters.  This
+	 * is needed for sockets which were not created by
+	 * CreateSocket(), e.g. those passed by systemd.
+	 *
+	 * Throws on error.
+	 */
+	static void SetupSocket(SocketDescriptor fd);
+
+	/**
+	 * Create a datagram socket, set it up (see SetupSocket())
+	 * and bind it to the given address.  The IPv6 wildcard
+	 * address accepts IPv4 datagrams as well.
+	 *
+	 * Throws on error.
+	 *
+	 * @param reuse_port set SO_REUSEPORT so multiple sockets
+	 * (e.g. one per thread) can be bound to the same address,
+	 * with the kernel distributing incoming datagrams among them
+	 */
+	static UniqueSocketDescriptor CreateSocket(SocketAddress address,
+						   bool reuse_port=false);
+
+	const RejectCounters &GetRejectCounters() const noexcept {
+		return rejects;
+	}
+
+	const RequestCounters &GetRequestCounters() const noexcept {
+		return requests;
+	}
+
+	/**
+	 * Returns the number of datagrams the kernel has dropped
+	 * because the socket's receive buffer was full (as of the
+	 * most recent datagram received).
+	 */
+	uint32_t GetDropCount() const noexcept {
+		return socket.GetDropCount();
+	}
 
 	void SendBuffer(SocketAddress address, std::span<const std::byte> src);
 
@@ -37,12 +219,79 @@ public:
 	}
 
 private:
-	void OnDatagramReceived(Client &&client, void *data, size_t length);
+	/**
+	 * Count the datagram in the #FloodFilter (if any).
+	 *
+	 * @return false if the datagram shall be discarded
+	 */
+	bool CheckSource(SocketAddress address) noexcept;
+
+	/**
+	 * Perform the cheap checks on a datagram (everything but the
+	 * CRC) and count rejected datagrams.
+	 *
+	 * @return the request type or std::nullopt if the datagram
+	 * shall be discarded
+	 */
+	std::optional<Protocol::RequestType> CheckDatagram(std::span<const std::byte> payload) noexcept;
+
+	/**
+	 * Verify the CRC of a datagram which has passed
+	 * CheckDatagram() and count mismatches.  The datagram is not
+	 * modified.
+	 */
+	bool VerifyCRC(std::span<const std::byte> payload) noexcept;
+
+	void OnDatagramReceived(Client &&client,
+				std::span<const std::byte> payload);
+
+	/**
+	 * A packet with a valid CRC has been received.
+	 */
+	void OnPacketReceived(Client &&client, Protocol::RequestType type,
+			      const void *data);
+
+	/**
+	 * Decode a #Protocol::FixBatchPacket which has passed
+	 * CheckDatagram() and pass it to OnFixBatch().
+	 */
+	void OnFixBatchPacket(const Client &client,
+			      const Protocol::FixBatchPacket &packet) noexcept;
+
+	/**
+	 * Check the time of a #Protocol::TimedFixPacket and pass it
+	 * to OnFix().
+	 */
+	void OnTimedFixPacket(const Client &client,
+			      const Protocol::TimedFixPacket &packet) noexcept;
+
+	/**
+	 * Verify the CRCs of a batch of fix packets which have passed
+	 * CheckDatagram() and handle them.
+	 */
+	void OnFixDatagrams(std::span<const MultiReceiveMessage::Datagram *const> datagrams);
 
 protected:
 	virtual void OnPing(const Client &client, unsigned id) noexcept;
 
-	virtual void OnFix(const Client &client, GeoPoint location) noexcept = 0;
+	/**
+	 * A valid #Protocol::FixPacket or #Protocol::TimedFixPacket
+	 * has been received.  The time of a #Protocol::FixPacket is
+	 * the receive time.
+	 */
+	virtual void OnFix(const Client &client,
+			   const TimedFix &fix) noexcept = 0;
+
+	/**
+	 * A valid #Protocol::FixBatchPacket has been received.  The
+	 * implementation is responsible for sending the #ACK.
+	 *
+	 * @param id the batch's id, to be copied to the #ACK
+	 * @param fixes the fixes (oldest first) with the times
+	 * reconstructed from their ages
+	 */
+	virtual void OnFixBatch(const Client &client, unsigned id,
+				std::span<const TimedFix> fixes) noexcept = 0;
 
 	/**
 	 * An error has occurred while sending a response to a client.  This
@@ -60,7 +309,11 @@ private:
 	/* virtual methods from UdpHandler */
 	bool OnUdpDatagram(std::span<const std::byte> payload,
 			   std::span<UniqueFileDescriptor> fds,
-			   SocketAddress address, int uid) final;
+			   SocketAddress address, int uid,
+			   std::chrono::system_clock::time_point timestamp) final;
+	bool OnUdpDatagrams(std::span<const MultiReceiveMessage::Datagram> datagrams) final;
+	void OnUdpReplyError(SocketAddress address,
+			     std::exception_ptr &&error) noexcept final;
 	void OnUdpError(std::exception_ptr &&error) noexcept final;
 };
 
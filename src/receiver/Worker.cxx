@@ -0,0 +1,398 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "Worker.hxx"
+#include "CommandLine.hxx"
+#include "Assemble.hxx"
+#include "Fix.hxx"
+#include "Protocol.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "lib/fmt/ToBuffer.hxx"
+#include "util/PrintException.hxx"
+
+#ifdef HAVE_URING
+#include <liburing.h>
+#endif
+
+#include <fmt/core.h>
+
+#include <limits.h>
+
+MyReceiver::MyReceiver(Worker &_worker, UniqueSocketDescriptor &&_socket,
+		       bool _count_drops, std::size_t batch_size,
+		       const Beacon::ClockWindow &_clock_window)
+	:Beacon::Receiver(_worker.GetEventLoop(), std::move(_socket), batch_size,
+			  &_worker.GetFloodFilter(), _clock_window),
+	 worker(_worker),
+	 count_drops(_count_drops)
+{
+}
+
+/**
+ * The fix interval (in seconds) recommended to clients while the
+ * database keeps up.
+ */
+static constexpr unsigned MIN_FIX_INTERVAL = 1;
+
+/**
+ * The fix interval (in seconds) recommended to clients while the
+ * database is overloaded.
+ */
+static constexpr unsigned MAX_FIX_INTERVAL = 60;
+
+/**
+ * Calculate the fix interval to be advertised in ACK packets.  It
+ * grows with the square of the #FixWriter's pressure, so clients
+ * are slowed down only when the database falls behind
+ * significantly.
+ */
+[[gnu::pure]]
+static unsigned
+CalcFixInterval(const Beacon::FixWriter &writer) noexcept
+{
+	const double pressure = writer.GetPressure();
+	return MIN_FIX_INTERVAL +
+		unsigned((MAX_FIX_INTERVAL - MIN_FIX_INTERVAL) * pressure * pressure);
+}
+
+void
+MyReceiver::OnPing(const Client &client, unsigned id) noexcept
+{
+	const uint32_t flags = worker.GetKeyReader().IsAuthorized(client.key)
+		? 0
+		: Beacon::Protocol::AckPacket::FLAG_BAD_KEY;
+
+	SendPacket(client.address,
+		   Beacon::Protocol::MakeAck(client.key, id, flags,
+					     CalcFixInterval(worker.GetWriter())));
+}
+
+void
+MyReceiver::OnFix(const Client &client,
+		  const Beacon::TimedFix &fix) noexcept
+{
+	if (!worker.GetKeyReader().IsAuthorized(client.key))
+		return;
+
+	if (worker.GetFixFilter().Check(client.key, fix.fix) != Beacon::FixFilter::Result::ACCEPT)
+		return;
+
+	worker.GetWriter().Push(fix.time, client.address, client.key, fix.fix);
+}
+
+void
+MyReceiver::OnFixBatch(const Client &client, unsigned id,
+		       std::span<const Beacon::TimedFix> fixes) noexcept
+{
+	if (!worker.GetKeyReader().IsAuthorized(client.key)) {
+		/* tell the client to stop retransmitting */
+		SendPacket(client.address,
+			   Beacon::Protocol::MakeAck(client.key, id,
+						     Beacon::Protocol::AckPacket::FLAG_BAD_KEY));
+		return;
+	}
+
+	switch (worker.GetFixFilter().CheckBatch(client.key, fixes)) {
+	case Beacon::FixFilter::Result::ACCEPT:
+		for (const auto &i : fixes)
+			worker.GetWriter().Push(i.time, client.address,
+						client.key, i.fix);
+		break;
+
+	case Beacon::FixFilter::Result::DUPLICATE:
+		/* the previous ACK was lost; send it again */
+		break;
+
+	case Beacon::FixFilter::Result::OVER_RATE:
+		/* no ACK; the client will retransmit later */
+		return;
+	}
+
+	SendPacket(client.address,
+		   Beacon::Protocol::MakeAck(client.key, id, 0,
+					     CalcFixInterval(worker.GetWriter())));
+}
+
+void
+MyReceiver::OnError(std::exception_ptr e) noexcept
+{
+	PrintException(e);
+	worker.OnReceiverError();
+}
+
+/**
+ * How often are the counters copied to #Worker::metrics?
+ */
+static constexpr Event::Duration METRICS_INTERVAL = std::chrono::seconds{1};
+
+#ifdef HAVE_URING
+/**
+ * The size of each worker's io_uring submission queue.  Each
+ * receiver occupies only one entry for its multishot operation.
+ */
+static constexpr unsigned URING_ENTRIES = 64;
+#endif
+
+static auto
+MakeJournalPath(const char *directory, unsigned index) noexcept
+{
+	return FmtBuffer<PATH_MAX>("{}/fixes-{}.journal", directory, index);
+}
+
+Worker::Worker(const Beacon::ReceiverConfig &config, unsigned index,
+	       const Beacon::KeyDatabase *key_database,
+	       UniqueFileDescriptor &&quit_fd,
+	       UniqueFileDescriptor &&_done_fd)
+	:writer(event_loop, config.database,
+		config.journal_directory != nullptr
+		? MakeJournalPath(config.journal_directory, index).c_str()
+		: nullptr,
+		config.insert_batch_size, config.max_queued_fixes,
+		config.max_ingest_memory / config.n_threads),
+	 /* with SO_REUSEPORT, the kernel distributes clients among
+	    the workers, so each one gets its share of the keys; the
+	    tables are rounded down, so together they never exceed
+	    the memory of one table for all keys */
+	 fix_filter(event_loop,
+		    Beacon::FixFilter::CalcMemory(config.max_keys) / config.n_threads,
+		    config.fix_rate, config.fix_burst),
+	 flood_filter(event_loop, config.max_address_rate),
+	 key_reader(key_database),
+	 batch_size(config.batch_size),
+	 clock_window(config.clock_window),
+	 done_fd(std::move(_done_fd)),
+	 quit_event(event_loop, BIND_THIS_METHOD(OnQuit), quit_fd.Release()),
+	 metrics_timer(event_loop, BIND_THIS_METHOD(OnMetricsTimer))
+{
+#ifdef HAVE_URING
+	if (config.io_uring)
+		/* must be enabled before the receivers are created */
+		event_loop.EnableUring(URING_ENTRIES, IORING_SETUP_COOP_TASKRUN);
+#endif
+
+	if (config.profile_loops)
+		event_loop.SetProfiler(&profiler.emplace());
+
+	quit_event.ScheduleRead();
+}
+
+Worker::~Worker() noexcept
+{
+	assert(!thread.joinable());
+
+	quit_event.Close();
+}
+
+void
+Worker::AddReceiver(UniqueSocketDescriptor &&socket, bool count_drops)
+{
+	assert(!thread.joinable());
+
+	receivers.emplace_front(*this, std::move(socket), count_drops,
+				batch_size, clock_window);
+}
+
+void
+Worker::Start()
+{
+	assert(!thread.joinable());
+
+	heartbeat.store(Event::Clock::now(), std::memory_order_relaxed);
+	thread = std::thread{&Worker::Run, this};
+}
+
+void
+Worker::Join() noexcept
+{
+	if (thread.joinable())
+		thread.join();
+}
+
+void
+Worker::Run() noexcept
+{
+	/* connect asynchronously; the receivers start immediately,
+	   and fixes are queued until the database is available */
+	writer.Connect();
+
+	metrics_timer.Schedule(METRICS_INTERVAL);
+
+	event_loop.Run();
+
+	for (auto &i : receivers) {
+		const auto &rejects = i.GetRejectCounters();
+		if (rejects.Total() > 0)
+			fmt::print(stderr, "Rejected datagrams: {} flood, {} too short, {} bad magic, {} bad type, {} bad CRC, {} bad batch, {} bad time\n",
+				   rejects.flood, rejects.too_short, rejects.bad_magic,
+				   rejects.bad_type, rejects.bad_crc, rejects.bad_batch,
+				   rejects.bad_time);
+
+		if (const auto n = i.UpdateDropCount(); n > 0)
+			fmt::print(stderr, "Datagrams dropped by the kernel (receive buffer full): {}\n", n);
+	}
+
+	const auto &filtered = fix_filter.GetCounters();
+	if (filtered.duplicate > 0 || filtered.over_rate > 0 || filtered.table_full > 0)
+		fmt::print(stderr, "Filtered fixes: {} duplicate, {} over rate, {} unfiltered (table full)\n",
+			   filtered.duplicate, filtered.over_rate, filtered.table_full);
+
+	if (const auto n = flood_filter.GetCounters().flooding_sources; n > 0)
+		fmt::print(stderr, "Flooding sources: {}\n", n);
+
+	const auto &ingest = writer.GetIngestCounters();
+	if (ingest.peak > 0)
+		fmt::print(stderr, "Ingest queue: peak {} fixes, {} superseded, {} dropped\n",
+			   ingest.peak, ingest.superseded, ingest.dropped);
+
+	if (const auto n = key_reader.GetUnknownCount(); n > 0)
+		fmt::print(stderr, "Requests with unknown keys: {}\n", n);
+
+	if (profiler)
+		PrintProfile();
+
+	/* close this thread's receiver sockets now; the #Instance
+	   keeps them open until it exits or hands them over to a new
+	   process, and meanwhile, datagrams queue up in the kernel */
+	receivers.clear();
+
+	done_fd.Close();
+}
+
+void
+Worker::PublishMetrics() noexcept
+{
+	Beacon::Receiver::RequestCounters requests;
+	Beacon::Receiver::RejectCounters rejects;
+	uint64_t kernel_drops = 0;
+
+	for (auto &i : receivers) {
+		const auto &r = i.GetRequestCounters();
+		requests.datagrams += r.datagrams;
+		requests.pings += r.pings;
+		requests.fixes += r.fixes;
+		requests.batches += r.batches;
+
+		const auto &j = i.GetRejectCounters();
+		rejects.flood += j.flood;
+		rejects.too_short += j.too_short;
+		rejects.bad_magic += j.bad_magic;
+		rejects.bad_type += j.bad_type;
+		rejects.bad_crc += j.bad_crc;
+		rejects.bad_batch += j.bad_batch;
+		rejects.bad_time += j.bad_time;
+
+		kernel_drops += i.UpdateDropCount();
+	}
+
+	metrics.datagrams.Set(requests.datagrams);
+	metrics.pings.Set(requests.pings);
+	metrics.fixes.Set(requests.fixes);
+	metrics.batches.Set(requests.batches);
+
+	metrics.rejected_flood.Set(rejects.flood);
+	metrics.rejected_too_short.Set(rejects.too_short);
+	metrics.rejected_bad_magic.Set(rejects.bad_magic);
+	metrics.rejected_bad_type.Set(rejects.bad_type);
+	metrics.rejected_bad_crc.Set(rejects.bad_crc);
+	metrics.rejected_bad_batch.Set(rejects.bad_batch);
+	metrics.rejected_bad_time.Set(rejects.bad_time);
+
+	metrics.kernel_drops.Set(kernel_drops);
+
+	const auto &filtered = fix_filter.GetCounters();
+	metrics.filtered_duplicate.Set(filtered.duplicate);
+	metrics.filtered_over_rate.Set(filtered.over_rate);
+	metrics.unfiltered.Set(filtered.table_full);
+
+	metrics.flooding_sources.Set(flood_filter.GetCounters().flooding_sources);
+	metrics.unknown_keys.Set(key_reader.GetUnknownCount());
+
+	const auto &written = writer.GetCounters();
+	metrics.committed_fixes.Set(written.committed);
+	metrics.insert_errors.Set(written.insert_errors);
+	metrics.reconnects.Set(written.reconnects);
+
+	const auto &ingest = writer.GetIngestCounters();
+	metrics.ingest_superseded.Set(ingest.superseded);
+	metrics.ingest_dropped.Set(ingest.dropped);
+
+	metrics.queue_depth.Set(writer.GetQueueDepth());
+	metrics.db_latency_us.Set(std::chrono::duration_cast<std::chrono::microseconds>(writer.GetLatency()).count());
+
+	metrics.commit_latency.Store(writer.GetCommitLatency());
+	metrics.statement_time.Store(writer.GetStatementTime());
+
+	if (profiler)
+		PublishProfile();
+}
+
+static constexpr uint64_t
+ToMicroseconds(Event::Duration d) noexcept
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+void
+Worker::PublishProfile() noexcept
+{
+	const auto &stats = profiler->GetStats();
+	metrics.loop_wakeups.Set(stats.n_waits);
+	metrics.loop_busy_us.Set(ToMicroseconds(stats.busy));
+	metrics.loop_wait_us.Set(ToMicroseconds(stats.wait));
+	metrics.loop_max_busy_us.Set(ToMicroseconds(stats.max_busy));
+	metrics.timers.Set(stats.n_timers);
+	metrics.timer_delay_us.Set(ToMicroseconds(stats.timer_delay));
+	metrics.timer_max_delay_us.Set(ToMicroseconds(stats.max_timer_delay));
+
+	for (std::size_t i = 0; i < stats.slowest.size(); ++i) {
+		const auto &c = stats.slowest[i];
+		metrics.slowest_function[i].Set(reinterpret_cast<uintptr_t>(c.function));
+		metrics.slowest_duration_us[i].Set(ToMicroseconds(c.duration));
+	}
+
+	/* the maximums are gauges: report each interval's maximum */
+	profiler->ResetMax();
+}
+
+void
+Worker::PrintProfile() const noexcept
+{
+	const auto &stats = profiler->GetStats();
+	const auto total = stats.busy + stats.wait;
+	if (total <= Event::Duration{})
+		return;
+
+	fmt::print(stderr, "Event loop: {} wakeups, {:.1f}% busy; {} timers, average delay {} ms\n",
+		   stats.n_waits,
+		   100. * stats.busy.count() / total.count(),
+		   stats.n_timers,
+		   stats.n_timers > 0
+		   ? ToMicroseconds(stats.timer_delay) / stats.n_timers / 1000
+		   : 0);
+
+	try {
+		for (const auto &c : stats.slowest)
+			if (c.duration > Event::Duration{})
+				fmt::print(stderr, "Slow callback: {} us {}\n",
+					   ToMicroseconds(c.duration),
+					   LoopProfiler::GetFunctionName(c.function));
+	} catch (...) {
+		PrintException(std::current_exception());
+	}
+}
+
+void
+Worker::OnMetricsTimer() noexcept
+{
+	heartbeat.store(event_loop.SteadyNow(), std::memory_order_relaxed);
+
+	PublishMetrics();
+	metrics_timer.Schedule(METRICS_INTERVAL);
+}
+
+void
+Worker::OnQuit(unsigned) noexcept
+{
+	quit_event.Close();
+	event_loop.Break();
+}
@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#pragma once
+
+#include "Receiver.hxx"
+#include "FixWriter.hxx"
+#include "FixFilter.hxx"
+#include "FloodFilter.hxx"
+#include "KeyDatabase.hxx"
+#include "Metrics.hxx"
+#include "event/Loop.hxx"
+#include "event/LoopProfiler.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "event/PipeEvent.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+
+#include <atomic>
+#include <forward_list>
+#include <optional>
+#include <thread>
+
+namespace Beacon { struct ReceiverConfig; }
+class Worker;
+
+class MyReceiver final : public Beacon::Receiver {
+	Worker &worker;
+
+	/**
+	 * Does this receiver count the datagrams dropped by the
+	 * kernel?  If several receivers share a socket, only one of
+	 * them does, because the counter belongs to the socket.
+	 */
+	const bool count_drops;
+
+	/**
+	 * The value of GetDropCount() at the last UpdateDropCount()
+	 * call.
+	 */
+	uint32_t last_drop_count = 0;
+
+	/**
+	 * The number of datagrams dropped by the kernel; unlike the
+	 * kernel's 32 bit counter, this does not wrap.
+	 */
+	uint64_t total_drops = 0;
+
+public:
+	MyReceiver(Worker &_worker, UniqueSocketDescriptor &&_socket,
+		   bool _count_drops, std::size_t batch_size,
+		   const Beacon::ClockWindow &_clock_window);
+
+	/**
+	 * Add the datagrams dropped by the kernel since the last
+	 * call to the total.  Must be called more often than the
+	 * kernel's counter wraps.
+	 *
+	 * @return the total, or 0 if this receiver does not count
+	 * drops
+	 */
+	uint64_t UpdateDropCount() noexcept {
+		if (!count_drops)
+			return 0;
+
+		const uint32_t n = GetDropCount();
+		total_drops += uint32_t(n - last_drop_count);
+		last_drop_count = n;
+		return total_drops;
+	}
+
+	void OnPing(const Client &client, unsigned id) noexcept override;
+
+	void OnFix(const Client &client,
+		   const Beacon::TimedFix &fix) noexcept override;
+
+	void OnFixBatch(const Client &client, unsigned id,
+			std::span<const Beacon::TimedFix> fixes) noexcept override;
+
+	void OnError(std::exception_ptr e) noexcept override;
+};
+
+/**
+ * A thread with its own #EventLoop, database connection and
+ * receiver sockets.
+ */
+class Worker {
+	EventLoop event_loop;
+
+	/**
+	 * Measures the #event_loop (only if enabled in the
+	 * #ReceiverConfig).
+	 */
+	std::optional<LoopProfiler> profiler;
+
+	Beacon::FixWriter writer;
+
+	/**
+	 * Discards duplicate and over-rate fixes before they are
+	 * passed to the #writer.
+	 */
+	Beacon::FixFilter fix_filter;
+
+	/**
+	 * Limits the datagram rate per source address; shared by all
+	 * #receivers.
+	 */
+	Beacon::FloodFilter flood_filter;
+
+	/**
+	 * Checks client keys against the "keys" table.
+	 */
+	Beacon::KeyDatabase::Reader key_reader;
+
+	const std::size_t batch_size;
+
+	const Beacon::ClockWindow clock_window;
+
+	/**
+	 * The write end of a pipe which is closed when this worker's
+	 * #EventLoop has finished, to notify the #Instance.
+	 */
+	UniqueFileDescriptor done_fd;
+
+	/**
+	 * Becomes readable (end of file) when the #Instance asks all
+	 * workers to quit.
+	 */
+	PipeEvent quit_event;
+
+	std::forward_list<MyReceiver> receivers;
+
+	/**
+	 * Copies the counters to #metrics periodically.
+	 */
+	CoarseTimerEvent metrics_timer;
+
+	/**
+	 * This worker's statistics, readable by other threads.
+	 */
+	Beacon::WorkerMetrics metrics;
+
+	/**
+	 * Updated by the #metrics_timer; if this gets old, the
+	 * #event_loop is stuck.
+	 */
+	std::atomic<Event::TimePoint> heartbeat;
+
+	std::thread thread;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param index the number of this worker, used to name its
+	 * journal file
+	 * @param key_database the set of authorized keys or nullptr
+	 * to accept all keys
+	 * @param quit_fd the read end of the "quit" pipe
+	 * @param _done_fd the write end of the "done" pipe
+	 */
+	Worker(const Beacon::ReceiverConfig &config, unsigned index,
+	       const Beacon::KeyDatabase *key_database,
+	       UniqueFileDescriptor &&quit_fd,
+	       UniqueFileDescriptor &&_done_fd);
+
+	~Worker() noexcept;
+
+	Worker(const Worker &) = delete;
+	Worker &operator=(const Worker &) = delete;
+
+	auto &GetEventLoop() noexcept {
+		return event_loop;
+	}
+
+	auto &GetWriter() noexcept {
+		return writer;
+	}
+
+	auto &GetFixFilter() noexcept {
+		return fix_filter;
+	}
+
+	auto &GetFloodFilter() noexcept {
+		return flood_filter;
+	}
+
+	auto &GetKeyReader() noexcept {
+		return key_reader;
+	}
+
+	/**
+	 * Returns this worker's statistics.  They may be read from
+	 * any thread and are updated about once per second.
+	 */
+	const Beacon::WorkerMetrics &GetMetrics() const noexcept {
+		return metrics;
+	}
+
+	/**
+	 * Returns the time of this worker's most recent sign of
+	 * life.  May be called from any thread.
+	 */
+	Event::TimePoint GetHeartbeat() const noexcept {
+		return heartbeat.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Receive datagrams on the given socket (which was created
+	 * by Receiver::CreateSocket() or set up with
+	 * Receiver::SetupSocket()).  Must be called before Start().
+	 *
+	 * Throws on error.
+	 *
+	 * @param count_drops count the datagrams dropped by the
+	 * kernel on this socket; pass true for only one of the
+	 * workers sharing a socket
+	 */
+	void AddReceiver(UniqueSocketDescriptor &&socket, bool count_drops);
+
+	/**
+	 * Launch the thread which runs the #EventLoop.
+	 *
+	 * Throws on error.
+	 */
+	void Start();
+
+	/**
+	 * Wait for the thread to finish.
+	 */
+	void Join() noexcept;
+
+	/**
+	 * A receiver has failed; stop this worker.
+	 */
+	void OnReceiverError() noexcept {
+		event_loop.Break();
+	}
+
+private:
+	void Run() noexcept;
+
+	/**
+	 * Copy all counters to #metrics.
+	 */
+	void PublishMetrics() noexcept;
+
+	/**
+	 * Copy the #profiler statistics to #metrics.
+	 */
+	void PublishProfile() noexcept;
+
+	/**
+	 * Print the #profiler statistics.
+	 */
+	void PrintProfile() const noexcept;
+
+	void OnMetricsTimer() noexcept;
+
+	void OnQuit(unsigned events) noexcept;
+};
@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include <chrono>
+
+#include <time.h>
+
+/**
+ * Convert a CLOCK_REALTIME "struct timespec" (e.g. a kernel
+ * timestamp) to a std::chrono::system_clock::time_point.
+ */
+constexpr std::chrono::system_clock::time_point
+ToSystemTimePoint(const struct timespec &ts) noexcept
+{
+	using namespace std::chrono;
+	return system_clock::time_point{duration_cast<system_clock::duration>(seconds{ts.tv_sec} + nanoseconds{ts.tv_nsec})};
+}
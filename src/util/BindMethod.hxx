@@ -48,6 +48,15 @@ public:
 		return function != nullptr;
 	}
 
+	/**
+	 * Returns the address of the wrapper function.  It
+	 * identifies the bound method (but not the instance), e.g.
+	 * for profiling.
+	 */
+	const void *GetFunctionAddress() const noexcept {
+		return reinterpret_cast<const void *>(function);
+	}
+
 	R operator()(Args... args) const noexcept(NoExcept) {
 		return function(instance_, std::forward<Args>(args)...);
 	}
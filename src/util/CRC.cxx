@@ -1,4 +1,13 @@
 #include "CRC.hxx"
+#include "ByteOrder.hxx"
+
+#include <array>
+
+#include <string.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
 const uint16_t crc16ccitt_table[256] = {
   0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
@@ -34,3 +43,278 @@ const uint16_t crc16ccitt_table[256] = {
   0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
   0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
 };
+
+/**
+ * The CRC16-CCITT generator polynomial without the x^16 term.
+ */
+static constexpr uint16_t CRC16CCITT_POLY = 0x1021;
+
+static constexpr auto
+MakeSlicingTables() noexcept
+{
+  std::array<std::array<uint16_t, 256>, 8> t{};
+
+  for (unsigned i = 0; i < 256; ++i) {
+    uint16_t crc = i << 8;
+    for (unsigned j = 0; j < 8; ++j)
+      crc = (crc & 0x8000) ? (crc << 1) ^ CRC16CCITT_POLY : crc << 1;
+    t[0][i] = crc;
+  }
+
+  for (unsigned k = 1; k < t.size(); ++k)
+    for (unsigned i = 0; i < 256; ++i)
+      t[k][i] = uint16_t(t[k - 1][i] << 8) ^ t[0][t[k - 1][i] >> 8];
+
+  return t;
+}
+
+/**
+ * Element [k][x] is the CRC of the byte x followed by k zero bytes.
+ */
+static constexpr auto crc16ccitt_slice8 = MakeSlicingTables();
+
+static inline uint64_t
+LoadBE64(const uint8_t *p) noexcept
+{
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return FromBE64(value);
+}
+
+/**
+ * Calculate the CRC (with initial value 0) of the 8 bytes of the
+ * given big-endian word.
+ */
+[[gnu::const]]
+static inline uint16_t
+Slice8(uint64_t word) noexcept
+{
+  const auto &t = crc16ccitt_slice8;
+  return t[7][word >> 56] ^ t[6][(word >> 48) & 0xff] ^
+    t[5][(word >> 40) & 0xff] ^ t[4][(word >> 32) & 0xff] ^
+    t[3][(word >> 24) & 0xff] ^ t[2][(word >> 16) & 0xff] ^
+    t[1][(word >> 8) & 0xff] ^ t[0][word & 0xff];
+}
+
+/**
+ * Update the CRC with 8 bytes.  The CRC is linear, and there is no
+ * final XOR, so the old CRC can simply be XORed into the first two
+ * bytes.
+ */
+[[gnu::pure]]
+static inline uint16_t
+Slice8Step(const uint8_t *p, uint16_t crc) noexcept
+{
+  return Slice8(LoadBE64(p) ^ (uint64_t(crc) << 48));
+}
+
+uint16_t
+UpdateCRC16CCITTSlice8(const void *data, size_t length, uint16_t crc) noexcept
+{
+  const uint8_t *p = (const uint8_t *)data;
+
+  for (; length >= 8; p += 8, length -= 8)
+    crc = Slice8Step(p, crc);
+
+  return UpdateCRC16CCITT(p, p + length, crc);
+}
+
+/**
+ * Update the CRC with the given number of zero bytes.
+ */
+[[gnu::const]]
+static inline uint16_t
+AppendZeroes(uint16_t crc, size_t n) noexcept
+{
+  for (; n >= 8; n -= 8)
+    crc = Slice8(uint64_t(crc) << 48);
+
+  for (; n > 0; --n)
+    crc = UpdateCRC16CCITT(0, crc);
+
+  return crc;
+}
+
+uint16_t
+CRC16CCITTFieldContribution(uint16_t field, size_t tail) noexcept
+{
+  /* the CRC of the two field bytes, followed by "tail" zero
+     bytes */
+  const uint16_t crc = crc16ccitt_slice8[1][field >> 8] ^
+    crc16ccitt_slice8[0][field & 0xff];
+  return AppendZeroes(crc, tail);
+}
+
+uint16_t
+CalculateCRC16CCITTSkipField(const void *data, size_t length,
+                             size_t offset) noexcept
+{
+  const uint8_t *p = (const uint8_t *)data;
+  const uint16_t field = (p[offset] << 8) | p[offset + 1];
+
+  return UpdateCRC16CCITTFast(data, length, 0) ^
+    CRC16CCITTFieldContribution(field, length - offset - 2);
+}
+
+#ifdef __x86_64__
+
+/**
+ * Calculate x^n mod P.
+ */
+static constexpr uint64_t
+XPowModPoly(unsigned n) noexcept
+{
+  uint32_t r = 1;
+  for (unsigned i = 0; i < n; ++i) {
+    r <<= 1;
+    if (r & 0x10000)
+      r ^= 0x10000 | CRC16CCITT_POLY;
+  }
+
+  return r;
+}
+
+/**
+ * Multiply the 64 bit polynomial with x^64 modulo P.  This is done
+ * by multiplying each half with the remainder of x^96 and x^64,
+ * resulting in a polynomial of degree < 48.
+ */
+[[gnu::target("pclmul")]] [[gnu::const]]
+static inline uint64_t
+FoldClmul(uint64_t acc) noexcept
+{
+  const __m128i k = _mm_set_epi64x(XPowModPoly(96), XPowModPoly(64));
+  const __m128i a = _mm_set_epi64x(acc >> 32, acc & 0xffffffff);
+  const __m128i folded = _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x00),
+                                       _mm_clmulepi64_si128(a, k, 0x11));
+  return _mm_cvtsi128_si64(folded);
+}
+
+[[gnu::target("pclmul")]]
+uint16_t
+UpdateCRC16CCITTClmul(const void *data, size_t length, uint16_t crc) noexcept
+{
+  const uint8_t *p = (const uint8_t *)data;
+
+  /* process the odd bytes first, so the rest is a multiple of 8
+     bytes */
+  const size_t head = length % 8;
+  crc = UpdateCRC16CCITT(p, p + head, crc);
+  p += head;
+  length -= head;
+
+  if (length == 0)
+    return crc;
+
+  /* "acc" is a 64 bit polynomial which is congruent (modulo P) to
+     the data processed so far */
+  uint64_t acc = LoadBE64(p) ^ (uint64_t(crc) << 48);
+  for (p += 8, length -= 8; length > 0; p += 8, length -= 8)
+    acc = FoldClmul(acc) ^ LoadBE64(p);
+
+  /* the CRC of "acc" is acc*x^16 mod P, i.e. the CRC of all
+     data */
+  return Slice8(acc);
+}
+
+[[gnu::target("pclmul")]]
+void
+CalculateCRC16CCITT32Clmul(const void *const*buffers, size_t n,
+                           uint16_t *crcs) noexcept
+{
+  size_t i = 0;
+
+  /* four independent dependency chains */
+  for (; i + 4 <= n; i += 4) {
+    const uint8_t *p0 = (const uint8_t *)buffers[i];
+    const uint8_t *p1 = (const uint8_t *)buffers[i + 1];
+    const uint8_t *p2 = (const uint8_t *)buffers[i + 2];
+    const uint8_t *p3 = (const uint8_t *)buffers[i + 3];
+
+    uint64_t a0 = LoadBE64(p0), a1 = LoadBE64(p1);
+    uint64_t a2 = LoadBE64(p2), a3 = LoadBE64(p3);
+    for (size_t j = 8; j < 32; j += 8) {
+      a0 = FoldClmul(a0) ^ LoadBE64(p0 + j);
+      a1 = FoldClmul(a1) ^ LoadBE64(p1 + j);
+      a2 = FoldClmul(a2) ^ LoadBE64(p2 + j);
+      a3 = FoldClmul(a3) ^ LoadBE64(p3 + j);
+    }
+
+    crcs[i] = Slice8(a0);
+    crcs[i + 1] = Slice8(a1);
+    crcs[i + 2] = Slice8(a2);
+    crcs[i + 3] = Slice8(a3);
+  }
+
+  for (; i < n; ++i)
+    crcs[i] = UpdateCRC16CCITTClmul(buffers[i], 32, 0);
+}
+
+#endif
+
+void
+CalculateCRC16CCITT32Slice8(const void *const*buffers, size_t n,
+                            uint16_t *crcs) noexcept
+{
+  size_t i = 0;
+
+  /* four independent dependency chains */
+  for (; i + 4 <= n; i += 4) {
+    const uint8_t *p0 = (const uint8_t *)buffers[i];
+    const uint8_t *p1 = (const uint8_t *)buffers[i + 1];
+    const uint8_t *p2 = (const uint8_t *)buffers[i + 2];
+    const uint8_t *p3 = (const uint8_t *)buffers[i + 3];
+
+    uint16_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    for (size_t j = 0; j < 32; j += 8) {
+      c0 = Slice8Step(p0 + j, c0);
+      c1 = Slice8Step(p1 + j, c1);
+      c2 = Slice8Step(p2 + j, c2);
+      c3 = Slice8Step(p3 + j, c3);
+    }
+
+    crcs[i] = c0;
+    crcs[i + 1] = c1;
+    crcs[i + 2] = c2;
+    crcs[i + 3] = c3;
+  }
+
+  for (; i < n; ++i)
+    crcs[i] = UpdateCRC16CCITTSlice8(buffers[i], 32, 0);
+}
+
+using CRC16Function = uint16_t (*)(const void *data, size_t length,
+                                   uint16_t crc) noexcept;
+using CRC16BatchFunction = void (*)(const void *const*buffers, size_t n,
+                                    uint16_t *crcs) noexcept;
+
+/**
+ * The implementations chosen for this CPU.
+ */
+static const struct CRC16Implementation {
+  CRC16Function update = UpdateCRC16CCITTSlice8;
+  CRC16BatchFunction batch32 = CalculateCRC16CCITT32Slice8;
+
+  CRC16Implementation() noexcept {
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul")) {
+      update = UpdateCRC16CCITTClmul;
+      batch32 = CalculateCRC16CCITT32Clmul;
+    }
+#endif
+  }
+} crc16ccitt_implementation;
+
+uint16_t
+UpdateCRC16CCITTFast(const void *data, size_t length, uint16_t crc) noexcept
+{
+  return crc16ccitt_implementation.update(data, length, crc);
+}
+
+void
+CalculateCRC16CCITT32(const void *const*buffers, size_t n,
+                      uint16_t *crcs) noexcept
+{
+  crc16ccitt_implementation.batch32(buffers, n, crcs);
+}
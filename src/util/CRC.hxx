@@ -28,3 +28,86 @@ UpdateCRC16CCITT(const void *data, size_t length, uint16_t crc) noexcept
   const uint8_t *p = (const uint8_t *)data, *end = p + length;
   return UpdateCRC16CCITT(p, end, crc);
 }
+
+/**
+ * Like UpdateCRC16CCITT(), but processes 8 bytes per iteration
+ * using 8 lookup tables ("slicing-by-8").
+ */
+[[gnu::pure]]
+uint16_t
+UpdateCRC16CCITTSlice8(const void *data, size_t length, uint16_t crc) noexcept;
+
+#ifdef __x86_64__
+
+/**
+ * Like UpdateCRC16CCITT(), but folds 8 bytes per iteration using
+ * carry-less multiplication (PCLMULQDQ).  Must only be called if
+ * the CPU supports it.
+ */
+[[gnu::pure]]
+uint16_t
+UpdateCRC16CCITTClmul(const void *data, size_t length, uint16_t crc) noexcept;
+
+#endif
+
+/**
+ * Like UpdateCRC16CCITT(), but uses the fastest implementation
+ * supported by this CPU (detected at startup).
+ */
+[[gnu::pure]]
+uint16_t
+UpdateCRC16CCITTFast(const void *data, size_t length, uint16_t crc) noexcept;
+
+/**
+ * Calculate the CRCs (with initial value 0) of multiple 32-byte
+ * buffers.  The calculations for several buffers are interleaved,
+ * which hides the latency of each table lookup.
+ *
+ * @param buffers an array of #n pointers to 32-byte buffers
+ * @param crcs an array of #n elements where the CRCs will be
+ * stored
+ */
+void
+CalculateCRC16CCITT32(const void *const*buffers, size_t n,
+                      uint16_t *crcs) noexcept;
+
+/**
+ * The slicing-by-8 implementation of CalculateCRC16CCITT32().
+ */
+void
+CalculateCRC16CCITT32Slice8(const void *const*buffers, size_t n,
+                            uint16_t *crcs) noexcept;
+
+#ifdef __x86_64__
+
+/**
+ * The PCLMULQDQ implementation of CalculateCRC16CCITT32().  Must
+ * only be called if the CPU supports it.
+ */
+void
+CalculateCRC16CCITT32Clmul(const void *const*buffers, size_t n,
+                           uint16_t *crcs) noexcept;
+
+#endif
+
+/**
+ * Returns the contribution of a 16-bit (big-endian) field which is
+ * followed by the given number of bytes to the CRC (with initial
+ * value 0) of a buffer.  The CRC is linear, so XORing this with the
+ * CRC of the buffer yields the CRC of the buffer with this field
+ * set to zero.
+ */
+[[gnu::const]]
+uint16_t
+CRC16CCITTFieldContribution(uint16_t field, size_t tail) noexcept;
+
+/**
+ * Calculate the CRC (with initial value 0) of a buffer as if the
+ * 16-bit field at the given offset were zero, without modifying the
+ * buffer.  This is how a CRC which is stored inside the data it
+ * covers is verified.
+ */
+[[gnu::pure]]
+uint16_t
+CalculateCRC16CCITTSkipField(const void *data, size_t length,
+                             size_t offset) noexcept;
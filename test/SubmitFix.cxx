@@ -12,35 +12,128 @@
 #include "util/CRC.hxx"
 #include "util/SpanCast.hxx"
 
+#include <cassert>
+#include <chrono>
+#include <span>
+#include <stdexcept>
+
 #include <stdio.h>
 #include <stdlib.h>
 
 namespace P = Beacon::Protocol;
 
+static void
+SendBuffer(SocketDescriptor s, SocketAddress address,
+	   P::Header &header, std::size_t size)
+{
+	header.crc = 0;
+	header.crc = ToBE16(UpdateCRC16CCITT(&header, size, 0));
+	auto nbytes = s.WriteNoWait({(const std::byte *)&header, size}, address);
+	if (nbytes < 0)
+		throw MakeSocketError("Failed to send");
+}
+
 template<typename P>
 static void
 SendPacket(SocketDescriptor s, SocketAddress address,
 	   P &&packet)
 {
-	packet.header.crc = 0;
-	packet.header.crc = ToBE16(UpdateCRC16CCITT(&packet, sizeof(packet), 0));
-	auto nbytes = s.WriteNoWait(ReferenceAsBytes(packet), address);
+	SendBuffer(s, address, packet.header, sizeof(packet));
+}
+
+/**
+ * Wait for the server's ACK and print it.
+ */
+static void
+ReceiveAck(SocketDescriptor s)
+{
+	if (s.WaitReadable(2000) <= 0)
+		throw std::runtime_error("No response");
+
+	P::AckPacket ack;
+	const auto nbytes = s.Read(ReferenceAsWritableBytes(ack));
 	if (nbytes < 0)
-		throw MakeSocketError("Failed to send");
+		throw MakeSocketError("Failed to receive");
+
+	if (std::size_t(nbytes) != sizeof(ack) ||
+	    ack.header.magic != ToBE32(P::MAGIC) ||
+	    FromBE16(ack.header.type) != uint16_t(P::ResponseType::ACK))
+		throw std::runtime_error("Malformed response");
+
+	const uint16_t crc = FromBE16(ack.header.crc);
+	ack.header.crc = 0;
+	if (UpdateCRC16CCITT(&ack, sizeof(ack), 0) != crc)
+		throw std::runtime_error("Bad CRC in response");
+
+	const uint32_t flags = FromBE32(ack.flags);
+	printf("id=%u flags=0x%x\n", FromBE16(ack.id), flags);
+
+	if (flags & P::AckPacket::FLAG_BAD_KEY)
+		printf("bad key\n");
+
+	if (flags & P::AckPacket::FLAG_INTERVAL)
+		printf("recommended interval: %us\n", FromBE16(ack.interval));
+}
+
+/**
+ * Send a PING and print the server's ACK.
+ */
+static void
+Ping(SocketDescriptor s, SocketAddress address, uint64_t key)
+{
+	P::PingPacket packet{};
+	packet.header = P::Header{P::RequestType::PING, key};
+	packet.id = ToBE16(1);
+	SendPacket(s, address, packet);
+
+	ReceiveAck(s);
+}
+
+/**
+ * Send the given fixes (oldest first, one second apart) in one
+ * #FixBatchPacket and print the server's ACK.
+ */
+static void
+SendBatch(SocketDescriptor s, SocketAddress address, uint64_t key,
+	  std::span<const Beacon::Fix> fixes)
+{
+	assert(!fixes.empty());
+	assert(fixes.size() <= P::MAX_BATCH_FIXES);
+
+	struct {
+		P::FixBatchPacket packet;
+		P::FixBatchItem items[P::MAX_BATCH_FIXES];
+	} buffer{};
+
+	buffer.packet.header = P::Header{P::RequestType::FIX_BATCH, key};
+	buffer.packet.id = ToBE16(1);
+	buffer.packet.count = ToBE16(fixes.size());
+
+	for (std::size_t i = 0; i < fixes.size(); ++i)
+		buffer.items[i] = P::ExportFixBatchItem(fixes[i],
+							std::chrono::seconds{fixes.size() - 1 - i});
+
+	SendBuffer(s, address, buffer.packet.header, buffer.packet.GetSize());
+
+	ReceiveAck(s);
 }
 
 int
 main(int argc, char **argv) noexcept
 try {
-	if (argc != 5) {
-		fprintf(stderr, "Usage: %s SERVER KEY LAT LON\n", argv[0]);
+	if (argc < 3 || argc % 2 == 0 ||
+	    std::size_t(argc - 3) / 2 > P::MAX_BATCH_FIXES) {
+		fprintf(stderr, "Usage: %s SERVER KEY [LAT LON ...]\n"
+			"\n"
+			"Without LAT/LON, send a PING and print the response.\n"
+			"With more than one LAT/LON pair, send them as one batch\n"
+			"(one second apart) and print the response.\n",
+			argv[0]);
 		return EXIT_FAILURE;
 	}
 
 	const char *server_s = argv[1];
 	const char *key_s = argv[2];
-	const char *lat_s = argv[3];
-	const char *lon_s = argv[4];
 
 	static constexpr struct addrinfo hints{
 		.ai_flags = AI_ADDRCONFIG,
@@ -51,12 +144,6 @@ try {
 	const auto ai = Resolve(server_s, P::DEFAULT_PORT_STRING, &hints);
 
 	const uint64_t key = strtoull(key_s, nullptr, 16);
-	const double lat = strtod(lat_s, nullptr);
-	const double lon = strtod(lon_s, nullptr);
-	const GeoPoint location{Angle::Degrees(lat), Angle::Degrees(lon)};
-
-	P::FixPacket packet(key);
-	packet.location = P::ExportGeoPoint(location);
 
 	const auto &server = ai.GetBest();
 
@@ -64,6 +151,36 @@ try {
 	if (!socket.Create(server.GetFamily(), server.GetType(), server.GetProtocol()))
 		throw MakeSocketError("Failed to create socket");
 
+	if (argc == 3) {
+		Ping(socket, server, key);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc > 5) {
+		Beacon::Fix fixes[P::MAX_BATCH_FIXES];
+		std::size_t n = 0;
+		for (int i = 3; i < argc; i += 2)
+			fixes[n++] = {
+				GeoPoint{
+					Angle::Degrees(strtod(argv[i], nullptr)),
+					Angle::Degrees(strtod(argv[i + 1], nullptr)),
+				},
+				Beacon::Fix::UNKNOWN_DIRECTION,
+				Beacon::Fix::UNKNOWN_SPEED,
+				Beacon::Fix::UNKNOWN_ALTITUDE,
+			};
+
+		SendBatch(socket, server, key, {fixes, n});
+		return EXIT_SUCCESS;
+	}
+
+	const double lat = strtod(argv[3], nullptr);
+	const double lon = strtod(argv[4], nullptr);
+	const GeoPoint location{Angle::Degrees(lat), Angle::Degrees(lon)};
+
+	P::FixPacket packet(key);
+	packet.location = P::ExportGeoPoint(location);
+
 	SendPacket(socket, server, packet);
 
 	return EXIT_SUCCESS;
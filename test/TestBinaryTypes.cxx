@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "pg/BinaryTypes.hxx"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace Pg;
+
+/**
+ * Copy the bytes of a #BinaryValue so they can be compared with
+ * EXPECT_EQ().
+ */
+static std::vector<uint8_t>
+ToVector(BinaryValue value) noexcept
+{
+	std::vector<uint8_t> result;
+	for (const auto b : value)
+		result.push_back(static_cast<uint8_t>(b));
+	return result;
+}
+
+using Bytes = std::vector<uint8_t>;
+
+TEST(BinaryTypes, Int4)
+{
+	EXPECT_EQ(ToVector(BinaryInt4{0}), (Bytes{0, 0, 0, 0}));
+	EXPECT_EQ(ToVector(BinaryInt4{0x01020304}), (Bytes{1, 2, 3, 4}));
+	EXPECT_EQ(ToVector(BinaryInt4{-2}), (Bytes{0xff, 0xff, 0xff, 0xfe}));
+	EXPECT_EQ(ToVector(BinaryInt4{INT32_MIN}), (Bytes{0x80, 0, 0, 0}));
+}
+
+TEST(BinaryTypes, Int8)
+{
+	EXPECT_EQ(ToVector(BinaryInt8{0x0102030405060708}),
+		  (Bytes{1, 2, 3, 4, 5, 6, 7, 8}));
+	EXPECT_EQ(ToVector(BinaryInt8{-1}),
+		  (Bytes{0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}));
+	EXPECT_EQ(ToVector(BinaryInt8{INT64_MAX}),
+		  (Bytes{0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}));
+}
+
+TEST(BinaryTypes, Float)
+{
+	EXPECT_EQ(ToVector(BinaryFloat4{1.f}), (Bytes{0x3f, 0x80, 0, 0}));
+	EXPECT_EQ(ToVector(BinaryFloat4{-2.5f}), (Bytes{0xc0, 0x20, 0, 0}));
+
+	EXPECT_EQ(ToVector(BinaryFloat8{1.}),
+		  (Bytes{0x3f, 0xf0, 0, 0, 0, 0, 0, 0}));
+	EXPECT_EQ(ToVector(BinaryFloat8{-2.5}),
+		  (Bytes{0xc0, 0x04, 0, 0, 0, 0, 0, 0}));
+}
+
+TEST(BinaryTypes, Timestamp)
+{
+	using namespace std::chrono;
+
+	/* the PostgreSQL epoch */
+	EXPECT_EQ(ToVector(BinaryTimestamp{system_clock::time_point{946684800s}}),
+		  (Bytes{0, 0, 0, 0, 0, 0, 0, 0}));
+
+	/* one microsecond later */
+	EXPECT_EQ(ToVector(BinaryTimestamp{system_clock::time_point{946684800s + 1us}}),
+		  (Bytes{0, 0, 0, 0, 0, 0, 0, 1}));
+
+	/* the Unix epoch is -946684800000000 microseconds */
+	EXPECT_EQ(ToVector(BinaryTimestamp{system_clock::time_point{}}),
+		  (Bytes{0xff, 0xfc, 0xa2, 0xfe, 0xc4, 0xc8, 0x20, 0x00}));
+}
+
+TEST(BinaryTypes, InetIPv4)
+{
+	static constexpr std::array address{
+		std::byte{127}, std::byte{0}, std::byte{0}, std::byte{1},
+	};
+
+	/* family, bits, is_cidr, length, address */
+	EXPECT_EQ(ToVector(BinaryInet{address}),
+		  (Bytes{2, 32, 0, 4, 127, 0, 0, 1}));
+}
+
+TEST(BinaryTypes, InetIPv6)
+{
+	std::array<std::byte, 16> address{};
+	address[0] = std::byte{0x20};
+	address[1] = std::byte{0x01};
+	address[15] = std::byte{0x01};
+
+	EXPECT_EQ(ToVector(BinaryInet{address}),
+		  (Bytes{3, 128, 0, 16,
+			 0x20, 0x01, 0, 0, 0, 0, 0, 0,
+			 0, 0, 0, 0, 0, 0, 0, 0x01}));
+}
+
+TEST(BinaryTypes, Point)
+{
+	/* ST_AsEWKB(ST_SetSRID(ST_MakePoint(1, 2), 4326), 'XDR') */
+	EXPECT_EQ(ToVector(BinaryPoint{1, 2, 4326}),
+		  (Bytes{0x00,
+			 0x20, 0x00, 0x00, 0x01,
+			 0x00, 0x00, 0x10, 0xe6,
+			 0x3f, 0xf0, 0, 0, 0, 0, 0, 0,
+			 0x40, 0x00, 0, 0, 0, 0, 0, 0}));
+}
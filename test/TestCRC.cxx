@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "util/CRC.hxx"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+/**
+ * The largest length tested; this covers several 8-byte blocks plus
+ * every possible remainder.
+ */
+static constexpr std::size_t MAX_LENGTH = 72;
+
+/**
+ * Random data with some slack, so the tests can start at unaligned
+ * addresses.
+ */
+static auto
+MakeData(std::mt19937 &rng) noexcept
+{
+	std::array<uint8_t, MAX_LENGTH + 8> data;
+	for (auto &i : data)
+		i = rng();
+	return data;
+}
+
+/**
+ * The bytewise table implementation is the reference.
+ */
+static uint16_t
+Reference(const void *data, std::size_t length, uint16_t crc) noexcept
+{
+	return UpdateCRC16CCITT(data, length, crc);
+}
+
+TEST(CRC, KnownValue)
+{
+	/* CRC-16/XMODEM check value */
+	static constexpr char check[] = "123456789";
+	EXPECT_EQ(Reference(check, 9, 0), 0x31c3);
+	EXPECT_EQ(UpdateCRC16CCITTSlice8(check, 9, 0), 0x31c3);
+	EXPECT_EQ(UpdateCRC16CCITTFast(check, 9, 0), 0x31c3);
+}
+
+TEST(CRC, Slice8)
+{
+	std::mt19937 rng;
+	const auto data = MakeData(rng);
+
+	for (std::size_t offset = 0; offset < 8; ++offset) {
+		for (std::size_t length = 0; length <= MAX_LENGTH; ++length) {
+			const uint16_t init = rng();
+			EXPECT_EQ(UpdateCRC16CCITTSlice8(data.data() + offset, length, init),
+				  Reference(data.data() + offset, length, init))
+				<< "offset=" << offset << " length=" << length;
+		}
+	}
+}
+
+#ifdef __x86_64__
+
+TEST(CRC, Clmul)
+{
+	if (!__builtin_cpu_supports("pclmul"))
+		GTEST_SKIP() << "CPU does not support PCLMULQDQ";
+
+	std::mt19937 rng;
+	const auto data = MakeData(rng);
+
+	for (std::size_t offset = 0; offset < 8; ++offset) {
+		for (std::size_t length = 0; length <= MAX_LENGTH; ++length) {
+			const uint16_t init = rng();
+			EXPECT_EQ(UpdateCRC16CCITTClmul(data.data() + offset, length, init),
+				  Reference(data.data() + offset, length, init))
+				<< "offset=" << offset << " length=" << length;
+		}
+	}
+}
+
+#endif
+
+TEST(CRC, Fast)
+{
+	std::mt19937 rng;
+	const auto data = MakeData(rng);
+
+	for (std::size_t length = 0; length <= MAX_LENGTH; ++length) {
+		const uint16_t init = rng();
+		EXPECT_EQ(UpdateCRC16CCITTFast(data.data() + 1, length, init),
+			  Reference(data.data() + 1, length, init))
+			<< "length=" << length;
+	}
+}
+
+/**
+ * The number of buffers in a batch; this covers several groups of
+ * four and a remainder.
+ */
+static constexpr std::size_t BATCH_SIZE = 11;
+
+using BatchFunction = void (*)(const void *const*buffers, std::size_t n,
+			       uint16_t *crcs) noexcept;
+
+static void
+CheckBatch(BatchFunction f)
+{
+	std::mt19937 rng;
+
+	std::array<uint8_t, BATCH_SIZE * 33> data;
+	for (auto &i : data)
+		i = rng();
+
+	/* 33 bytes apart, so most buffers are unaligned */
+	const void *buffers[BATCH_SIZE];
+	for (std::size_t i = 0; i < BATCH_SIZE; ++i)
+		buffers[i] = data.data() + i * 33;
+
+	for (std::size_t n = 0; n <= BATCH_SIZE; ++n) {
+		uint16_t crcs[BATCH_SIZE + 1];
+		crcs[n] = 0x5a5a;
+
+		f(buffers, n, crcs);
+
+		for (std::size_t i = 0; i < n; ++i)
+			EXPECT_EQ(crcs[i], Reference(buffers[i], 32, 0))
+				<< "n=" << n << " i=" << i;
+
+		/* must not write past the end */
+		EXPECT_EQ(crcs[n], 0x5a5a);
+	}
+}
+
+TEST(CRC, Batch32)
+{
+	CheckBatch(CalculateCRC16CCITT32);
+}
+
+TEST(CRC, Batch32Slice8)
+{
+	CheckBatch(CalculateCRC16CCITT32Slice8);
+}
+
+#ifdef __x86_64__
+
+TEST(CRC, Batch32Clmul)
+{
+	if (!__builtin_cpu_supports("pclmul"))
+		GTEST_SKIP() << "CPU does not support PCLMULQDQ";
+
+	CheckBatch(CalculateCRC16CCITT32Clmul);
+}
+
+#endif
+
+TEST(CRC, SkipField)
+{
+	std::mt19937 rng;
+
+	for (std::size_t length = 2; length <= MAX_LENGTH; ++length) {
+		for (std::size_t offset = 0; offset + 2 <= length; ++offset) {
+			auto data = MakeData(rng);
+
+			/* the CRC of the data with the field zeroed */
+			auto zeroed = data;
+			zeroed[offset] = zeroed[offset + 1] = 0;
+			const uint16_t expected = Reference(zeroed.data(), length, 0);
+
+			EXPECT_EQ(CalculateCRC16CCITTSkipField(data.data(), length, offset),
+				  expected)
+				<< "length=" << length << " offset=" << offset;
+
+			/* this is how the receiver verifies a batch */
+			const uint16_t field = (data[offset] << 8) | data[offset + 1];
+			EXPECT_EQ(Reference(data.data(), length, 0) ^
+				  CRC16CCITTFieldContribution(field, length - offset - 2),
+				  expected)
+				<< "length=" << length << " offset=" << offset;
+		}
+	}
+}
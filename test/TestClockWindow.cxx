@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "receiver/Receiver.hxx"
+#include "receiver/Import.hxx"
+#include "receiver/Protocol.hxx"
+#include "util/ByteOrder.hxx"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+using namespace Beacon;
+using namespace std::chrono_literals;
+using std::chrono::milliseconds;
+
+static constexpr std::chrono::system_clock::time_point received{1700000000s};
+static constexpr milliseconds r{1700000000000};
+
+/* the check is constexpr, so the compiler verifies that extreme
+   client values do not overflow */
+static_assert(!ClockWindow{}.Check(milliseconds::max(), received));
+static_assert(!ClockWindow{}.Check(milliseconds::min(), received));
+static_assert(!ClockWindow{}.Check(milliseconds::max() - 1ms, received));
+static_assert(!ClockWindow{}.Check(milliseconds::min() + 1ms, received));
+static_assert(ClockWindow{}.Check(r, received));
+
+TEST(ClockWindow, Default)
+{
+	const ClockWindow w;
+
+	EXPECT_TRUE(w.Check(r, received));
+
+	EXPECT_TRUE(w.Check(r + 30s, received));
+	EXPECT_FALSE(w.Check(r + 30s + 1ms, received));
+
+	EXPECT_TRUE(w.Check(r - 24h, received));
+	EXPECT_FALSE(w.Check(r - 24h - 1ms, received));
+
+	EXPECT_FALSE(w.Check(0ms, received));
+}
+
+TEST(ClockWindow, Custom)
+{
+	const ClockWindow w{.max_skew = 0s, .max_age = 1h};
+
+	EXPECT_TRUE(w.Check(r, received));
+	EXPECT_FALSE(w.Check(r + 1ms, received));
+	EXPECT_TRUE(w.Check(r - 1h, received));
+	EXPECT_FALSE(w.Check(r - 1h - 1ms, received));
+}
+
+/**
+ * The receive time has a higher resolution than the client's
+ * time; the window is still exact to the millisecond.
+ */
+TEST(ClockWindow, SubMillisecond)
+{
+	const ClockWindow w{.max_skew = 0s, .max_age = 0s};
+	const auto received2 = received + std::chrono::microseconds{999};
+
+	EXPECT_TRUE(w.Check(r, received2));
+	EXPECT_FALSE(w.Check(r + 1ms, received2));
+	EXPECT_FALSE(w.Check(r - 1ms, received2));
+}
+
+static milliseconds
+ImportRawTime(uint64_t raw) noexcept
+{
+	Protocol::TimedFixPacket packet{42};
+	packet.time = ToBE64(raw);
+	return Protocol::ImportTime(packet);
+}
+
+TEST(ClockWindow, ImportTime)
+{
+	EXPECT_EQ(ImportRawTime(1700000000000), r);
+	EXPECT_TRUE(ClockWindow{}.Check(ImportRawTime(1700000000000), received));
+
+	/* all values which do not fit into the window are
+	   rejected without overflowing */
+	static constexpr uint64_t extreme[] = {
+		0,
+		1,
+		0x7fffffffffffffff,
+		0x8000000000000000,
+		0x8000000000000001,
+		0xffffffffffffffff,
+		0x00ffffffffffffff,
+		0xff00000000000000,
+	};
+
+	for (const uint64_t raw : extreme)
+		EXPECT_FALSE(ClockWindow{}.Check(ImportRawTime(raw), received))
+			<< std::hex << raw;
+
+	EXPECT_EQ(ImportRawTime(0xffffffffffffffff), -1ms);
+	EXPECT_EQ(ImportRawTime(0x8000000000000000), milliseconds::min());
+}
@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "receiver/Receiver.hxx"
+#include "receiver/Export.hxx"
+#include "receiver/Fix.hxx"
+#include "receiver/Import.hxx"
+#include "receiver/Protocol.hxx"
+#include "event/Loop.hxx"
+#include "event/SocketEvent.hxx"
+#include "net/IPv4Address.hxx"
+#include "net/SocketError.hxx"
+#include "net/StaticSocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/ByteOrder.hxx"
+#include "util/CRC.hxx"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace P = Beacon::Protocol;
+using namespace std::chrono_literals;
+
+static constexpr Beacon::Fix
+MakeFix(double latitude, double longitude, uint16_t direction = 90,
+	uint16_t speed = 160, int16_t altitude = -12) noexcept
+{
+	return {
+		.location = {Angle::Degrees(latitude), Angle::Degrees(longitude)},
+		.direction = direction,
+		.speed = speed,
+		.altitude = altitude,
+	};
+}
+
+TEST(FixBatch, Codec)
+{
+	const auto fix = MakeFix(52.520008, -13.404954);
+	const auto item = P::ExportFixBatchItem(fix, 3600s);
+
+	const auto result = P::ImportFix(item);
+	EXPECT_NEAR(result.location.latitude.Degrees(), 52.520008, 1e-6);
+	EXPECT_NEAR(result.location.longitude.Degrees(), -13.404954, 1e-6);
+	EXPECT_EQ(result.direction, 90);
+	EXPECT_EQ(result.speed, 160);
+	EXPECT_EQ(result.altitude, -12);
+	EXPECT_EQ(P::ImportAge(item), 3600s);
+
+	/* "unknown" values survive */
+	const auto unknown = P::ImportFix(P::ExportFixBatchItem({
+		::GeoPoint::MakeInvalid(),
+		Beacon::Fix::UNKNOWN_DIRECTION,
+		Beacon::Fix::UNKNOWN_SPEED,
+		Beacon::Fix::UNKNOWN_ALTITUDE,
+	}, 0s));
+	EXPECT_FALSE(unknown.location.IsValid());
+	EXPECT_FALSE(unknown.HasDirection());
+	EXPECT_FALSE(unknown.HasSpeed());
+	EXPECT_FALSE(unknown.HasAltitude());
+}
+
+TEST(FixBatch, AgeClamped)
+{
+	const auto fix = MakeFix(1, 2);
+	EXPECT_EQ(P::ImportAge(P::ExportFixBatchItem(fix, -5s)), 0s);
+	EXPECT_EQ(P::ImportAge(P::ExportFixBatchItem(fix, 65535s)), 65535s);
+	EXPECT_EQ(P::ImportAge(P::ExportFixBatchItem(fix, 70000s)), 65535s);
+}
+
+/**
+ * A #Beacon::Receiver listening on a loopback socket which records
+ * the batches it receives, plus a client socket to send datagrams
+ * to it.
+ */
+class TestReceiver final : public Beacon::Receiver {
+	UniqueSocketDescriptor client_socket;
+	SocketEvent client_event;
+
+	const StaticSocketAddress server_address;
+
+public:
+	struct Batch {
+		uint64_t key;
+		unsigned id;
+		std::chrono::system_clock::time_point received;
+		std::vector<Beacon::TimedFix> fixes;
+	};
+
+	std::vector<Batch> batches;
+
+	TestReceiver(EventLoop &event_loop, UniqueSocketDescriptor &&_socket,
+		     StaticSocketAddress _server_address)
+		:Receiver(event_loop, std::move(_socket), DEFAULT_BATCH_SIZE,
+			  nullptr),
+		 client_event(event_loop, BIND_THIS_METHOD(OnClientReady)),
+		 server_address(_server_address)
+	{
+		if (!client_socket.CreateNonBlock(AF_INET, SOCK_DGRAM, 0) ||
+		    !client_socket.Bind(IPv4Address{127, 0, 0, 1, 0}))
+			throw MakeSocketError("Failed to create client socket");
+
+		client_event.Open(client_socket);
+		client_event.ScheduleRead();
+	}
+
+	/**
+	 * Send a datagram with a valid CRC.
+	 */
+	void Send(std::span<std::byte> datagram) {
+		auto &header = *(P::Header *)datagram.data();
+		header.crc = 0;
+		header.crc = ToBE16(UpdateCRC16CCITT(datagram.data(), datagram.size(), 0));
+
+		if (client_socket.WriteNoWait(datagram, server_address) != (ssize_t)datagram.size())
+			throw MakeSocketError("Failed to send");
+	}
+
+	/**
+	 * Send a PING and run the #EventLoop until its reply
+	 * arrives; by then, all datagrams sent before have been
+	 * handled.
+	 */
+	void Sync() {
+		P::PingPacket packet{};
+		packet.header = P::Header{P::RequestType::PING, 1};
+		packet.id = ToBE16(42);
+		Send(std::as_writable_bytes(std::span{&packet, 1}));
+
+		GetEventLoop().Run();
+	}
+
+	EventLoop &GetEventLoop() const noexcept {
+		return client_event.GetEventLoop();
+	}
+
+private:
+	void OnClientReady(unsigned) noexcept {
+		/* batches are not acknowledged by this class, so this
+		   is the reply to the PING sent by Sync() */
+		std::byte buffer[256];
+		if (client_socket.ReadNoWait(buffer) > 0)
+			GetEventLoop().Break();
+	}
+
+protected:
+	/* virtual methods from class Beacon::Receiver */
+	void OnFix(const Client &, const Beacon::TimedFix &) noexcept override {
+	}
+
+	void OnFixBatch(const Client &client, unsigned id,
+			std::span<const Beacon::TimedFix> fixes) noexcept override {
+		batches.push_back({client.key, id, client.time, {fixes.begin(), fixes.end()}});
+	}
+
+	void OnError(std::exception_ptr) noexcept override {
+		std::abort();
+	}
+};
+
+/**
+ * A #P::FixBatchPacket with room for one more item than permitted.
+ */
+struct BatchBuffer {
+	P::FixBatchPacket packet;
+	P::FixBatchItem items[P::MAX_BATCH_FIXES + 1];
+
+	BatchBuffer(uint64_t key, unsigned id, unsigned count) noexcept
+		:packet{}, items{}
+	{
+		packet.header = P::Header{P::RequestType::FIX_BATCH, key};
+		packet.id = ToBE16(id);
+		packet.count = ToBE16(count);
+	}
+
+	/**
+	 * @param n_items the number of items to send (may differ
+	 * from the "count" field)
+	 */
+	std::span<std::byte> Get(std::size_t n_items) noexcept {
+		return std::as_writable_bytes(std::span{this, 1})
+			.first(sizeof(packet) + n_items * sizeof(P::FixBatchItem));
+	}
+};
+
+static_assert(sizeof(BatchBuffer) == sizeof(P::FixBatchPacket) + (P::MAX_BATCH_FIXES + 1) * sizeof(P::FixBatchItem));
+
+class FixBatchReceiver : public ::testing::Test {
+protected:
+	EventLoop event_loop;
+	TestReceiver receiver = MakeReceiver(event_loop);
+
+	static TestReceiver MakeReceiver(EventLoop &_event_loop) {
+		auto socket = Beacon::Receiver::CreateSocket(IPv4Address{127, 0, 0, 1, 0});
+		const auto address = socket.GetLocalAddress();
+		return {_event_loop, std::move(socket), address};
+	}
+};
+
+/**
+ * The time of each fix is the receive time minus its age.
+ */
+TEST_F(FixBatchReceiver, Times)
+{
+	static constexpr std::chrono::seconds ages[] = {3600s, 60s, 0s};
+
+	BatchBuffer batch{0x1234, 7, std::size(ages)};
+	for (std::size_t i = 0; i < std::size(ages); ++i)
+		batch.items[i] = P::ExportFixBatchItem(MakeFix(50 + i, 10), ages[i]);
+
+	receiver.Send(batch.Get(std::size(ages)));
+	receiver.Sync();
+
+	ASSERT_EQ(receiver.batches.size(), 1U);
+	const auto &b = receiver.batches.front();
+	EXPECT_EQ(b.key, 0x1234U);
+	EXPECT_EQ(b.id, 7U);
+	ASSERT_EQ(b.fixes.size(), std::size(ages));
+
+	for (std::size_t i = 0; i < std::size(ages); ++i) {
+		EXPECT_EQ(b.fixes[i].time, b.received - ages[i]);
+		EXPECT_NEAR(b.fixes[i].fix.location.latitude.Degrees(), 50. + i, 1e-6);
+	}
+
+	const auto &requests = receiver.GetRequestCounters();
+	EXPECT_EQ(requests.batches, 1U);
+	EXPECT_EQ(requests.fixes, std::size(ages));
+}
+
+TEST_F(FixBatchReceiver, MaxSize)
+{
+	BatchBuffer batch{0x1234, 1, P::MAX_BATCH_FIXES};
+	receiver.Send(batch.Get(P::MAX_BATCH_FIXES));
+	receiver.Sync();
+
+	ASSERT_EQ(receiver.batches.size(), 1U);
+	EXPECT_EQ(receiver.batches.front().fixes.size(), P::MAX_BATCH_FIXES);
+	EXPECT_EQ(receiver.GetRejectCounters().Total(), 0U);
+}
+
+TEST_F(FixBatchReceiver, Malformed)
+{
+	/* no fixes */
+	BatchBuffer empty{0x1234, 1, 0};
+	receiver.Send(empty.Get(0));
+
+	/* too many fixes */
+	BatchBuffer large{0x1234, 2, P::MAX_BATCH_FIXES + 1};
+	receiver.Send(large.Get(P::MAX_BATCH_FIXES + 1));
+
+	/* the datagram is shorter than the count says */
+	BatchBuffer truncated{0x1234, 3, 3};
+	receiver.Send(truncated.Get(2));
+
+	receiver.Sync();
+
+	EXPECT_TRUE(receiver.batches.empty());
+
+	const auto &rejects = receiver.GetRejectCounters();
+	EXPECT_EQ(rejects.bad_batch, 2U);
+	EXPECT_EQ(rejects.too_short, 1U);
+	EXPECT_EQ(receiver.GetRequestCounters().batches, 0U);
+}
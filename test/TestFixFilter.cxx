@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "receiver/FixFilter.hxx"
+#include "receiver/Fix.hxx"
+#include "event/Loop.hxx"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+using namespace Beacon;
+using namespace std::chrono_literals;
+
+/**
+ * Controls the (cached) steady clock of an #EventLoop; the
+ * #FixFilter reads its time from there.
+ */
+class FakeClock {
+	EventLoop &event_loop;
+
+	/* must not be zero, or ClockCache::now() queries the real
+	   clock */
+	std::chrono::steady_clock::time_point now{1h};
+
+public:
+	explicit FakeClock(EventLoop &_event_loop) noexcept
+		:event_loop(_event_loop)
+	{
+		Update();
+	}
+
+	void Advance(std::chrono::steady_clock::duration d) noexcept {
+		now += d;
+		Update();
+	}
+
+private:
+	void Update() noexcept {
+		event_loop.GetSteadyClockCache().Mock(now);
+	}
+};
+
+static constexpr Fix
+MakeFix(double latitude, double longitude) noexcept
+{
+	return {
+		.location = {Angle::Degrees(latitude), Angle::Degrees(longitude)},
+		.direction = Fix::UNKNOWN_DIRECTION,
+		.speed = Fix::UNKNOWN_SPEED,
+		.altitude = Fix::UNKNOWN_ALTITUDE,
+	};
+}
+
+/**
+ * Returns a different fix for each value of #i.
+ */
+static constexpr Fix
+MakeFix(unsigned i) noexcept
+{
+	return MakeFix(52 + i / 1000., 13);
+}
+
+/**
+ * A memory budget which is large enough for all tests which don't
+ * check the table size.
+ */
+static constexpr std::size_t MEMORY = FixFilter::CalcMemory(1024);
+
+TEST(FixFilter, Duplicate)
+{
+	EventLoop event_loop;
+	FakeClock clock{event_loop};
+	FixFilter filter{event_loop, MEMORY, 100, 100};
+
+	const auto a = MakeFix(1), b = MakeFix(2), c = MakeFix(3);
+
+	EXPECT_EQ(filter.Check(1, a), FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.Check(1, a), FixFilter::Result::DUPLICATE);
+
+	/* other keys are not affected */
+	EXPECT_EQ(filter.Check(2, a), FixFilter::Result::ACCEPT);
+
+	/* the two most recent fixes are remembered */
+	clock.Advance(1s);
+	EXPECT_EQ(filter.Check(1, b), FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.Check(1, a), FixFilter::Result::DUPLICATE);
+	EXPECT_EQ(filter.Check(1, b), FixFilter::Result::DUPLICATE);
+
+	clock.Advance(1s);
+	EXPECT_EQ(filter.Check(1, c), FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.Check(1, a), FixFilter::Result::ACCEPT);
+
+	EXPECT_EQ(filter.GetCounters().duplicate, 3U);
+	EXPECT_EQ(filter.GetCounters().over_rate, 0U);
+}
+
+/**
+ * A stationary client which keeps sending the same location gets
+ * one fix through per duplicate window, even if it sends more
+ * often than that.
+ */
+TEST(FixFilter, DuplicateWindow)
+{
+	EventLoop event_loop;
+	FakeClock clock{event_loop};
+	FixFilter filter{event_loop, MEMORY, 100, 100};
+
+	const auto fix = MakeFix(1);
+
+	EXPECT_EQ(filter.Check(1, fix), FixFilter::Result::ACCEPT);
+
+	for (unsigned i = 1; i < 10; ++i) {
+		clock.Advance(1s);
+		EXPECT_EQ(filter.Check(1, fix), FixFilter::Result::DUPLICATE)
+			<< "after " << i << "s";
+	}
+
+	clock.Advance(1s);
+	EXPECT_EQ(filter.Check(1, fix), FixFilter::Result::ACCEPT);
+
+	/* the next window starts at the accepted fix */
+	clock.Advance(9s);
+	EXPECT_EQ(filter.Check(1, fix), FixFilter::Result::DUPLICATE);
+	clock.Advance(1s);
+	EXPECT_EQ(filter.Check(1, fix), FixFilter::Result::ACCEPT);
+}
+
+TEST(FixFilter, OverRate)
+{
+	EventLoop event_loop;
+	FakeClock clock{event_loop};
+	FixFilter filter{event_loop, MEMORY, 2, 4};
+
+	unsigned i = 0;
+
+	/* a full bucket allows a burst */
+	for (unsigned j = 0; j < 4; ++j)
+		EXPECT_EQ(filter.Check(1, MakeFix(i++)), FixFilter::Result::ACCEPT);
+
+	EXPECT_EQ(filter.Check(1, MakeFix(i++)), FixFilter::Result::OVER_RATE);
+	EXPECT_EQ(filter.Check(1, MakeFix(i++)), FixFilter::Result::OVER_RATE);
+
+	/* two tokens per second; rejected fixes don't consume
+	   any */
+	clock.Advance(1s);
+	EXPECT_EQ(filter.Check(1, MakeFix(i++)), FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.Check(1, MakeFix(i++)), FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.Check(1, MakeFix(i++)), FixFilter::Result::OVER_RATE);
+
+	clock.Advance(500ms);
+	EXPECT_EQ(filter.Check(1, MakeFix(i++)), FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.Check(1, MakeFix(i++)), FixFilter::Result::OVER_RATE);
+
+	/* the bucket does not fill beyond the burst size */
+	clock.Advance(1min);
+	for (unsigned j = 0; j < 4; ++j)
+		EXPECT_EQ(filter.Check(1, MakeFix(i++)), FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.Check(1, MakeFix(i++)), FixFilter::Result::OVER_RATE);
+
+	EXPECT_EQ(filter.GetCounters().over_rate, 5U);
+	EXPECT_EQ(filter.GetCounters().duplicate, 0U);
+}
+
+TEST(FixFilter, Batch)
+{
+	EventLoop event_loop;
+	FakeClock clock{event_loop};
+	FixFilter filter{event_loop, MEMORY, 1, 2};
+
+	const TimedFix batch[] = {
+		{std::chrono::system_clock::time_point{}, MakeFix(1)},
+		{std::chrono::system_clock::time_point{}, MakeFix(2)},
+		{std::chrono::system_clock::time_point{}, MakeFix(3)},
+	};
+
+	/* a retransmitted batch is a duplicate, but a prefix is
+	   not */
+	EXPECT_EQ(filter.CheckBatch(1, batch), FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.CheckBatch(1, batch), FixFilter::Result::DUPLICATE);
+
+	/* each batch consumes only one token */
+	EXPECT_EQ(filter.CheckBatch(1, std::span{batch}.first(2)),
+		  FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.CheckBatch(1, std::span{batch}.first(1)),
+		  FixFilter::Result::OVER_RATE);
+}
+
+TEST(FixFilter, KeyZero)
+{
+	EventLoop event_loop;
+	FakeClock clock{event_loop};
+	FixFilter filter{event_loop, MEMORY, 1, 1};
+
+	const auto fix = MakeFix(1);
+	for (unsigned i = 0; i < 10; ++i)
+		EXPECT_EQ(filter.Check(0, fix), FixFilter::Result::ACCEPT);
+}
+
+/**
+ * If the table is full, new keys are accepted without filtering,
+ * and the keys which are already in the table are still filtered.
+ */
+TEST(FixFilter, TableFull)
+{
+	EventLoop event_loop;
+	FakeClock clock{event_loop};
+
+	/* too small: this is rounded up to 16 slots, 12 of which
+	   may be used */
+	FixFilter filter{event_loop, 1, 100, 100};
+
+	const auto fix = MakeFix(1);
+
+	for (uint64_t key = 1; key <= 12; ++key)
+		EXPECT_EQ(filter.Check(key, fix), FixFilter::Result::ACCEPT);
+
+	EXPECT_EQ(filter.GetCounters().table_full, 0U);
+
+	EXPECT_EQ(filter.Check(13, fix), FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.Check(13, fix), FixFilter::Result::ACCEPT);
+	EXPECT_EQ(filter.GetCounters().table_full, 2U);
+
+	for (uint64_t key = 1; key <= 12; ++key)
+		EXPECT_EQ(filter.Check(key, fix), FixFilter::Result::DUPLICATE);
+}
+
+TEST(FixFilter, CalcMemory)
+{
+	/* 16 bytes per slot, a power of two, at most 75% used */
+	static_assert(FixFilter::CalcMemory(0) == 16 * 16);
+	static_assert(FixFilter::CalcMemory(12) == 16 * 16);
+	static_assert(FixFilter::CalcMemory(13) == 32 * 16);
+	static_assert(FixFilter::CalcMemory(1536) == 2048 * 16);
+	static_assert(FixFilter::CalcMemory(1537) == 4096 * 16);
+
+	EventLoop event_loop;
+	FakeClock clock{event_loop};
+
+	/* the budget for 1000 keys, shared by 4 instances: each
+	   has room for a quarter of the keys */
+	static constexpr std::size_t N_KEYS = 1000, N_INSTANCES = 4;
+	static constexpr std::size_t max_memory =
+		FixFilter::CalcMemory(N_KEYS) / N_INSTANCES;
+
+	FixFilter filter{event_loop, max_memory, 100, 100};
+
+	const auto fix = MakeFix(1);
+
+	for (uint64_t key = 1; key <= N_KEYS / N_INSTANCES; ++key)
+		EXPECT_EQ(filter.Check(key, fix), FixFilter::Result::ACCEPT);
+
+	EXPECT_EQ(filter.GetCounters().table_full, 0U);
+
+	for (uint64_t key = 1; key <= N_KEYS / N_INSTANCES; ++key)
+		EXPECT_EQ(filter.Check(key, fix), FixFilter::Result::DUPLICATE);
+}
@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "receiver/Handover.hxx"
+#include "net/IPv4Address.hxx"
+#include "net/LocalSocketAddress.hxx"
+#include "net/SocketError.hxx"
+#include "net/StaticSocketAddress.hxx"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace Beacon;
+
+/**
+ * A temporary directory for the handover socket.
+ */
+class HandoverTest : public ::testing::Test {
+	std::string directory;
+
+protected:
+	std::string path;
+
+	void SetUp() override {
+		char buffer[] = "/tmp/TestHandover.XXXXXX";
+		ASSERT_NE(mkdtemp(buffer), nullptr);
+		directory = buffer;
+		path = directory + "/handover";
+	}
+
+	void TearDown() override {
+		unlink(path.c_str());
+		rmdir(directory.c_str());
+	}
+};
+
+static UniqueSocketDescriptor
+CreateUdpSocket()
+{
+	UniqueSocketDescriptor s;
+	if (!s.Create(AF_INET, SOCK_DGRAM, 0) ||
+	    !s.Bind(IPv4Address{127, 0, 0, 1, 0}))
+		throw MakeSocketError("Failed to create socket");
+	return s;
+}
+
+static JournalRecord
+MakeRecord(uint64_t i) noexcept
+{
+	JournalRecord record{};
+	record.time = 1700000000000000 + i;
+	record.key = i * 7 + 1;
+	record.fix.location = {Angle::Degrees(i % 90), Angle::Degrees(13)};
+	record.fix.altitude = int16_t(i);
+	return record;
+}
+
+/**
+ * Play the old process in a separate thread: wait for the new
+ * process to connect and give it the sockets and records.
+ */
+static std::jthread
+StartGive(SocketDescriptor listener,
+	  std::span<const UniqueSocketDescriptor> sockets,
+	  std::span<const JournalRecord> records,
+	  std::exception_ptr &error)
+{
+	return std::jthread{[=, &error]{
+		try {
+			if (listener.WaitReadable(10000) <= 0)
+				throw std::runtime_error("No connection");
+
+			const UniqueSocketDescriptor peer{AdoptTag{}, listener.AcceptNonBlock()};
+			if (!peer.IsDefined())
+				throw MakeSocketError("Failed to accept");
+
+			if (!Handover::CheckPeer(peer))
+				throw std::runtime_error("Wrong peer");
+
+			Handover::Give(peer, sockets, records);
+
+			/* closing the connection tells the new
+			   process that the records are committed */
+		} catch (...) {
+			error = std::current_exception();
+		}
+	}};
+}
+
+TEST_F(HandoverTest, RoundTrip)
+{
+	std::vector<UniqueSocketDescriptor> sockets;
+	for (unsigned i = 0; i < 3; ++i)
+		sockets.emplace_back(CreateUdpSocket());
+
+	/* more than fits into the socket buffer, so both sides
+	   block in between */
+	std::vector<JournalRecord> records;
+	for (uint64_t i = 0; i < 100000; ++i)
+		records.push_back(MakeRecord(i));
+
+	const auto listener = Handover::Listen(path.c_str());
+
+	std::exception_ptr error;
+	auto thread = StartGive(listener, sockets, records, error);
+
+	auto received = Handover::TakeOver(path.c_str());
+	thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+
+	ASSERT_TRUE(received);
+
+	/* the same sockets in the same order */
+	ASSERT_EQ(received->sockets.size(), sockets.size());
+	for (std::size_t i = 0; i < sockets.size(); ++i)
+		EXPECT_EQ(received->sockets[i].GetLocalAddress().GetPort(),
+			  sockets[i].GetLocalAddress().GetPort());
+
+	ASSERT_EQ(received->records.size(), records.size());
+	for (std::size_t i = 0; i < records.size(); ++i) {
+		ASSERT_EQ(received->records[i].key, records[i].key);
+		ASSERT_EQ(received->records[i].time, records[i].time);
+		ASSERT_EQ(received->records[i].fix.altitude, records[i].fix.altitude);
+	}
+}
+
+TEST_F(HandoverTest, Empty)
+{
+	const auto listener = Handover::Listen(path.c_str());
+
+	std::exception_ptr error;
+	auto thread = StartGive(listener, {}, {}, error);
+
+	auto received = Handover::TakeOver(path.c_str());
+	thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+
+	ASSERT_TRUE(received);
+	EXPECT_TRUE(received->sockets.empty());
+	EXPECT_TRUE(received->records.empty());
+}
+
+/**
+ * Without an old process, TakeOver() returns std::nullopt.
+ */
+TEST_F(HandoverTest, NoOldProcess)
+{
+	EXPECT_FALSE(Handover::TakeOver(path.c_str()));
+
+	/* a stale socket left behind by a process which has
+	   exited */
+	{
+		UniqueSocketDescriptor s;
+		ASSERT_TRUE(s.Create(AF_LOCAL, SOCK_STREAM, 0));
+		ASSERT_TRUE(s.Bind(LocalSocketAddress{path.c_str()}));
+	}
+
+	EXPECT_FALSE(Handover::TakeOver(path.c_str()));
+}
+
+TEST_F(HandoverTest, RelativePath)
+{
+	EXPECT_THROW(Handover::Listen("handover"), std::runtime_error);
+}
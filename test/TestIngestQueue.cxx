@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "receiver/IngestQueue.hxx"
+#include "net/IPv4Address.hxx"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace Beacon;
+
+static std::chrono::system_clock::time_point
+MakeTime(unsigned seconds) noexcept
+{
+	return std::chrono::system_clock::time_point{std::chrono::seconds{1700000000 + seconds}};
+}
+
+/**
+ * Returns a different fix for each value of #i.
+ */
+static Fix
+MakeFix(unsigned i) noexcept
+{
+	return {
+		.location = {Angle::Degrees(i), Angle::Degrees(13)},
+		.direction = Fix::UNKNOWN_DIRECTION,
+		.speed = Fix::UNKNOWN_SPEED,
+		.altitude = Fix::UNKNOWN_ALTITUDE,
+	};
+}
+
+static unsigned
+GetFixNumber(const JournalRecord &record) noexcept
+{
+	return unsigned(record.fix.location.latitude.Degrees() + 0.5);
+}
+
+static const IPv4Address address{127, 0, 0, 1, 1234};
+
+TEST(IngestQueue, LatestWins)
+{
+	IngestQueue queue{16 * IngestQueue::ITEM_MEMORY};
+
+	EXPECT_TRUE(queue.Push(MakeTime(1), address, 1, MakeFix(1)));
+	EXPECT_TRUE(queue.Push(MakeTime(1), address, 2, MakeFix(2)));
+	EXPECT_TRUE(queue.Push(MakeTime(2), address, 1, MakeFix(3)));
+	EXPECT_TRUE(queue.Push(MakeTime(3), address, 1, MakeFix(4)));
+
+	EXPECT_EQ(queue.size(), 2U);
+	EXPECT_EQ(queue.GetCounters().superseded, 2U);
+	EXPECT_EQ(queue.GetCounters().peak, 2U);
+
+	/* the replaced fix keeps the position of the first one */
+	EXPECT_EQ(queue.front().key, 1U);
+	EXPECT_EQ(GetFixNumber(queue.front()), 4U);
+	EXPECT_EQ(queue.front().GetTime(), MakeTime(3));
+	queue.pop_front();
+
+	EXPECT_EQ(queue.front().key, 2U);
+	EXPECT_EQ(GetFixNumber(queue.front()), 2U);
+	queue.pop_front();
+
+	EXPECT_TRUE(queue.empty());
+	EXPECT_EQ(queue.size(), 0U);
+}
+
+/**
+ * A fix which is older than the queued one of the same key (e.g.
+ * from a batch) does not replace it, but it is counted as
+ * superseded.
+ */
+TEST(IngestQueue, OlderDoesNotReplace)
+{
+	IngestQueue queue{16 * IngestQueue::ITEM_MEMORY};
+
+	EXPECT_TRUE(queue.Push(MakeTime(10), address, 1, MakeFix(1)));
+	EXPECT_TRUE(queue.Push(MakeTime(5), address, 1, MakeFix(2)));
+
+	EXPECT_EQ(queue.size(), 1U);
+	EXPECT_EQ(queue.GetCounters().superseded, 1U);
+	EXPECT_EQ(GetFixNumber(queue.front()), 1U);
+	EXPECT_EQ(queue.front().GetTime(), MakeTime(10));
+
+	/* the same time replaces it */
+	EXPECT_TRUE(queue.Push(MakeTime(10), address, 1, MakeFix(3)));
+	EXPECT_EQ(GetFixNumber(queue.front()), 3U);
+}
+
+/**
+ * If all items are in use, fixes of new keys are dropped, but
+ * queued keys can still be updated.
+ */
+TEST(IngestQueue, Full)
+{
+	IngestQueue queue{3 * IngestQueue::ITEM_MEMORY};
+
+	EXPECT_TRUE(queue.Push(MakeTime(1), address, 1, MakeFix(1)));
+	EXPECT_TRUE(queue.Push(MakeTime(1), address, 2, MakeFix(2)));
+	EXPECT_TRUE(queue.Push(MakeTime(1), address, 3, MakeFix(3)));
+	EXPECT_FALSE(queue.Push(MakeTime(1), address, 4, MakeFix(4)));
+	EXPECT_EQ(queue.GetCounters().dropped, 1U);
+
+	EXPECT_TRUE(queue.Push(MakeTime(2), address, 2, MakeFix(5)));
+	EXPECT_EQ(queue.size(), 3U);
+
+	/* popping one makes room for a new key */
+	queue.pop_front();
+	EXPECT_TRUE(queue.Push(MakeTime(2), address, 4, MakeFix(4)));
+
+	std::vector<uint64_t> keys;
+	queue.ForEach([&keys](const JournalRecord &record){
+		keys.push_back(record.key);
+	});
+	EXPECT_EQ(keys, (std::vector<uint64_t>{2, 3, 4}));
+
+	queue.clear();
+	EXPECT_TRUE(queue.empty());
+	EXPECT_EQ(queue.GetCounters().peak, 3U);
+}
+
+/**
+ * Push and pop random keys and compare with a simple model; this
+ * exercises the removal from the hash index.
+ */
+TEST(IngestQueue, Random)
+{
+	static constexpr std::size_t CAPACITY = 64;
+	IngestQueue queue{CAPACITY * IngestQueue::ITEM_MEMORY};
+
+	/* key to fix number */
+	std::map<uint64_t, unsigned> model;
+
+	std::mt19937_64 rng;
+
+	for (unsigned i = 1; i <= 100000; ++i) {
+		if (rng() % 3 != 0) {
+			const uint64_t key = rng() % 200 + 1;
+			const unsigned n = i % 90;
+			const bool queued = model.contains(key);
+			const bool full = model.size() >= CAPACITY;
+
+			ASSERT_EQ(queue.Push(MakeTime(i), address, key, MakeFix(n)),
+				  queued || !full);
+
+			if (queued || !full)
+				model[key] = n;
+		} else if (!queue.empty()) {
+			const auto &front = queue.front();
+			const auto j = model.find(front.key);
+			ASSERT_NE(j, model.end());
+			ASSERT_EQ(GetFixNumber(front), j->second);
+			model.erase(j);
+			queue.pop_front();
+		}
+
+		ASSERT_EQ(queue.size(), model.size());
+	}
+}
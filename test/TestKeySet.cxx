@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "receiver/KeySet.hxx"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <set>
+
+using namespace Beacon;
+
+/**
+ * The number of slots, derived from the memory usage.
+ */
+static std::size_t
+GetCapacity(const KeySet &s) noexcept
+{
+	return (s.GetMemoryUsage() - sizeof(s)) / sizeof(uint64_t);
+}
+
+/**
+ * Insert distinct keys (which are not special) until the set is
+ * full.
+ *
+ * @return the number of keys inserted
+ */
+static std::size_t
+Fill(KeySet &s, uint64_t first) noexcept
+{
+	std::size_t n = 0;
+	for (uint64_t key = first; s.CanInsert(); ++key, ++n)
+		s.Insert(key);
+	return n;
+}
+
+TEST(KeySet, InsertRemove)
+{
+	KeySet s{0};
+	EXPECT_EQ(s.size(), 0U);
+	EXPECT_FALSE(s.Contains(42));
+
+	for (uint64_t key = 100; key < 110; ++key)
+		s.Insert(key);
+
+	EXPECT_EQ(s.size(), 10U);
+	for (uint64_t key = 100; key < 110; ++key)
+		EXPECT_TRUE(s.Contains(key)) << key;
+	EXPECT_FALSE(s.Contains(99));
+	EXPECT_FALSE(s.Contains(110));
+
+	/* duplicates are ignored */
+	s.Insert(105);
+	EXPECT_EQ(s.size(), 10U);
+
+	s.Remove(105);
+	EXPECT_EQ(s.size(), 9U);
+	EXPECT_FALSE(s.Contains(105));
+
+	/* the other keys are still found behind the tombstone */
+	for (uint64_t key = 100; key < 110; ++key) {
+		if (key != 105)
+			EXPECT_TRUE(s.Contains(key)) << key;
+	}
+
+	/* removing a missing key is a no-op */
+	s.Remove(105);
+	s.Remove(12345);
+	EXPECT_EQ(s.size(), 9U);
+
+	/* all bits set is a regular key */
+	s.Insert(UINT64_MAX);
+	EXPECT_TRUE(s.Contains(UINT64_MAX));
+	EXPECT_EQ(s.size(), 10U);
+}
+
+/**
+ * 0 and 1 are used as slot markers internally; they must still
+ * work as keys.
+ */
+TEST(KeySet, SpecialKeys)
+{
+	KeySet s{0};
+	EXPECT_FALSE(s.Contains(0));
+	EXPECT_FALSE(s.Contains(1));
+
+	s.Insert(0);
+	EXPECT_TRUE(s.Contains(0));
+	EXPECT_FALSE(s.Contains(1));
+	EXPECT_EQ(s.size(), 1U);
+
+	s.Insert(0);
+	s.Insert(1);
+	EXPECT_TRUE(s.Contains(1));
+	EXPECT_EQ(s.size(), 2U);
+
+	/* they do not occupy slots */
+	EXPECT_EQ(Fill(s, 2), GetCapacity(s) * 3 / 4);
+	EXPECT_EQ(s.size(), GetCapacity(s) * 3 / 4 + 2);
+
+	s.Remove(0);
+	EXPECT_FALSE(s.Contains(0));
+	EXPECT_TRUE(s.Contains(1));
+
+	s.Remove(0);
+	EXPECT_EQ(s.size(), GetCapacity(s) * 3 / 4 + 1);
+
+	/* removing 1 (the tombstone marker) does not remove
+	   anything else */
+	s.Remove(1);
+	EXPECT_FALSE(s.Contains(1));
+	EXPECT_TRUE(s.Contains(2));
+	EXPECT_EQ(s.size(), GetCapacity(s) * 3 / 4);
+}
+
+/**
+ * Removing and inserting the same key again reuses its tombstone
+ * instead of using up another slot.
+ */
+TEST(KeySet, TombstoneReuse)
+{
+	KeySet s{0};
+	const std::size_t n = Fill(s, 1000);
+
+	/* the tombstone still occupies the slot */
+	s.Remove(1000);
+	EXPECT_FALSE(s.CanInsert());
+
+	for (unsigned i = 0; i < 1000; ++i) {
+		s.Insert(1000);
+		ASSERT_TRUE(s.Contains(1000));
+		s.Remove(1000);
+		ASSERT_FALSE(s.Contains(1000));
+	}
+
+	s.Insert(1000);
+	EXPECT_EQ(s.size(), n);
+	for (uint64_t key = 1000; key < 1000 + n; ++key)
+		EXPECT_TRUE(s.Contains(key)) << key;
+}
+
+/**
+ * CanInsert() returns false when 75% of the slots are used; there is
+ * room for more keys than expected.
+ */
+TEST(KeySet, CanInsert)
+{
+	for (const std::size_t expected : {0U, 1U, 64U, 100U, 1000U, 100000U}) {
+		KeySet s{expected};
+		const std::size_t capacity = GetCapacity(s);
+		EXPECT_EQ(capacity & (capacity - 1), 0U) << capacity;
+
+		const std::size_t n = Fill(s, 2);
+		EXPECT_EQ(n, capacity * 3 / 4) << expected;
+		EXPECT_GT(n, expected);
+
+		/* lookups of missing keys stop at an empty slot */
+		EXPECT_FALSE(s.Contains(2 + n));
+		EXPECT_FALSE(s.Contains(UINT64_MAX));
+	}
+}
+
+/**
+ * Tombstones count as used slots until the set is rebuilt.
+ */
+TEST(KeySet, Rebuild)
+{
+	KeySet s{0};
+	s.Insert(0);
+	s.Insert(1);
+	const std::size_t n = Fill(s, 2);
+
+	for (uint64_t key = 2; key < 2 + n; key += 2)
+		s.Remove(key);
+
+	/* the removed keys have left tombstones */
+	EXPECT_FALSE(s.CanInsert());
+
+	const auto r = s.Rebuild();
+	EXPECT_EQ(r->size(), s.size());
+	EXPECT_TRUE(r->Contains(0));
+	EXPECT_TRUE(r->Contains(1));
+	for (uint64_t key = 2; key < 2 + n; ++key)
+		EXPECT_EQ(r->Contains(key), key % 2 == 1) << key;
+
+	/* room for at least half as many keys again */
+	EXPECT_GE(Fill(*r, 1000000), r->size() / 2);
+
+	/* the original is unchanged */
+	EXPECT_TRUE(s.Contains(3));
+	EXPECT_FALSE(s.Contains(1000000));
+}
+
+/**
+ * Random operations, compared with std::set.
+ */
+TEST(KeySet, Random)
+{
+	std::mt19937_64 random{42};
+	std::set<uint64_t> reference;
+	auto s = std::make_unique<KeySet>(0);
+
+	for (unsigned i = 0; i < 200000; ++i) {
+		/* some special and duplicate keys */
+		const uint64_t key = i % 100 == 0
+			? random() % 4
+			: random() % 100000;
+
+		if (random() % 4 == 0) {
+			s->Remove(key);
+			reference.erase(key);
+		} else {
+			if (!s->CanInsert())
+				s = s->Rebuild();
+
+			s->Insert(key);
+			reference.insert(key);
+		}
+	}
+
+	EXPECT_EQ(s->size(), reference.size());
+
+	for (uint64_t key = 0; key < 100000; ++key)
+		ASSERT_EQ(s->Contains(key), reference.contains(key)) << key;
+}
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "event/LoopProfiler.hxx"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+/**
+ * Returns a distinct fake function address.
+ */
+static const void *
+F(std::size_t i) noexcept
+{
+	static const char functions[64]{};
+	return functions + i;
+}
+
+static void
+ExpectSorted(const LoopProfiler::Stats &stats)
+{
+	for (std::size_t i = 1; i < stats.slowest.size(); ++i)
+		EXPECT_GE(stats.slowest[i - 1].duration, stats.slowest[i].duration)
+			<< "i=" << i;
+}
+
+TEST(LoopProfiler, AddSlow)
+{
+	LoopProfiler profiler;
+	const auto &slowest = profiler.GetStats().slowest;
+
+	profiler.AddSlow(F(1), 10ms);
+	profiler.AddSlow(F(2), 30ms);
+	profiler.AddSlow(F(3), 20ms);
+
+	EXPECT_EQ(slowest[0].function, F(2));
+	EXPECT_EQ(slowest[0].duration, 30ms);
+	EXPECT_EQ(slowest[1].function, F(3));
+	EXPECT_EQ(slowest[2].function, F(1));
+	EXPECT_EQ(slowest[3].duration, Event::Duration{});
+	ExpectSorted(profiler.GetStats());
+}
+
+/**
+ * Each function occupies at most one entry, with its longest
+ * duration.
+ */
+TEST(LoopProfiler, AddSlowSameFunction)
+{
+	LoopProfiler profiler;
+	const auto &slowest = profiler.GetStats().slowest;
+
+	profiler.AddSlow(F(1), 10ms);
+	profiler.AddSlow(F(2), 20ms);
+
+	/* shorter than its own entry: ignored */
+	profiler.AddSlow(F(1), 5ms);
+	EXPECT_EQ(slowest[1].function, F(1));
+	EXPECT_EQ(slowest[1].duration, 10ms);
+	EXPECT_EQ(slowest[2].duration, Event::Duration{});
+
+	/* longer: the entry is updated and moves up */
+	profiler.AddSlow(F(1), 40ms);
+	EXPECT_EQ(slowest[0].function, F(1));
+	EXPECT_EQ(slowest[0].duration, 40ms);
+	EXPECT_EQ(slowest[1].function, F(2));
+	EXPECT_EQ(slowest[2].duration, Event::Duration{});
+
+	/* nullptr (io_uring completions) is a regular function */
+	profiler.AddSlow(nullptr, 15ms);
+	profiler.AddSlow(nullptr, 25ms);
+	EXPECT_EQ(slowest[1].function, nullptr);
+	EXPECT_EQ(slowest[1].duration, 25ms);
+	EXPECT_EQ(slowest[2].function, F(2));
+	EXPECT_EQ(slowest[3].duration, Event::Duration{});
+}
+
+/**
+ * If the list is full, the fastest entry is replaced.
+ */
+TEST(LoopProfiler, AddSlowFull)
+{
+	static constexpr std::size_t N = LoopProfiler::N_SLOWEST;
+
+	LoopProfiler profiler;
+	const auto &slowest = profiler.GetStats().slowest;
+
+	for (std::size_t i = 0; i < N; ++i)
+		profiler.AddSlow(F(i), std::chrono::milliseconds(10 * (i + 1)));
+
+	EXPECT_EQ(slowest.back().function, F(0));
+	EXPECT_EQ(slowest.back().duration, 10ms);
+
+	profiler.AddSlow(F(N), 15ms);
+	EXPECT_EQ(slowest.back().function, F(N));
+	EXPECT_EQ(slowest[N - 2].function, F(1));
+
+	profiler.AddSlow(F(N + 1), 1s);
+	EXPECT_EQ(slowest.front().function, F(N + 1));
+	EXPECT_EQ(slowest.back().function, F(1));
+
+	for (const auto &i : slowest)
+		EXPECT_NE(i.function, F(0));
+
+	ExpectSorted(profiler.GetStats());
+}
+
+TEST(LoopProfiler, Invoke)
+{
+	LoopProfiler profiler;
+	const auto &slowest = profiler.GetStats().slowest;
+
+	bool invoked = false;
+	profiler.Invoke(F(1), [&invoked]{
+		invoked = true;
+		const auto start = Event::Clock::now();
+		while (Event::Clock::now() == start) {}
+	});
+
+	EXPECT_TRUE(invoked);
+	EXPECT_EQ(slowest[0].function, F(1));
+	EXPECT_GT(slowest[0].duration, Event::Duration{});
+}
+
+TEST(LoopProfiler, OnTimer)
+{
+	LoopProfiler profiler;
+	const auto &stats = profiler.GetStats();
+
+	const Event::TimePoint due{1h};
+	profiler.OnTimer(due, due + 300ms);
+	profiler.OnTimer(due, due + 100ms);
+
+	EXPECT_EQ(stats.n_timers, 2U);
+	EXPECT_EQ(stats.timer_delay, 400ms);
+	EXPECT_EQ(stats.max_timer_delay, 300ms);
+
+	profiler.ResetMax();
+	EXPECT_EQ(stats.max_timer_delay, Event::Duration{});
+	EXPECT_EQ(stats.timer_delay, 400ms);
+}
+
+TEST(LoopProfiler, GetFunctionName)
+{
+	EXPECT_EQ(LoopProfiler::GetFunctionName(nullptr), "io_uring completions");
+}
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+#include "receiver/Metrics.hxx"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <set>
+#include <sstream>
+#include <string>
+
+using namespace Beacon;
+using namespace std::chrono_literals;
+
+TEST(DurationHistogram, Buckets)
+{
+	DurationHistogram h;
+
+	/* the upper bound is inclusive ("le") */
+	h.Add(0s);
+	h.Add(1ms);
+	h.Add(1001us);
+	h.Add(10s);
+	h.Add(10s + 1us);
+	h.Add(1h);
+
+	EXPECT_EQ(h.buckets[0], 2U);
+	EXPECT_EQ(h.buckets[1], 1U);
+	EXPECT_EQ(h.buckets[DurationHistogram::BOUNDS.size() - 1], 1U);
+	EXPECT_EQ(h.buckets.back(), 2U);
+	EXPECT_EQ(h.sum, 1ms + 1001us + 10s + 10s + 1us + 1h);
+
+	SharedHistogram shared;
+	shared.Store(h);
+	EXPECT_EQ(shared.buckets[0].Get(), 2U);
+	EXPECT_EQ(shared.buckets.back().Get(), 2U);
+	EXPECT_EQ(shared.sum_us.Get(), 3620002002U);
+}
+
+TEST(Metrics, SumMax)
+{
+	WorkerMetrics a, b;
+	a.fixes.Set(3);
+	b.fixes.Set(4);
+	a.loop_max_busy_us.Set(200);
+	b.loop_max_busy_us.Set(100);
+
+	const WorkerMetrics *const workers[] = {&a, &b};
+	EXPECT_EQ(SumMetric(workers, &WorkerMetrics::fixes), 7U);
+	EXPECT_EQ(MaxMetric(workers, &WorkerMetrics::fixes), 4U);
+	EXPECT_EQ(MaxMetric(workers, &WorkerMetrics::loop_max_busy_us), 200U);
+	EXPECT_EQ(SumMetric(workers, &WorkerMetrics::pings), 0U);
+	EXPECT_EQ(SumMetric({}, &WorkerMetrics::fixes), 0U);
+}
+
+static bool
+Contains(const std::string &haystack, const std::string &line)
+{
+	return haystack.find("\n" + line + "\n") != haystack.npos;
+}
+
+TEST(Metrics, Format)
+{
+	WorkerMetrics a, b;
+	a.datagrams.Set(5);
+	b.datagrams.Set(2);
+	a.rejected_bad_crc.Set(1);
+	a.db_latency_us.Set(1500);
+	a.loop_max_busy_us.Set(250000);
+	b.loop_max_busy_us.Set(500000);
+
+	DurationHistogram h;
+	h.Add(1ms);
+	h.Add(3ms);
+	a.commit_latency.Store(h);
+	b.commit_latency.Store(h);
+
+	const WorkerMetrics *const workers[] = {&a, &b};
+	const auto out = "\n" + FormatMetrics(workers);
+
+	EXPECT_TRUE(Contains(out, "# TYPE beacon_receiver_datagrams_total counter"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_datagrams_total 7"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_rejected_datagrams_total{reason=\"bad_crc\"} 1"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_rejected_datagrams_total{reason=\"flood\"} 0"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_loop_max_busy_seconds 0.5"));
+
+	/* histogram buckets are cumulative */
+	EXPECT_TRUE(Contains(out, "# TYPE beacon_receiver_commit_latency_seconds histogram"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_commit_latency_seconds_bucket{le=\"0.001\"} 2"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_commit_latency_seconds_bucket{le=\"0.002\"} 2"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_commit_latency_seconds_bucket{le=\"0.005\"} 4"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_commit_latency_seconds_bucket{le=\"+Inf\"} 4"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_commit_latency_seconds_sum 0.008"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_commit_latency_seconds_count 4"));
+
+	/* without profiling data, there is no list of slow
+	   callbacks */
+	EXPECT_EQ(out.find("beacon_receiver_slowest_callback_seconds"), out.npos);
+
+	/* each metric has exactly one HELP and one TYPE line */
+	std::set<std::string> help, type;
+	std::istringstream s{out};
+	for (std::string line; std::getline(s, line);) {
+		if (line.starts_with("# HELP ")) {
+			EXPECT_TRUE(help.emplace(line.substr(7, line.find(' ', 7) - 7)).second) << line;
+		} else if (line.starts_with("# TYPE ")) {
+			EXPECT_TRUE(type.emplace(line.substr(7, line.find(' ', 7) - 7)).second) << line;
+		}
+	}
+
+	EXPECT_EQ(help, type);
+}
+
+/**
+ * The slowest callbacks of all workers are merged, with the maximum
+ * per function.
+ */
+TEST(Metrics, FormatSlowest)
+{
+	WorkerMetrics a, b;
+
+	/* nullptr means io_uring completions */
+	a.slowest_function[0].Set(0);
+	a.slowest_duration_us[0].Set(2000);
+	b.slowest_function[0].Set(0);
+	b.slowest_duration_us[0].Set(3000);
+	b.slowest_function[1].Set(0);
+	b.slowest_duration_us[1].Set(0);
+
+	const WorkerMetrics *const workers[] = {&a, &b};
+	const auto out = "\n" + FormatMetrics(workers);
+
+	EXPECT_TRUE(Contains(out, "# TYPE beacon_receiver_slowest_callback_seconds gauge"));
+	EXPECT_TRUE(Contains(out, "beacon_receiver_slowest_callback_seconds{function=\"io_uring completions\"} 0.003"));
+
+	std::size_t n = 0;
+	for (auto i = out.find("\nbeacon_receiver_slowest_callback_seconds{");
+	     i != out.npos;
+	     i = out.find("\nbeacon_receiver_slowest_callback_seconds{", i + 1))
+		++n;
+	EXPECT_EQ(n, 1U);
+}
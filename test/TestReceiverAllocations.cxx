@@ -0,0 +1,249 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright Max Kellermann <max.kellermann@gmail.com>
+
+/*
+ * Verify that the receive path (Receiver::OnUdpDatagrams(), the CRC
+ * batches, the #FloodFilter and the batched replies) does not
+ * allocate heap memory once it has been warmed up.
+ */
+
+#include "receiver/Receiver.hxx"
+#include "receiver/Assemble.hxx"
+#include "receiver/Fix.hxx"
+#include "receiver/FloodFilter.hxx"
+#include "receiver/Protocol.hxx"
+#include "event/Loop.hxx"
+#include "event/SocketEvent.hxx"
+#include "net/IPv4Address.hxx"
+#include "net/SocketError.hxx"
+#include "net/StaticSocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/ByteOrder.hxx"
+#include "util/CRC.hxx"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <span>
+
+namespace P = Beacon::Protocol;
+
+/**
+ * The number of operator new calls.  The test is single-threaded.
+ */
+static std::size_t n_allocations = 0;
+
+void *
+operator new(std::size_t size)
+{
+	++n_allocations;
+
+	if (void *p = std::malloc(size))
+		return p;
+
+	throw std::bad_alloc{};
+}
+
+void *
+operator new[](std::size_t size)
+{
+	++n_allocations;
+
+	if (void *p = std::malloc(size))
+		return p;
+
+	throw std::bad_alloc{};
+}
+
+void
+operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete[](void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+/**
+ * What one round sends.
+ */
+static constexpr unsigned N_FIXES = 32, N_TIMED_FIXES = 4, N_PINGS = 4,
+	N_BATCHES = 4;
+
+/**
+ * Batches and pings are acknowledged.
+ */
+static constexpr unsigned N_REPLIES = N_PINGS + N_BATCHES;
+
+class TestReceiver final : public Beacon::Receiver {
+	UniqueSocketDescriptor client_socket;
+	SocketEvent client_event;
+
+	const StaticSocketAddress server_address;
+
+	unsigned n_replies = 0;
+
+public:
+	TestReceiver(EventLoop &event_loop, UniqueSocketDescriptor &&_socket,
+		     StaticSocketAddress _server_address,
+		     Beacon::FloodFilter &_flood_filter)
+		:Receiver(event_loop, std::move(_socket), DEFAULT_BATCH_SIZE,
+			  &_flood_filter),
+		 client_event(event_loop, BIND_THIS_METHOD(OnClientReady)),
+		 server_address(_server_address)
+	{
+		if (!client_socket.CreateNonBlock(AF_INET, SOCK_DGRAM, 0) ||
+		    !client_socket.Bind(IPv4Address{127, 0, 0, 1, 0}))
+			throw MakeSocketError("Failed to create client socket");
+
+		client_event.Open(client_socket);
+		client_event.ScheduleRead();
+	}
+
+	/**
+	 * Send a mix of all request types and run the #EventLoop
+	 * until all replies have been received.
+	 */
+	void Round() {
+		n_replies = 0;
+
+		for (unsigned i = 0; i < N_FIXES; ++i)
+			SendFix(1000 + i);
+
+		for (unsigned i = 0; i < N_PINGS; ++i)
+			SendPing(2000 + i);
+
+		for (unsigned i = 0; i < N_TIMED_FIXES; ++i)
+			SendTimedFix(3000 + i);
+
+		for (unsigned i = 0; i < N_BATCHES; ++i)
+			SendBatch(4000 + i);
+
+		GetEventLoop().Run();
+	}
+
+	EventLoop &GetEventLoop() const noexcept {
+		return client_event.GetEventLoop();
+	}
+
+private:
+	void Send(P::Header &header, std::size_t size) {
+		header.crc = ToBE16(UpdateCRC16CCITT(&header, size, 0));
+
+		if (client_socket.WriteNoWait({(const std::byte *)&header, size},
+				       server_address) != (ssize_t)size)
+			throw MakeSocketError("Failed to send");
+	}
+
+	void SendFix(uint64_t key) {
+		P::FixPacket packet{key};
+		packet.location.latitude.value = ToBE32(52000000);
+		packet.location.longitude.value = ToBE32(13000000);
+		Send(packet.header, sizeof(packet));
+	}
+
+	void SendTimedFix(uint64_t key) {
+		const auto now = std::chrono::system_clock::now().time_since_epoch();
+
+		P::TimedFixPacket packet{key};
+		packet.time = ToBE64(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+		Send(packet.fix.header, sizeof(packet));
+	}
+
+	void SendPing(uint64_t key) {
+		P::PingPacket packet{};
+		packet.header = P::Header{P::RequestType::PING, key};
+		packet.id = ToBE16(42);
+		Send(packet.header, sizeof(packet));
+	}
+
+	void SendBatch(uint64_t key) {
+		struct {
+			P::FixBatchPacket packet;
+			P::FixBatchItem items[3];
+		} batch{};
+
+		batch.packet.header = P::Header{P::RequestType::FIX_BATCH, key};
+		batch.packet.id = ToBE16(7);
+		batch.packet.count = ToBE16(std::size(batch.items));
+
+		for (auto &i : batch.items) {
+			i.location = P::GeoPoint::MakeInvalid();
+			i.age = ToBE16(60);
+		}
+
+		Send(batch.packet.header, sizeof(batch));
+	}
+
+	void OnClientReady(unsigned) noexcept {
+		std::byte buffer[256];
+		while (client_socket.ReadNoWait(buffer) > 0)
+			++n_replies;
+
+		if (n_replies >= N_REPLIES)
+			GetEventLoop().Break();
+	}
+
+protected:
+	/* virtual methods from class Beacon::Receiver */
+	void OnFix(const Client &, const Beacon::TimedFix &) noexcept override {
+	}
+
+	void OnFixBatch(const Client &client, unsigned id,
+			std::span<const Beacon::TimedFix>) noexcept override {
+		SendPacket(client.address, P::MakeAck(client.key, id, 0));
+	}
+
+	void OnError(std::exception_ptr) noexcept override {
+		std::abort();
+	}
+};
+
+TEST(ReceiverAllocations, Zero)
+{
+	EventLoop event_loop;
+	Beacon::FloodFilter flood_filter{event_loop, 1000000};
+
+	auto socket = Beacon::Receiver::CreateSocket(IPv4Address{127, 0, 0, 1, 0});
+	const auto address = socket.GetLocalAddress();
+
+	TestReceiver receiver{event_loop, std::move(socket), address,
+			      flood_filter};
+
+	/* the first round may allocate (e.g. lazy initialization) */
+	receiver.Round();
+
+	const auto &requests = receiver.GetRequestCounters();
+	ASSERT_EQ(requests.datagrams,
+		  N_FIXES + N_TIMED_FIXES + N_PINGS + N_BATCHES);
+	ASSERT_EQ(requests.pings, N_PINGS);
+	ASSERT_EQ(requests.batches, N_BATCHES);
+	ASSERT_EQ(receiver.GetRejectCounters().Total(), 0U);
+
+	for (unsigned i = 0; i < 3; ++i) {
+		const std::size_t before = n_allocations;
+		receiver.Round();
+		EXPECT_EQ(n_allocations - before, 0U) << "round " << i;
+	}
+
+	EXPECT_EQ(requests.datagrams,
+		  4 * (N_FIXES + N_TIMED_FIXES + N_PINGS + N_BATCHES));
+	EXPECT_EQ(receiver.GetRejectCounters().Total(), 0U);
+}